@@ -0,0 +1,665 @@
+// Headless microbenchmarks for the text pipeline. No window or GPU needed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "stb_rect_pack.h"
+#include "stb_truetype.h"
+
+#define PJP_IMPLEMENTATION
+#include "pjp.h"
+
+#include "types.h"
+
+#define DRAW_IMPLEMENTATION
+#include "draw.h"
+
+#define TEXT_IMPLEMENTATION
+#include "text.h"
+
+#define SYNTAX_IMPLEMENTATION
+#include "syntax.h"
+
+#define DOC_IMPLEMENTATION
+#include "doc.h"
+
+#define SEARCH_IMPLEMENTATION
+#include "search.h"
+
+#define MINIMAP_IMPLEMENTATION
+#include "minimap.h"
+
+#define WRAP_IMPLEMENTATION
+#include "wrap.h"
+
+#define RASTER_IMPLEMENTATION
+#include "raster.h"
+
+#define FONT_SIZE 24.0f
+#define ATLAS_WIDTH 512
+#define ATLAS_HEIGHT 512
+
+static f64 now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The per-glyph stbtt_GetPackedQuad loop draw_text used before text_layout_batch
+static void layout_scalar(VertStore *store, FontMetrics *metrics, stbtt_packedchar *char_data, const char *text, float x, float y, bool kerning) {
+    int prev = -1;
+    for (; *text; text++) {
+        u8 ch = (u8)*text;
+        if (ch >= 32 && ch < 128) {
+            int c = ch - 32;
+            if (kerning && prev >= 0) {
+                x += font_metrics_kern(metrics, prev, c);
+            }
+            prev = c;
+            stbtt_aligned_quad quad;
+            stbtt_GetPackedQuad(char_data, ATLAS_WIDTH, ATLAS_HEIGHT, c, &x, &y, &quad, 1);
+            VertInput vert = metrics->quad[c];
+            vert.dst_rect = (Rect){quad.x0, quad.y0, quad.x1 - quad.x0, quad.y1 - quad.y0};
+            vert.src_rect = (Rect){quad.s0, quad.t0, quad.s1 - quad.s0, quad.t1 - quad.t0};
+            push_vert(store, vert);
+        }
+    }
+}
+
+static void layout_lines(VertStore *store, FontMetrics *metrics, stbtt_packedchar *char_data, char **lines, size_t line_count, bool batch, bool kerning) {
+    vert_clear(store);
+    for (size_t i = 0; i < line_count; i++) {
+        float baseline = FONT_SIZE + i * 20;
+        if (batch) {
+            text_layout_batch(store, metrics, lines[i], (int)strlen(lines[i]), 0.0f, baseline, kerning, NULL, NULL);
+        } else {
+            layout_scalar(store, metrics, char_data, lines[i], 0.0f, baseline, kerning);
+        }
+    }
+}
+
+static void bench_layout(FontMetrics *metrics, stbtt_packedchar *char_data, char **lines, size_t line_count) {
+    VertStore scalar = make_vert_store(), batch = make_vert_store();
+    for (int kerning = 0; kerning < 2; kerning++) {
+        for (int use_batch = 0; use_batch < 2; use_batch++) {
+            VertStore *store = use_batch ? &batch : &scalar;
+            u64 glyphs = 0;
+            f64 start = now(), elapsed;
+            do {
+                layout_lines(store, metrics, char_data, lines, line_count, use_batch, kerning);
+                glyphs += store->size;
+                elapsed = now() - start;
+            } while (elapsed < 1.0);
+            printf("layout %-6s %-12s %8.1f Mglyphs/s\n", use_batch ? "batch" : "scalar",
+                   kerning ? "kerning" : "no kerning", glyphs / elapsed / 1e6);
+        }
+
+        int mismatches = 0;
+        for (int i = 0; i < scalar.size; i++) {
+            if (memcmp(&scalar.data[i].dst_rect, &batch.data[i].dst_rect, sizeof(Rect)) != 0) mismatches++;
+        }
+        printf("layout %d of %d glyphs rounded to a different pixel\n", mismatches, scalar.size);
+    }
+    free_vert_store(&scalar);
+    free_vert_store(&batch);
+}
+
+#define SYNTAX_LINES 1000000
+
+static const char *get_array_line(void *user, int line) {
+    return ((char **)user)[line];
+}
+
+// Highlighting cost on a million-line document made by repeating the input
+static void bench_syntax(FontMetrics *metrics, char **lines, size_t line_count) {
+    char **doc = malloc(SYNTAX_LINES * sizeof(*doc));
+    for (int i = 0; i < SYNTAX_LINES; i++) {
+        doc[i] = lines[i % line_count];
+    }
+
+    SyntaxCache cache;
+    syntax_init(&cache, SYNTAX_LINES);
+    f64 start = now();
+    syntax_update(&cache, get_array_line, doc, SYNTAX_LINES, SYNTAX_LINES);
+    f64 elapsed = now() - start;
+    printf("syntax full scan     %8.1f Mlines/s (%.1f ms for %d lines)\n", SYNTAX_LINES / elapsed / 1e6, elapsed * 1e3, SYNTAX_LINES);
+
+    // Replace a line in the middle with one that opens a block comment,
+    // then put the original back; both re-lex only until states converge
+    int line = SYNTAX_LINES / 2;
+    char *original = doc[line];
+    char *edits[2] = {"/* unterminated", original};
+    for (int e = 0; e < 2; e++) {
+        doc[line] = edits[e];
+        syntax_lines_changed(&cache, line, 1, 1);
+        start = now();
+        int relexed = syntax_update(&cache, get_array_line, doc, SYNTAX_LINES, SYNTAX_LINES);
+        elapsed = now() - start;
+        printf("syntax edit %-8s re-lexed %7d lines in %.3f ms\n", e ? "revert" : "comment", relexed, elapsed * 1e3);
+    }
+
+    // One frame's worth of visible lines: color and lay out
+    VertStore store = make_vert_store();
+    u8 kinds[4096];
+    static const Vec4 palette[TOKEN_COUNT] = {{{1.0f, 1.0f, 1.0f, 1.0f}}};
+    int frames = 0;
+    start = now();
+    do {
+        vert_clear(&store);
+        int first = (frames * 37) % (SYNTAX_LINES - 40);
+        for (int i = first; i < first + 40; i++) {
+            if (strlen(doc[i]) >= sizeof(kinds)) continue;
+            syntax_scan_line(doc[i], syntax_line_state(&cache, i), kinds);
+            text_layout_batch(&store, metrics, doc[i], (int)strlen(doc[i]), 0.0f, FONT_SIZE + i * 20, true, kinds, palette);
+        }
+        frames++;
+        elapsed = now() - start;
+    } while (elapsed < 1.0);
+    printf("syntax 40-line frame %8.1f us\n", elapsed / frames * 1e6);
+
+    free_vert_store(&store);
+    syntax_free(&cache);
+    free(doc);
+}
+
+#define DOC_BYTES (100 << 20)
+#define DOC_EDITS 100000
+
+static int compare_f64(const void *a, const void *b) {
+    f64 x = *(const f64 *)a, y = *(const f64 *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_latency(const char *name, f64 *samples, int count) {
+    f64 total = 0.0;
+    for (int i = 0; i < count; i++) total += samples[i];
+    qsort(samples, count, sizeof(f64), compare_f64);
+    printf("doc %-14s avg %6.2f us  p99 %6.2f us  max %7.2f us\n", name,
+           total / count * 1e6, samples[count * 99 / 100] * 1e6, samples[count - 1] * 1e6);
+}
+
+// Line lengths and contents leave out \r\n, including after an edit next to one
+static void check_doc_crlf(void) {
+    const char text[] = "ab\r\ncd\r\n\r\nx";
+    char *data = malloc(sizeof(text) - 1);
+    memcpy(data, text, sizeof(text) - 1);
+    Document doc;
+    doc_init(&doc, data, sizeof(text) - 1);
+    doc_insert(&doc, doc_line_offset(&doc, 1) + doc_line_length(&doc, 1), "e", 1);
+
+    const char *expected[] = {"ab", "cde", "", "x"};
+    char *line = NULL;
+    size_t capacity = 0;
+    int mismatches = doc_line_count(&doc) != 4;
+    for (size_t i = 0; i < 4 && i < doc_line_count(&doc); i++) {
+        size_t len = doc_get_line(&doc, i, &line, &capacity);
+        if (len != doc_line_length(&doc, i) || strcmp(line, expected[i]) != 0) mismatches++;
+    }
+    printf("doc crlf %d mismatched lines\n", mismatches);
+    free(line);
+    doc_free(&doc);
+}
+
+// Edit latency on a 100MB document made by repeating the input
+static void bench_doc(const char *path) {
+    check_doc_crlf();
+
+    size_t file_size = 0;
+    char *file = (char *)read_file(path, &file_size);
+    char *data = malloc(DOC_BYTES);
+    for (size_t i = 0; i < DOC_BYTES; i += file_size) {
+        memcpy(data + i, file, i + file_size <= DOC_BYTES ? file_size : DOC_BYTES - i);
+    }
+    free(file);
+
+    Document doc;
+    f64 start = now();
+    doc_init(&doc, data, DOC_BYTES);
+    printf("doc load %d MB, %zd lines in %.1f ms\n", DOC_BYTES >> 20, doc_line_count(&doc), (now() - start) * 1e3);
+
+    f64 *samples = malloc(DOC_EDITS * sizeof(f64));
+    u32 rng = 1;
+#define DOC_RANDOM() (rng ^= rng << 13, rng ^= rng >> 17, rng ^= rng << 5, rng)
+
+    for (int i = 0; i < DOC_EDITS; i++) {
+        size_t offset = DOC_RANDOM() % doc_length(&doc);
+        start = now();
+        doc_insert(&doc, offset, "x = y;\n", 7);
+        samples[i] = now() - start;
+    }
+    print_latency("insert", samples, DOC_EDITS);
+
+    for (int i = 0; i < DOC_EDITS; i++) {
+        size_t offset = DOC_RANDOM() % (doc_length(&doc) - 8);
+        start = now();
+        doc_delete(&doc, offset, 1 + DOC_RANDOM() % 8);
+        samples[i] = now() - start;
+    }
+    print_latency("delete", samples, DOC_EDITS);
+
+    char *line = NULL;
+    size_t capacity = 0;
+    for (int i = 0; i < DOC_EDITS; i++) {
+        size_t n = DOC_RANDOM() % doc_line_count(&doc);
+        start = now();
+        doc_get_line(&doc, n, &line, &capacity);
+        samples[i] = now() - start;
+    }
+    print_latency("get line", samples, DOC_EDITS);
+#undef DOC_RANDOM
+
+    printf("doc %u pieces after %d edits\n", doc.node_count - 1, DOC_EDITS * 2);
+    free(line);
+    free(samples);
+    doc_free(&doc);
+}
+
+#define SEARCH_BYTES (100 << 20)
+
+static int search_naive(const char *hay, size_t len, const char *needle, size_t needle_len) {
+    int found = 0;
+    for (size_t i = 0; i + needle_len <= len; i++) {
+        if (memcmp(hay + i, needle, needle_len) == 0) found++;
+    }
+    return found;
+}
+
+// Find throughput over 100MB of the input, single threaded
+static void bench_search(const char *path) {
+    size_t file_size = 0;
+    char *file = (char *)read_file(path, &file_size);
+    char *data = malloc(SEARCH_BYTES);
+    for (size_t i = 0; i < SEARCH_BYTES; i += file_size) {
+        memcpy(data + i, file, i + file_size <= SEARCH_BYTES ? file_size : SEARCH_BYTES - i);
+    }
+    free(file);
+
+    const char *needles[] = {"e", "SDL_GPU", "text_layout_batch", "not in the file"};
+    size_t *offsets = NULL;
+    int capacity = 0;
+    for (int n = 0; n < 4; n++) {
+        size_t needle_len = strlen(needles[n]);
+        f64 start = now();
+        int expected = search_naive(data, SEARCH_BYTES, needles[n], needle_len);
+        f64 naive = now() - start;
+
+        int count = 0;
+        start = now();
+        search_range(data, SEARCH_BYTES, 0, SEARCH_BYTES, needles[n], needle_len, &offsets, &count, &capacity);
+        f64 simd = now() - start;
+        printf("search %-20s naive %6.2f GB/s  simd %6.2f GB/s  %d matches%s\n", needles[n],
+               SEARCH_BYTES / naive / 1e9, SEARCH_BYTES / simd / 1e9, count, count == expected ? "" : " MISMATCH");
+    }
+    free(offsets);
+    free(data);
+}
+
+#define MINIMAP_LINES 10000000
+#define MINIMAP_ROWS 1024
+
+typedef struct RepeatedFile {
+    char *data;
+    size_t *line_start; // line_count + 1 entries
+    int line_count;
+} RepeatedFile;
+
+// Feeds stale lines of a document made by repeating one file, at most
+// `budget` lines, never crossing the end of a repetition
+static int minimap_feed(Minimap *m, RepeatedFile *file, int budget) {
+    int first, count;
+    if (!minimap_next_scan(m, budget, &first, &count)) return 0;
+    int line = first % file->line_count;
+    if (line + count > file->line_count) count = file->line_count - line;
+    size_t start = file->line_start[line], end = file->line_start[line + count] - 1;
+    minimap_scan(m, first, count, file->data + start, end - start);
+    return count;
+}
+
+// Per-frame minimap cost on a 10M-line document made by repeating the input
+static void bench_minimap(const char *path) {
+    RepeatedFile file = {0};
+    size_t file_size = 0;
+    file.data = (char *)read_file(path, &file_size);
+    file.line_start = malloc((file_size + 2) * sizeof(size_t));
+    file.line_start[0] = 0;
+    for (size_t i = 0; i < file_size; i++) {
+        if (file.data[i] == '\n') file.line_start[++file.line_count] = i + 1;
+    }
+
+    Minimap m;
+    minimap_init(&m, MINIMAP_LINES, MINIMAP_ROWS);
+    f64 start = now();
+    while (minimap_feed(&m, &file, MINIMAP_LINES));
+    f64 scan = now() - start;
+    start = now();
+    minimap_update(&m, MINIMAP_LINES);
+    f64 update = now() - start;
+    printf("minimap build %d lines: scan %.1f ms, pyramid %.1f ms (%d lines per row)\n", MINIMAP_LINES, scan * 1e3, update * 1e3, 1 << m.shift);
+
+    int frames = 0;
+    start = now();
+    do {
+        minimap_update(&m, 2048);
+        frames++;
+    } while (now() - start < 0.2);
+    printf("minimap idle frame     %8.2f us\n", (now() - start) / frames * 1e6);
+
+    // The first edit moves the gap in the mask array from the end of the
+    // file to the edit; edits after that only move it locally
+    start = now();
+    minimap_lines_changed(&m, 100, 1, 1);
+    printf("minimap first edit     %8.2f us\n", (now() - start) * 1e6);
+
+    // Typing inside a line: one mask, one block, one path up the pyramid
+    frames = 0;
+    start = now();
+    do {
+        minimap_lines_changed(&m, 100 + frames % 50, 1, 1);
+        minimap_feed(&m, &file, 20000);
+        minimap_update(&m, 2048);
+        frames++;
+    } while (now() - start < 0.2);
+    printf("minimap typing frame   %8.2f us\n", (now() - start) / frames * 1e6);
+
+    // A new line near the top shifts everything below it, which is worked
+    // off a budget of blocks per frame
+    start = now();
+    minimap_lines_changed(&m, 120, 1, 2);
+    printf("minimap newline        %8.2f us (mask array grows)\n", (now() - start) * 1e6);
+    start = now();
+    minimap_lines_changed(&m, 121, 1, 2);
+    printf("minimap second newline %8.2f us\n", (now() - start) * 1e6);
+    f64 worst = 0.0, total = 0.0;
+    frames = 0;
+    start = now();
+    while (m.scan_from < m.scan_until || m.block_from < m.block_until) {
+        minimap_feed(&m, &file, 20000);
+        minimap_update(&m, 2048);
+        f64 t = now();
+        if (t - start > worst) worst = t - start;
+        total += t - start;
+        start = t;
+        frames++;
+    }
+    printf("minimap newline at top %8.2f us avg, %.2f us worst frame, %d frames to settle\n", total / frames * 1e6, worst * 1e6, frames);
+
+    minimap_free(&m);
+    free(file.line_start);
+    free(file.data);
+}
+
+#define WRAP_LINES 10000000
+#define WRAP_VISIBLE 60
+
+typedef struct RepeatedLines {
+    char **lines;
+    size_t count;
+} RepeatedLines;
+
+static const char *get_repeated_line(void *user, int line) {
+    RepeatedLines *r = user;
+    return r->lines[line % r->count];
+}
+
+// Random line inserts and removals, some spanning and splitting blocks,
+// checked against a plain array of row counts
+static void check_wrap_edits(void) {
+    int count = 3000, capacity = 1 << 16;
+    int *rows = malloc(capacity * sizeof(int));
+    Wrap w;
+    wrap_init(&w, count, 300.0f);
+    for (int i = 0; i < count; i++) rows[i] = 1;
+    srand(2);
+    int mismatches = 0;
+    for (int op = 0; op < 2000; op++) {
+        int line = rand() % (count + 1);
+        int removed = rand() % 4 ? rand() % 3 : rand() % 700;
+        if (removed > count - line) removed = count - line;
+        int inserted = rand() % 4 ? rand() % 3 : rand() % 700;
+        if (count - removed + inserted > capacity) inserted = 0;
+        wrap_lines_changed(&w, line, removed, inserted);
+        if (inserted != removed) {
+            memmove(rows + line + inserted, rows + line + removed, (count - line - removed) * sizeof(int));
+            for (int i = line; i < line + inserted; i++) rows[i] = 1;
+            count += inserted - removed;
+        }
+        for (int i = 0; i < 20 && count > 0; i++) {
+            int changed = rand() % count;
+            rows[changed] = 1 + rand() % 5;
+            wrap_set_rows(&w, changed, rows[changed]);
+        }
+        if (op % 100) continue;
+        int row = 0;
+        for (int i = 0; i < count; i++) {
+            int row_in_line;
+            if (wrap_line_row(&w, i) != row) mismatches++;
+            if (wrap_row_line(&w, row + rows[i] - 1, &row_in_line) != i || row_in_line != rows[i] - 1) mismatches++;
+            row += rows[i];
+        }
+        if (w.count != count || wrap_total_rows(&w) != row) mismatches++;
+    }
+    printf("wrap edits %d mismatches over %d blocks\n", mismatches, w.block_count);
+    wrap_free(&w);
+    free(rows);
+}
+
+// Soft wrap on a 10M-line document made by repeating the input
+static void bench_wrap(FontMetrics *metrics, char **lines, size_t line_count) {
+    check_wrap_edits();
+
+    RepeatedLines doc = {lines, line_count};
+    Wrap w;
+    wrap_init(&w, WRAP_LINES, 300.0f);
+    f64 start = now();
+    wrap_update(&w, metrics, get_repeated_line, &doc, WRAP_LINES);
+    f64 elapsed = now() - start;
+    printf("wrap all %d lines     %8.1f ms (%d rows)\n", WRAP_LINES, elapsed * 1e3, wrap_total_rows(&w));
+
+    // A screenful of lines, first wrapped with their prefixes measured and
+    // cached, then re-wrapped at other widths as during a resize
+    int first = WRAP_LINES / 2;
+    int breaks[1024];
+    start = now();
+    for (int i = first; i < first + WRAP_VISIBLE; i++) {
+        const char *text = get_repeated_line(&doc, i);
+        wrap_line(&w, metrics, i, text, (int)strlen(text), breaks, 1024);
+    }
+    printf("wrap screen, measured %8.2f us\n", (now() - start) * 1e6);
+    int frames = 0;
+    start = now();
+    do {
+        w.width = 200.0f + frames % 400;
+        for (int i = first; i < first + WRAP_VISIBLE; i++) {
+            const char *text = get_repeated_line(&doc, i);
+            wrap_line(&w, metrics, i, text, (int)strlen(text), breaks, 1024);
+        }
+        frames++;
+    } while (now() - start < 0.2);
+    printf("wrap screen, cached   %8.2f us\n", (now() - start) / frames * 1e6);
+
+    u32 rng = 1;
+    int total = wrap_total_rows(&w);
+    u64 sink = 0;
+    start = now();
+    for (int i = 0; i < 1000000; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        int row_in_line;
+        sink += wrap_row_line(&w, (int)(rng % total), &row_in_line);
+        sink += wrap_line_row(&w, (int)(rng % WRAP_LINES));
+    }
+    printf("wrap row <-> line     %8.1f ns (%d)\n", (now() - start) / 1e6 * 1e9, (int)(sink & 1));
+
+    // Enter and line joins all over the document, each followed by the
+    // lookups a frame does
+    start = now();
+    for (int i = 0; i < 100000; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        int line = (int)(rng % (w.count - 1));
+        wrap_lines_changed(&w, line, i % 2 ? 2 : 1, i % 2 ? 1 : 2);
+        int row_in_line;
+        sink += wrap_row_line(&w, wrap_line_row(&w, line), &row_in_line);
+    }
+    printf("wrap line edit        %8.1f ns with a lookup (%d)\n", (now() - start) / 1e5 * 1e9, (int)(sink & 1));
+
+    start = now();
+    wrap_set_width(&w, 500.0f);
+    printf("wrap resize           %8.1f ms to mark all lines stale\n", (now() - start) * 1e3);
+    wrap_free(&w);
+}
+
+#define RASTER_WIDTH 1920
+#define RASTER_HEIGHT 1080
+
+static f64 raster_frame_time(Raster *r, VertStore *store, const RasterTexture *texture) {
+    int frames = 0;
+    f64 start = now();
+    do {
+        raster_draw(r, store->data, store->size, texture);
+        frames++;
+    } while (now() - start < 0.5);
+    return (now() - start) / frames;
+}
+
+static float random_range(float min, float max) {
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static Vec4 random_color(void) {
+    return (Vec4){{random_range(0.0f, 1.0f), random_range(0.0f, 1.0f), random_range(0.0f, 1.0f), rand() % 2 ? 1.0f : random_range(0.0f, 1.0f)}};
+}
+
+// Randomized quads at sub-pixel positions and odd sizes, some crossing the
+// edges, on an odd sized framebuffer so tiles and SSE2 spans end partway.
+// Every kind of quad and both store paths get exercised; the fast path has
+// to stay within 1 of the reference on every channel.
+static bool check_raster_random(const RasterTexture *texture) {
+    int width = 333, height = 217;
+    VertStore store = make_vert_store();
+    srand(1);
+    for (int i = 0; i < 2000; i++) {
+        Rect rect = {random_range(-20.0f, width), random_range(-20.0f, height), random_range(0.5f, 120.0f), random_range(0.5f, 80.0f)};
+        float shortest = rect.w < rect.h ? rect.w : rect.h;
+        switch (rand() % 4) {
+        case 0:
+            draw_rect(&store, rect, random_color());
+            break;
+        case 1: {
+            Vec4 colors[4] = {random_color(), random_color(), random_color(), random_color()};
+            draw_gradient(&store, rect, colors);
+        } break;
+        case 2:
+            draw_box(&store, rect, random_color(), random_range(0.0f, shortest / 2), rand() % 3 ? random_range(0.5f, 4.0f) : 0.0f, random_color());
+            break;
+        case 3: {
+            Rect src = {random_range(0.0f, 0.9f), random_range(0.0f, 0.9f), random_range(0.01f, 0.1f), random_range(0.01f, 0.1f)};
+            draw_image(&store, rect, src, random_color());
+        } break;
+        }
+    }
+
+    Raster reference, fast;
+    raster_init(&reference, width, height, 1);
+    reference.reference = true;
+    raster_draw(&reference, store.data, store.size, texture);
+    int worst = 0;
+    int threads[] = {1, 3};
+    for (int t = 0; t < 2; t++) {
+        raster_init(&fast, width, height, threads[t]);
+        raster_draw(&fast, store.data, store.size, texture);
+        for (int i = 0; i < width * height * 4; i++) {
+            int d = abs(fast.pixels[i] - reference.pixels[i]);
+            if (d > worst) worst = d;
+        }
+        raster_free(&fast);
+    }
+    printf("raster random %d quads differ from the reference by at most %d%s\n", store.size, worst, worst > 1 ? ", FAILED" : "");
+    raster_free(&reference);
+    free_vert_store(&store);
+    return worst <= 1;
+}
+
+// A 1080p editor frame drawn by the software renderer: bordered panels,
+// a gradient, and a screenful of text
+static bool bench_raster(FontMetrics *metrics, u8 *atlas, char **lines, size_t line_count) {
+    RasterTexture texture = {atlas, ATLAS_WIDTH, ATLAS_HEIGHT};
+    bool ok = check_raster_random(&texture);
+
+    VertStore store = make_vert_store();
+    Vec4 panel = {{0.15f, 0.15f, 0.18f, 1.0f}}, edge = {{0.5f, 0.5f, 0.6f, 1.0f}};
+    for (int i = 0; i < 4; i++) {
+        draw_box(&store, (Rect){20.0f + i * 470.0f, 20.0f, 450.0f, 1040.0f}, panel, 12.0f, 2.0f, edge);
+    }
+    Vec4 bar[4] = {{{0.2f, 0.2f, 0.8f, 1.0f}}, {{0.8f, 0.2f, 0.2f, 1.0f}}, {{0.2f, 0.8f, 0.2f, 0.5f}}, {{0.8f, 0.8f, 0.2f, 1.0f}}};
+    draw_gradient(&store, (Rect){0.0f, 1040.0f, RASTER_WIDTH, 40.0f}, bar);
+    for (size_t i = 0; i < line_count && i < 50; i++) {
+        for (int column = 0; column < 4; column++) {
+            text_layout_batch(&store, metrics, lines[i], (int)strlen(lines[i]), 30.0f + column * 470.0f, FONT_SIZE + 20.0f + i * 20, true, NULL, NULL);
+        }
+    }
+
+    Raster reference, fast;
+    raster_init(&reference, RASTER_WIDTH, RASTER_HEIGHT, 1);
+    reference.reference = true;
+    raster_draw(&reference, store.data, store.size, &texture);
+
+    int threads[] = {1, 2, 4, 8};
+    for (int t = 0; t < 4; t++) {
+        raster_init(&fast, RASTER_WIDTH, RASTER_HEIGHT, threads[t]);
+        f64 frame = raster_frame_time(&fast, &store, &texture);
+        printf("raster %d thread%s       %8.2f ms (%.0f Mpixels/s)\n", threads[t], threads[t] > 1 ? "s" : " ",
+               frame * 1e3, RASTER_WIDTH * RASTER_HEIGHT / frame / 1e6);
+        if (t == 0) {
+            int differ = 0, worst = 0;
+            for (int i = 0; i < RASTER_WIDTH * RASTER_HEIGHT * 4; i++) {
+                int d = abs(fast.pixels[i] - reference.pixels[i]);
+                if (d) differ++;
+                if (d > worst) worst = d;
+            }
+            printf("raster %d of %d channels differ from the reference, by at most %d\n", differ, RASTER_WIDTH * RASTER_HEIGHT * 4, worst);
+        }
+        raster_free(&fast);
+    }
+    printf("raster reference      %8.2f ms (%d quads)\n", raster_frame_time(&reference, &store, &texture) * 1e3, store.size);
+
+    raster_free(&reference);
+    free_vert_store(&store);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "gpu.c";
+    size_t file_size = 0, line_count = 0;
+    char **lines = read_file_lines(path, &file_size, &line_count);
+    if (!lines) {
+        printf("could not read %s\n", path);
+        return 1;
+    }
+
+    size_t font_size = 0;
+    u8 *font_buffer = read_file("../res/fonts/vera/Vera.ttf", &font_size);
+    stbtt_packedchar char_data[96];
+    FontMetrics metrics;
+    u8 *atlas = text_atlas_build(&metrics, char_data, font_buffer, FONT_SIZE, ATLAS_WIDTH, ATLAS_HEIGHT, ATLAS_HEIGHT);
+    printf("%s: %zd lines, %d kerning pairs\n", path, line_count, metrics.kern_count);
+
+    bench_layout(&metrics, char_data, lines, line_count);
+    bench_syntax(&metrics, lines, line_count);
+    bench_doc(path);
+    bench_search(path);
+    bench_minimap(path);
+    bench_wrap(&metrics, lines, line_count);
+    bool ok = bench_raster(&metrics, atlas, lines, line_count);
+
+    font_metrics_free(&metrics);
+    free(atlas);
+    free(font_buffer);
+    free(lines);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,397 @@
+// Editable text document: a piece table whose pieces live in a treap.
+//
+// The file is loaded once into an "original" buffer and never modified.
+// Inserted text is appended to an "added" buffer. The document is the
+// in-order sequence of pieces (ranges of either buffer). Every tree node
+// keeps the byte length and line break count of its subtree, and each
+// buffer keeps the offsets of all its line breaks, so offset <-> line
+// lookups, inserts and deletes are all O(log n).
+//
+// In exactly one C or C++ file in your project:
+// #define DOC_IMPLEMENTATION
+// #include "doc.h"
+
+#ifndef DOC_H
+#define DOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+enum {
+    DOC_ORIGINAL,
+    DOC_ADDED,
+};
+
+typedef struct DocBuffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+    size_t *breaks; // offset of every '\n', ascending
+    size_t break_count;
+    size_t break_capacity;
+} DocBuffer;
+
+typedef struct DocNode {
+    u32 left, right; // 0 = none
+    u32 priority;
+    u32 buffer;
+    size_t start;
+    size_t len;
+    size_t break_index; // first entry of the buffer's breaks inside this piece
+    size_t breaks;
+    size_t total_len; // whole subtree
+    size_t total_breaks;
+} DocNode;
+
+typedef struct Document {
+    DocBuffer buffers[2];
+    DocNode *nodes; // nodes[0] is an empty sentinel
+    u32 node_count;
+    u32 node_capacity;
+    u32 free_list;
+    u32 root;
+    u32 seed;
+} Document;
+
+// Lines [line, line + removed) of the old document became lines
+// [line, line + inserted) of the new one. Per-line caches only need to
+// throw away that range.
+typedef struct DocEdit {
+    int line;
+    int removed;
+    int inserted;
+} DocEdit;
+
+// Takes ownership of `data`, which must come from malloc.
+void doc_init(Document *doc, char *data, size_t len);
+void doc_free(Document *doc);
+
+size_t doc_length(const Document *doc);
+size_t doc_line_count(const Document *doc);
+size_t doc_line_offset(const Document *doc, size_t line);
+size_t doc_offset_line(const Document *doc, size_t offset);
+size_t doc_line_length(const Document *doc, size_t line); // without the \n or \r\n
+
+// Copies `len` bytes starting at `offset` into `out`.
+void doc_copy(const Document *doc, size_t offset, size_t len, char *out);
+
+// Copies line `line` without its line break into *buf, growing it as
+// needed, and NUL-terminates it. Returns the line length.
+size_t doc_get_line(const Document *doc, size_t line, char **buf, size_t *capacity);
+
+DocEdit doc_insert(Document *doc, size_t offset, const char *text, size_t len);
+DocEdit doc_delete(Document *doc, size_t offset, size_t len);
+
+#ifdef DOC_IMPLEMENTATION
+
+#define DOC_NODE(i) (doc->nodes[i])
+
+static void doc_buffer_append(DocBuffer *b, const char *text, size_t len) {
+    if (b->len + len > b->capacity) {
+        b->capacity = b->capacity ? b->capacity : 4096;
+        while (b->len + len > b->capacity) b->capacity *= 2;
+        b->data = realloc(b->data, b->capacity);
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] != '\n') continue;
+        if (b->break_count == b->break_capacity) {
+            b->break_capacity = b->break_capacity ? b->break_capacity * 2 : 256;
+            b->breaks = realloc(b->breaks, b->break_capacity * sizeof(size_t));
+        }
+        b->breaks[b->break_count++] = b->len + i;
+    }
+    memcpy(b->data + b->len, text, len);
+    b->len += len;
+}
+
+// Index of the first line break at or after `offset`
+static size_t doc_buffer_break_at(const DocBuffer *b, size_t offset) {
+    size_t lo = 0, hi = b->break_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (b->breaks[mid] < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void doc_update(Document *doc, u32 t) {
+    DocNode *n = &DOC_NODE(t);
+    n->total_len = DOC_NODE(n->left).total_len + n->len + DOC_NODE(n->right).total_len;
+    n->total_breaks = DOC_NODE(n->left).total_breaks + n->breaks + DOC_NODE(n->right).total_breaks;
+}
+
+static void doc_reserve_nodes(Document *doc, u32 count) {
+    if (doc->node_count + count <= doc->node_capacity) return;
+    while (doc->node_count + count > doc->node_capacity) doc->node_capacity *= 2;
+    doc->nodes = realloc(doc->nodes, doc->node_capacity * sizeof(DocNode));
+}
+
+// Nodes must have been reserved with doc_reserve_nodes first
+static u32 doc_new_node(Document *doc, u32 buffer, size_t start, size_t len) {
+    u32 t;
+    if (doc->free_list) {
+        t = doc->free_list;
+        doc->free_list = DOC_NODE(t).left;
+    } else {
+        t = doc->node_count++;
+    }
+    doc->seed ^= doc->seed << 13;
+    doc->seed ^= doc->seed >> 17;
+    doc->seed ^= doc->seed << 5;
+
+    const DocBuffer *b = &doc->buffers[buffer];
+    size_t first = doc_buffer_break_at(b, start);
+    DOC_NODE(t) = (DocNode){
+        .priority = doc->seed,
+        .buffer = buffer,
+        .start = start,
+        .len = len,
+        .break_index = first,
+        .breaks = doc_buffer_break_at(b, start + len) - first,
+    };
+    doc_update(doc, t);
+    return t;
+}
+
+static void doc_free_tree(Document *doc, u32 t) {
+    if (!t) return;
+    doc_free_tree(doc, DOC_NODE(t).left);
+    doc_free_tree(doc, DOC_NODE(t).right);
+    DOC_NODE(t).left = doc->free_list;
+    doc->free_list = t;
+}
+
+static u32 doc_merge(Document *doc, u32 a, u32 b) {
+    if (!a) return b;
+    if (!b) return a;
+    if (DOC_NODE(a).priority > DOC_NODE(b).priority) {
+        DOC_NODE(a).right = doc_merge(doc, DOC_NODE(a).right, b);
+        doc_update(doc, a);
+        return a;
+    }
+    DOC_NODE(b).left = doc_merge(doc, a, DOC_NODE(b).left);
+    doc_update(doc, b);
+    return b;
+}
+
+// Splits `t` into the first `offset` bytes and the rest, cutting a piece
+// in two if the offset falls inside it. Needs one reserved node.
+static void doc_split(Document *doc, u32 t, size_t offset, u32 *l, u32 *r) {
+    if (!t) {
+        *l = *r = 0;
+        return;
+    }
+    size_t left_len = DOC_NODE(DOC_NODE(t).left).total_len;
+    size_t len = DOC_NODE(t).len;
+    if (offset <= left_len) {
+        u32 rl;
+        doc_split(doc, DOC_NODE(t).left, offset, l, &rl);
+        DOC_NODE(t).left = rl;
+        doc_update(doc, t);
+        *r = t;
+    } else if (offset >= left_len + len) {
+        u32 lr;
+        doc_split(doc, DOC_NODE(t).right, offset - left_len - len, &lr, r);
+        DOC_NODE(t).right = lr;
+        doc_update(doc, t);
+        *l = t;
+    } else {
+        size_t k = offset - left_len;
+        u32 tail = doc_new_node(doc, DOC_NODE(t).buffer, DOC_NODE(t).start + k, len - k);
+        u32 right = DOC_NODE(t).right;
+        DOC_NODE(t).len = k;
+        DOC_NODE(t).breaks = DOC_NODE(tail).break_index - DOC_NODE(t).break_index;
+        DOC_NODE(t).right = 0;
+        doc_update(doc, t);
+        *l = t;
+        *r = doc_merge(doc, tail, right);
+    }
+}
+
+void doc_init(Document *doc, char *data, size_t len) {
+    memset(doc, 0, sizeof(*doc));
+    DocBuffer *original = &doc->buffers[DOC_ORIGINAL];
+    original->data = data;
+    original->len = len;
+    original->capacity = len;
+    for (char *p = data, *end = data + len; (p = memchr(p, '\n', end - p)); p++) {
+        if (original->break_count == original->break_capacity) {
+            original->break_capacity = original->break_capacity ? original->break_capacity * 2 : 256;
+            original->breaks = realloc(original->breaks, original->break_capacity * sizeof(size_t));
+        }
+        original->breaks[original->break_count++] = p - data;
+    }
+
+    doc->node_capacity = 1024;
+    doc->nodes = calloc(doc->node_capacity, sizeof(DocNode));
+    doc->node_count = 1;
+    doc->seed = 0x9E3779B9u;
+    doc->root = len ? doc_new_node(doc, DOC_ORIGINAL, 0, len) : 0;
+}
+
+void doc_free(Document *doc) {
+    for (int i = 0; i < 2; i++) {
+        free(doc->buffers[i].data);
+        free(doc->buffers[i].breaks);
+    }
+    free(doc->nodes);
+    memset(doc, 0, sizeof(*doc));
+}
+
+size_t doc_length(const Document *doc) {
+    return DOC_NODE(doc->root).total_len;
+}
+
+size_t doc_line_count(const Document *doc) {
+    return DOC_NODE(doc->root).total_breaks + 1;
+}
+
+size_t doc_line_offset(const Document *doc, size_t line) {
+    if (line == 0) return 0;
+    if (line >= doc_line_count(doc)) return doc_length(doc);
+
+    // Find break number line - 1
+    size_t k = line - 1, offset = 0;
+    u32 t = doc->root;
+    for (;;) {
+        const DocNode *n = &DOC_NODE(t);
+        const DocNode *left = &DOC_NODE(n->left);
+        if (k < left->total_breaks) {
+            t = n->left;
+        } else if (k < left->total_breaks + n->breaks) {
+            k -= left->total_breaks;
+            const DocBuffer *b = &doc->buffers[n->buffer];
+            return offset + left->total_len + (b->breaks[n->break_index + k] - n->start) + 1;
+        } else {
+            k -= left->total_breaks + n->breaks;
+            offset += left->total_len + n->len;
+            t = n->right;
+        }
+    }
+}
+
+size_t doc_offset_line(const Document *doc, size_t offset) {
+    size_t line = 0;
+    u32 t = doc->root;
+    while (t) {
+        const DocNode *n = &DOC_NODE(t);
+        const DocNode *left = &DOC_NODE(n->left);
+        if (offset < left->total_len) {
+            t = n->left;
+        } else if (offset < left->total_len + n->len) {
+            const DocBuffer *b = &doc->buffers[n->buffer];
+            size_t local = offset - left->total_len;
+            return line + left->total_breaks + doc_buffer_break_at(b, n->start + local) - n->break_index;
+        } else {
+            offset -= left->total_len + n->len;
+            line += left->total_breaks + n->breaks;
+            t = n->right;
+        }
+    }
+    return line;
+}
+
+static void doc_copy_tree(const Document *doc, u32 t, size_t offset, size_t len, char *out) {
+    while (t && len > 0) {
+        const DocNode *n = &DOC_NODE(t);
+        size_t left_len = DOC_NODE(n->left).total_len;
+        if (offset < left_len) {
+            size_t count = left_len - offset < len ? left_len - offset : len;
+            doc_copy_tree(doc, n->left, offset, count, out);
+            out += count;
+            len -= count;
+            offset = left_len;
+        }
+        if (len > 0 && offset < left_len + n->len) {
+            size_t local = offset - left_len;
+            size_t count = n->len - local < len ? n->len - local : len;
+            memcpy(out, doc->buffers[n->buffer].data + n->start + local, count);
+            out += count;
+            len -= count;
+            offset += count;
+        }
+        offset -= left_len + n->len;
+        t = n->right;
+    }
+}
+
+void doc_copy(const Document *doc, size_t offset, size_t len, char *out) {
+    doc_copy_tree(doc, doc->root, offset, len, out);
+}
+
+size_t doc_line_length(const Document *doc, size_t line) {
+    size_t start = doc_line_offset(doc, line);
+    size_t end = line + 1 < doc_line_count(doc) ? doc_line_offset(doc, line + 1) - 1 : doc_length(doc);
+    if (end > start) {
+        char last;
+        doc_copy(doc, end - 1, 1, &last);
+        if (last == '\r') end--;
+    }
+    return end - start;
+}
+
+size_t doc_get_line(const Document *doc, size_t line, char **buf, size_t *capacity) {
+    size_t start = doc_line_offset(doc, line);
+    size_t len = doc_line_length(doc, line);
+    if (len + 1 > *capacity) {
+        *capacity = *capacity ? *capacity : 256;
+        while (len + 1 > *capacity) *capacity *= 2;
+        *buf = realloc(*buf, *capacity);
+    }
+    doc_copy(doc, start, len, *buf);
+    (*buf)[len] = 0;
+    return len;
+}
+
+DocEdit doc_insert(Document *doc, size_t offset, const char *text, size_t len) {
+    DocBuffer *added = &doc->buffers[DOC_ADDED];
+    size_t start = added->len;
+    size_t first_break = added->break_count;
+    doc_buffer_append(added, text, len);
+
+    DocEdit edit = {
+        .line = (int)doc_offset_line(doc, offset),
+        .removed = 1,
+        .inserted = 1 + (int)(added->break_count - first_break),
+    };
+
+    doc_reserve_nodes(doc, 2);
+    u32 l, r;
+    doc_split(doc, doc->root, offset, &l, &r);
+    u32 t = doc_new_node(doc, DOC_ADDED, start, len);
+    doc->root = doc_merge(doc, doc_merge(doc, l, t), r);
+    return edit;
+}
+
+DocEdit doc_delete(Document *doc, size_t offset, size_t len) {
+    DocEdit edit = {
+        .line = (int)doc_offset_line(doc, offset),
+        .inserted = 1,
+    };
+
+    doc_reserve_nodes(doc, 2);
+    u32 l, m, r;
+    doc_split(doc, doc->root, offset, &l, &r);
+    doc_split(doc, r, len, &m, &r);
+    edit.removed = 1 + (int)DOC_NODE(m).total_breaks;
+    doc_free_tree(doc, m);
+    doc->root = doc_merge(doc, l, r);
+    return edit;
+}
+
+#undef DOC_NODE
+
+#endif // DOC_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DOC_H
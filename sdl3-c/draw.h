@@ -0,0 +1,168 @@
+// Instance data for the 2D pipeline (shaders/2d.*.hlsl).
+//
+// Also vendored into sdlgl-cpp/ and sokol/lib/, whose renderers draw the
+// same instances; keep the copies identical.
+//
+// In exactly one C or C++ file in your project:
+// #define DRAW_IMPLEMENTATION
+// #include "draw.h"
+
+#ifndef DRAW_H
+#define DRAW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+typedef union Vec4 {
+    struct {
+        float x, y, z, w;
+    };
+    struct {
+        float r, g, b, a;
+    };
+} Vec4;
+
+typedef struct Rect {
+    float x, y, w, h;
+} Rect;
+
+typedef struct Vec2 {
+    float x, y;
+} Vec2;
+
+typedef struct VertInput {
+    Rect dst_rect;
+    Rect src_rect;
+    Vec4 border_color;
+    Vec4 corner_radii;
+    Vec4 colors[4];
+    float edge_softness;
+    float border_thickness;
+    float use_texture;
+    float _padding[1]; // std140 alignment
+} VertInput;
+
+typedef struct VertStore {
+    VertInput *data;
+    int size;
+    int capacity;
+} VertStore;
+
+VertStore make_vert_store();
+void push_vert(VertStore *store, VertInput input);
+VertInput *reserve_verts(VertStore *store, int count);
+void vert_clear(VertStore *store);
+void free_vert_store(VertStore *store);
+
+// Commands shared by every backend (gpu.c, draw_gl.h, draw_sdl.h, raster.h).
+// Text goes through text_layout_batch in text.h.
+
+// Solid rectangle, optionally with a color per corner (TL, BL, BR, TR).
+void draw_rect(VertStore *store, Rect rect, Vec4 color);
+void draw_gradient(VertStore *store, Rect rect, const Vec4 colors[4]);
+
+// Rounded rectangle. With no border the edge is the fill color.
+void draw_box(VertStore *store, Rect rect, Vec4 color, float radius, float border_thickness, Vec4 border_color);
+
+// Part of the bound texture, `src` in normalized coordinates, tinted by `color`.
+void draw_image(VertStore *store, Rect dst, Rect src, Vec4 color);
+
+#ifdef DRAW_IMPLEMENTATION
+
+VertStore make_vert_store() {
+    VertInput *data = (VertInput *)malloc(1024 * sizeof(VertInput));
+    return (VertStore){
+        .data = data,
+        .size = 0,
+        .capacity = 1024,
+    };
+}
+
+void push_vert(VertStore *store, VertInput input) {
+    if (store->size == store->capacity) {
+        printf("push capacity %d -> %d\n", store->capacity, store->capacity * 2);
+        store->capacity *= 2;
+        store->data = (VertInput *)realloc(store->data, store->capacity * sizeof(VertInput));
+    }
+
+    store->data[store->size] = input;
+    store->size++;
+}
+
+// Makes room for `count` more instances and returns a pointer to them.
+// The caller fills them in and bumps store->size itself.
+VertInput *reserve_verts(VertStore *store, int count) {
+    if (store->size + count > store->capacity) {
+        int capacity = store->capacity;
+        while (store->size + count > capacity) capacity *= 2;
+        printf("reserve capacity %d -> %d\n", store->capacity, capacity);
+        store->capacity = capacity;
+        store->data = (VertInput *)realloc(store->data, store->capacity * sizeof(VertInput));
+    }
+    return store->data + store->size;
+}
+
+void vert_clear(VertStore *store) {
+    store->size = 0;
+}
+
+void free_vert_store(VertStore *store) {
+    free(store->data);
+    store->data = NULL;
+    store->size = 0;
+    store->capacity = 0;
+}
+
+void draw_rect(VertStore *store, Rect rect, Vec4 color) {
+    push_vert(store, (VertInput){
+        .dst_rect = rect,
+        .colors = {color, color, color, color},
+    });
+}
+
+void draw_gradient(VertStore *store, Rect rect, const Vec4 colors[4]) {
+    push_vert(store, (VertInput){
+        .dst_rect = rect,
+        .colors = {colors[0], colors[1], colors[2], colors[3]},
+    });
+}
+
+void draw_box(VertStore *store, Rect rect, Vec4 color, float radius, float border_thickness, Vec4 border_color) {
+    // The shader only evaluates the SDF when there is a border, so a
+    // borderless box gets a one pixel border in its own color
+    if (border_thickness <= 0.0f) {
+        border_thickness = 1.0f;
+        border_color = color;
+    }
+    push_vert(store, (VertInput){
+        .dst_rect = rect,
+        .border_color = border_color,
+        .corner_radii = {{radius, radius, radius, radius}},
+        .colors = {color, color, color, color},
+        .edge_softness = 1.0f,
+        .border_thickness = border_thickness,
+    });
+}
+
+void draw_image(VertStore *store, Rect dst, Rect src, Vec4 color) {
+    push_vert(store, (VertInput){
+        .dst_rect = dst,
+        .src_rect = src,
+        .colors = {color, color, color, color},
+        .use_texture = 1.0f,
+    });
+}
+
+#endif // DRAW_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRAW_H
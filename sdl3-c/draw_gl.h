@@ -0,0 +1,251 @@
+// OpenGL 3.3 backend for the 2D pipeline: draws a VertStore with one
+// instanced call, using a GLSL port of shaders/2d.vert.hlsl and 2d.frag.hlsl.
+//
+// GL 3.3 headers with function prototypes (or a loader) must be included
+// before this file.
+//
+// In exactly one C or C++ file in your project:
+// #define DRAW_GL_IMPLEMENTATION
+// #include "draw_gl.h"
+
+#ifndef DRAW_GL_H
+#define DRAW_GL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "types.h"
+#include "draw.h"
+
+typedef struct DrawGL {
+    GLuint program;
+    GLuint vao;
+    GLuint buffer; // one VertInput per instance
+    int capacity;  // instances the buffer holds
+    GLint screen_size;
+} DrawGL;
+
+bool draw_gl_init(DrawGL *gl);
+void draw_gl_free(DrawGL *gl);
+
+// RGBA8 texture with nearest filtering, as the SDL_GPU sampler uses.
+GLuint draw_gl_create_texture(const u8 *pixels, int w, int h);
+void draw_gl_update_texture(GLuint texture, const u8 *pixels, int w, int h);
+
+// Draws `count` instances over the current framebuffer.
+void draw_gl_render(DrawGL *gl, const VertInput *verts, int count, GLuint texture, int width, int height);
+
+// For renderers that manage their own buffers: the shader sources (uniforms
+// screen_size and tex), and the instance attributes for VertInputs starting
+// `offset` bytes into the bound GL_ARRAY_BUFFER, set on the bound VAO.
+extern const char *const draw_gl_vertex_source;
+extern const char *const draw_gl_fragment_source;
+void draw_gl_set_attributes(size_t offset);
+
+#ifdef DRAW_GL_IMPLEMENTATION
+
+const char *const draw_gl_vertex_source =
+    "#version 330 core\n"
+    "layout (location = 0) in vec4 in_dst_rect;\n"
+    "layout (location = 1) in vec4 in_src_rect;\n"
+    "layout (location = 2) in vec4 in_border_color;\n"
+    "layout (location = 3) in vec4 in_corner_radii;\n"
+    "layout (location = 4) in vec4 in_color0;\n"
+    "layout (location = 5) in vec4 in_color1;\n"
+    "layout (location = 6) in vec4 in_color2;\n"
+    "layout (location = 7) in vec4 in_color3;\n"
+    "layout (location = 8) in vec3 in_params;\n"
+    "uniform vec2 screen_size;\n"
+    "out vec4 color;\n"
+    "out vec2 tex_coord;\n"
+    "flat out vec4 rect;\n"
+    "flat out vec4 border_color;\n"
+    "flat out vec4 corner_radii;\n"
+    "flat out float border_thickness;\n"
+    "flat out float use_texture;\n"
+    "const int tri_idx[6] = int[6](0, 1, 2, 2, 3, 0);\n"
+    "void main() {\n"
+    "    int p = tri_idx[gl_VertexID];\n"
+    "    vec2 corner = vec2(p >= 2 ? 1.0 : 0.0, p == 1 || p == 2 ? 1.0 : 0.0);\n"
+    "    vec4 colors[4] = vec4[4](in_color0, in_color1, in_color2, in_color3);\n"
+    "    vec2 pos = in_dst_rect.xy + in_dst_rect.zw * corner;\n"
+    "    gl_Position = vec4((pos / (screen_size / 2.0) - 1.0) * vec2(1.0, -1.0), 0.0, 1.0);\n"
+    "    tex_coord = in_src_rect.xy + in_src_rect.zw * corner;\n"
+    "    color = colors[p];\n"
+    "    rect = in_dst_rect;\n"
+    "    border_color = in_border_color;\n"
+    "    corner_radii = in_corner_radii;\n"
+    "    border_thickness = in_params.y;\n"
+    "    use_texture = in_params.z;\n"
+    "}\n";
+
+const char *const draw_gl_fragment_source =
+    "#version 330 core\n"
+    "in vec4 color;\n"
+    "in vec2 tex_coord;\n"
+    "flat in vec4 rect;\n"
+    "flat in vec4 border_color;\n"
+    "flat in vec4 corner_radii;\n"
+    "flat in float border_thickness;\n"
+    "flat in float use_texture;\n"
+    "uniform vec2 screen_size;\n"
+    "uniform sampler2D tex;\n"
+    "out vec4 out_color;\n"
+    "float sdf_rounded_box(vec2 p, vec2 b, vec4 r) {\n"
+    "    r.xy = (p.x > 0.0) ? r.xy : r.zw;\n"
+    "    r.x = (p.y > 0.0) ? r.x : r.y;\n"
+    "    vec2 q = abs(p) - b + r.x;\n"
+    "    return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r.x;\n"
+    "}\n"
+    "void main() {\n"
+    "    if (use_texture > 0.0) {\n"
+    "        out_color = color * texture(tex, tex_coord);\n"
+    "        return;\n"
+    "    }\n"
+    // gl_FragCoord counts up from the bottom; the HLSL position counts down
+    "    vec2 position = vec2(gl_FragCoord.x, screen_size.y - gl_FragCoord.y);\n"
+    "    vec2 half_size = rect.zw / screen_size.y;\n"
+    "    vec2 p = (2.0 * position - screen_size) / screen_size.y - (2.0 * (rect.xy + rect.zw / 2.0) - screen_size) / screen_size.y;\n"
+    "    float d = sdf_rounded_box(p, half_size, corner_radii / (screen_size.y / 2.0));\n"
+    "    float d2 = 0.0;\n"
+    "    vec2 half_size2 = (rect.zw - (border_thickness * 2.0 + 2.0)) / screen_size.y;\n"
+    "    if (border_thickness > 0.0) {\n"
+    "        d2 = sdf_rounded_box(p, half_size2, (corner_radii - (border_thickness + 2.0)) / (screen_size.y / 2.0));\n"
+    "    }\n"
+    "    out_color = mix(\n"
+    "        vec4(border_color.rgb, (1.0 - smoothstep(0.0, 0.003, d)) * border_color.a),\n"
+    "        color,\n"
+    "        1.0 - smoothstep(0.0, 0.005, d2));\n"
+    "}\n";
+
+static GLuint draw_gl_compile(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("draw_gl: shader compile failed: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+void draw_gl_set_attributes(size_t offset) {
+    // The instance buffer is the VertStore as is
+    const struct {
+        int size;
+        size_t offset;
+    } attributes[] = {
+        {4, offsetof(VertInput, dst_rect)},
+        {4, offsetof(VertInput, src_rect)},
+        {4, offsetof(VertInput, border_color)},
+        {4, offsetof(VertInput, corner_radii)},
+        {4, offsetof(VertInput, colors[0])},
+        {4, offsetof(VertInput, colors[1])},
+        {4, offsetof(VertInput, colors[2])},
+        {4, offsetof(VertInput, colors[3])},
+        {3, offsetof(VertInput, edge_softness)},
+    };
+    for (GLuint i = 0; i < sizeof(attributes) / sizeof(attributes[0]); i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, attributes[i].size, GL_FLOAT, GL_FALSE, sizeof(VertInput), (const void *)(offset + attributes[i].offset));
+        glVertexAttribDivisor(i, 1);
+    }
+}
+
+bool draw_gl_init(DrawGL *gl) {
+    memset(gl, 0, sizeof(*gl));
+    GLuint vs = draw_gl_compile(GL_VERTEX_SHADER, draw_gl_vertex_source);
+    GLuint fs = draw_gl_compile(GL_FRAGMENT_SHADER, draw_gl_fragment_source);
+    if (!vs || !fs) return false;
+
+    gl->program = glCreateProgram();
+    glAttachShader(gl->program, vs);
+    glAttachShader(gl->program, fs);
+    glLinkProgram(gl->program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    GLint ok = 0;
+    glGetProgramiv(gl->program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetProgramInfoLog(gl->program, sizeof(log), NULL, log);
+        printf("draw_gl: program link failed: %s\n", log);
+        return false;
+    }
+    gl->screen_size = glGetUniformLocation(gl->program, "screen_size");
+    glUseProgram(gl->program);
+    glUniform1i(glGetUniformLocation(gl->program, "tex"), 0);
+
+    gl->capacity = 1024;
+    glGenVertexArrays(1, &gl->vao);
+    glGenBuffers(1, &gl->buffer);
+    glBindVertexArray(gl->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, gl->buffer);
+    glBufferData(GL_ARRAY_BUFFER, gl->capacity * sizeof(VertInput), NULL, GL_STREAM_DRAW);
+
+    draw_gl_set_attributes(0);
+    glBindVertexArray(0);
+    return true;
+}
+
+void draw_gl_free(DrawGL *gl) {
+    glDeleteBuffers(1, &gl->buffer);
+    glDeleteVertexArrays(1, &gl->vao);
+    glDeleteProgram(gl->program);
+    memset(gl, 0, sizeof(*gl));
+}
+
+GLuint draw_gl_create_texture(const u8 *pixels, int w, int h) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    return texture;
+}
+
+void draw_gl_update_texture(GLuint texture, const u8 *pixels, int w, int h) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+void draw_gl_render(DrawGL *gl, const VertInput *verts, int count, GLuint texture, int width, int height) {
+    if (count == 0) return;
+    glBindBuffer(GL_ARRAY_BUFFER, gl->buffer);
+    while (count > gl->capacity) gl->capacity *= 2;
+    // Orphan the old storage so the driver doesn't wait on last frame's draw
+    glBufferData(GL_ARRAY_BUFFER, gl->capacity * sizeof(VertInput), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(VertInput), verts);
+
+    glViewport(0, 0, width, height);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgram(gl->program);
+    glUniform2f(gl->screen_size, (float)width, (float)height);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindVertexArray(gl->vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+    glBindVertexArray(0);
+}
+
+#endif // DRAW_GL_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRAW_GL_H
@@ -0,0 +1,90 @@
+// SDL_Renderer backend for the 2D pipeline: draws a VertStore with
+// SDL_RenderGeometry, one call per run of textured or untextured instances.
+//
+// SDL_Renderer has no shaders, so rounded corners and borders are dropped
+// and boxes come out as plain rectangles. Corner colors and texture tinting
+// work as on the GPU.
+//
+// SDL3/SDL.h must be included before this file.
+//
+// In exactly one C or C++ file in your project:
+// #define DRAW_SDL_IMPLEMENTATION
+// #include "draw_sdl.h"
+
+#ifndef DRAW_SDL_H
+#define DRAW_SDL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "types.h"
+#include "draw.h"
+
+typedef struct DrawSDL {
+    SDL_Vertex *vertices; // 4 per instance
+    int *indices;         // 6 per instance
+    int capacity;         // instances
+} DrawSDL;
+
+void draw_sdl_free(DrawSDL *sdl);
+
+// Draws `count` instances; textured ones sample `texture`.
+void draw_sdl_render(DrawSDL *sdl, SDL_Renderer *renderer, const VertInput *verts, int count, SDL_Texture *texture);
+
+#ifdef DRAW_SDL_IMPLEMENTATION
+
+void draw_sdl_free(DrawSDL *sdl) {
+    free(sdl->vertices);
+    free(sdl->indices);
+    *sdl = (DrawSDL){0};
+}
+
+void draw_sdl_render(DrawSDL *sdl, SDL_Renderer *renderer, const VertInput *verts, int count, SDL_Texture *texture) {
+    if (count > sdl->capacity) {
+        int old = sdl->capacity;
+        sdl->capacity = count * 2;
+        sdl->vertices = realloc(sdl->vertices, sdl->capacity * 4 * sizeof(SDL_Vertex));
+        sdl->indices = realloc(sdl->indices, sdl->capacity * 6 * sizeof(int));
+        // The index pattern only depends on the slot, so it is written once
+        for (int i = old; i < sdl->capacity; i++) {
+            static const int tri_idx[6] = {0, 1, 2, 2, 3, 0};
+            for (int k = 0; k < 6; k++) sdl->indices[i * 6 + k] = i * 4 + tri_idx[k];
+        }
+    }
+
+    int run_start = 0;
+    for (int i = 0; i <= count; i++) {
+        bool textured = i < count && verts[i].use_texture > 0.0f;
+        if (i > run_start && (i == count || textured != (verts[run_start].use_texture > 0.0f))) {
+            // Indices are absolute, so each run starts at vertex 0
+            SDL_RenderGeometry(renderer, verts[run_start].use_texture > 0.0f ? texture : NULL,
+                               sdl->vertices + run_start * 4, (i - run_start) * 4,
+                               sdl->indices, (i - run_start) * 6);
+            run_start = i;
+        }
+        if (i == count) break;
+
+        const VertInput *v = &verts[i];
+        const Rect *d = &v->dst_rect, *s = &v->src_rect;
+        float corner_x[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+        float corner_y[4] = {0.0f, 1.0f, 1.0f, 0.0f};
+        for (int k = 0; k < 4; k++) {
+            sdl->vertices[i * 4 + k] = (SDL_Vertex){
+                .position = {d->x + d->w * corner_x[k], d->y + d->h * corner_y[k]},
+                .color = {v->colors[k].r, v->colors[k].g, v->colors[k].b, v->colors[k].a},
+                .tex_coord = {s->x + s->w * corner_x[k], s->y + s->h * corner_y[k]},
+            };
+        }
+    }
+}
+
+#endif // DRAW_SDL_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRAW_SDL_H
@@ -1,7 +1,30 @@
 #include <SDL3/SDL.h>
+#define GL_GLEXT_PROTOTYPES
 #include <SDL3/SDL_opengl.h>
 #include <stdbool.h>
 
+#define STB_TRUETYPE_IMPLEMENTATION
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "stb_rect_pack.h"
+#include "stb_truetype.h"
+
+#define PJP_IMPLEMENTATION
+#include "pjp.h"
+
+#include "types.h"
+
+#define DRAW_IMPLEMENTATION
+#include "draw.h"
+
+#define TEXT_IMPLEMENTATION
+#include "text.h"
+
+#define DRAW_GL_IMPLEMENTATION
+#include "draw_gl.h"
+
+#define RASTER_IMPLEMENTATION
+#include "raster.h"
+
 #define ASSERT_CALL(call) \
     do { \
         if (!(call)) { \
@@ -13,14 +36,82 @@
 
 #define ASSERT_CREATED(obj) do { if ((obj) == NULL) { SDL_Log("Error: %s is null", #obj); SDL_Quit(); return 1; }} while (0)
 
-int main(void) {
+#define FONT_SIZE 24.0f
+#define ATLAS_WIDTH 512
+#define ATLAS_HEIGHT 512
+#define LINE_HEIGHT 20
+#define RASTER_THREADS 4
+
+// The same frame for every backend: a panel, a gradient bar and some text
+static void build_frame(VertStore *store, FontMetrics *metrics, char **lines, size_t line_count, float scroll, int width, int height) {
+    vert_clear(store);
+    draw_box(store, (Rect){10.0f, 10.0f, width - 20.0f, height - 60.0f}, (Vec4){{0.15f, 0.15f, 0.18f, 1.0f}},
+             12.0f, 2.0f, (Vec4){{0.5f, 0.5f, 0.6f, 1.0f}});
+    Vec4 bar[4] = {
+        {{0.2f, 0.2f, 0.8f, 1.0f}},
+        {{0.8f, 0.2f, 0.2f, 1.0f}},
+        {{0.2f, 0.8f, 0.2f, 1.0f}},
+        {{0.8f, 0.8f, 0.2f, 1.0f}},
+    };
+    draw_gradient(store, (Rect){0.0f, height - 40.0f, (float)width, 40.0f}, bar);
+    int first = (int)(-scroll / LINE_HEIGHT);
+    if (first < 0) first = 0;
+    for (int i = first; i < (int)line_count; i++) {
+        float y = 20.0f + i * LINE_HEIGHT + scroll;
+        if (y > height - 60.0f) break;
+        text_layout_batch(store, metrics, lines[i], (int)strlen(lines[i]), 20.0f, y + FONT_SIZE, true, NULL, NULL);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "gl.c";
+    size_t file_size = 0, line_count = 0;
+    char **lines = read_file_lines(path, &file_size, &line_count);
+    if (!lines) {
+        printf("could not read %s\n", path);
+        return 1;
+    }
+
+    int width = 800;
+    int height = 600;
+
     ASSERT_CALL(SDL_Init(SDL_INIT_VIDEO));
-    SDL_Window *window = SDL_CreateWindow("Test", 800, 600, SDL_WINDOW_OPENGL);
+    ASSERT_CALL(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3));
+    ASSERT_CALL(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3));
+    ASSERT_CALL(SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE));
+    SDL_Window *window = SDL_CreateWindow("Test", width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
     ASSERT_CREATED(window);
 
     SDL_GLContext glcontext = SDL_GL_CreateContext(window);
     ASSERT_CREATED(glcontext);
 
+    DrawGL gl;
+    ASSERT_CALL(draw_gl_init(&gl));
+
+    size_t font_size = 0;
+    u8 *font_buffer = read_file("../res/fonts/vera/Vera.ttf", &font_size);
+    ASSERT_CREATED(font_buffer);
+    FontMetrics metrics;
+    stbtt_packedchar char_data[TEXT_NUM_CHARS];
+    u8 *atlas = text_atlas_build(&metrics, char_data, font_buffer, FONT_SIZE, ATLAS_WIDTH, ATLAS_HEIGHT, ATLAS_HEIGHT);
+    GLuint atlas_texture = draw_gl_create_texture(atlas, ATLAS_WIDTH, ATLAS_HEIGHT);
+    RasterTexture raster_atlas = {atlas, ATLAS_WIDTH, ATLAS_HEIGHT};
+
+    // S switches to the software renderer, whose frame is shown as one
+    // textured quad through the GL backend
+    bool software = false;
+    Raster raster;
+    raster_init(&raster, width, height, RASTER_THREADS);
+    raster.clear_color = (Vec4){{0.0f, 0.5f, 0.0f, 1.0f}};
+    GLuint raster_texture = draw_gl_create_texture(NULL, width, height);
+    VertStore blit = make_vert_store();
+
+    VertStore store = make_vert_store();
+    float scroll = 0.0f;
+    Uint64 frame_start = SDL_GetPerformanceCounter();
+    f64 frame_ms = 0.0;
+    int frames = 0;
+
     bool quit = false;
     SDL_Event event;
     while (!quit) {
@@ -32,15 +123,67 @@ int main(void) {
                 case SDL_EVENT_KEY_DOWN:
                     if (event.key.key == SDLK_Q) {
                         quit = true;
+                    } else if (event.key.key == SDLK_S) {
+                        software = !software;
                     }
                     break;
+                case SDL_EVENT_MOUSE_WHEEL:
+                    scroll += event.wheel.y * LINE_HEIGHT;
+                    if (scroll > 0.0f) scroll = 0.0f;
+                    break;
+                case SDL_EVENT_WINDOW_RESIZED:
+                    width = event.window.data1;
+                    height = event.window.data2;
+                    raster_resize(&raster, width, height);
+                    glDeleteTextures(1, &raster_texture);
+                    raster_texture = draw_gl_create_texture(NULL, width, height);
+                    break;
             }
         }
 
-        glClearColor(0, 1, 0, 1);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        build_frame(&store, &metrics, lines, line_count, scroll, width, height);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (software) {
+            raster_draw(&raster, store.data, store.size, &raster_atlas);
+            draw_gl_update_texture(raster_texture, raster.pixels, width, height);
+            vert_clear(&blit);
+            draw_image(&blit, (Rect){0.0f, 0.0f, (float)width, (float)height}, (Rect){0.0f, 0.0f, 1.0f, 1.0f}, (Vec4){{1.0f, 1.0f, 1.0f, 1.0f}});
+            glClearColor(0, 0, 0, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+            draw_gl_render(&gl, blit.data, blit.size, raster_texture, width, height);
+        } else {
+            glClearColor(0, 0.5f, 0, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+            draw_gl_render(&gl, store.data, store.size, atlas_texture, width, height);
+        }
+        glFinish();
+        frame_ms += (SDL_GetPerformanceCounter() - start) * 1e3 / SDL_GetPerformanceFrequency();
+        frames++;
         SDL_GL_SwapWindow(window);
+
+        if (SDL_GetPerformanceCounter() - frame_start > SDL_GetPerformanceFrequency()) {
+            char title[128];
+            snprintf(title, sizeof(title), "%s: %.2f ms for %d instances", software ? "software" : "gl", frame_ms / frames, store.size);
+            SDL_SetWindowTitle(window, title);
+            frame_start = SDL_GetPerformanceCounter();
+            frame_ms = 0.0;
+            frames = 0;
+        }
     }
 
+    free_vert_store(&store);
+    free_vert_store(&blit);
+    raster_free(&raster);
+    glDeleteTextures(1, &raster_texture);
+    glDeleteTextures(1, &atlas_texture);
+    draw_gl_free(&gl);
+    font_metrics_free(&metrics);
+    free(atlas);
+    free(font_buffer);
+    free(lines);
+    SDL_GL_DestroyContext(glcontext);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
     return 0;
 }
@@ -17,6 +17,27 @@
 
 #include "types.h"
 
+#define DRAW_IMPLEMENTATION
+#include "draw.h"
+
+#define TEXT_IMPLEMENTATION
+#include "text.h"
+
+#define SYNTAX_IMPLEMENTATION
+#include "syntax.h"
+
+#define DOC_IMPLEMENTATION
+#include "doc.h"
+
+#define SEARCH_IMPLEMENTATION
+#include "search.h"
+
+#define MINIMAP_IMPLEMENTATION
+#include "minimap.h"
+
+#define WRAP_IMPLEMENTATION
+#include "wrap.h"
+
 #define ASSERT_CALL(call) \
     do { \
         if (!(call)) { \
@@ -28,23 +49,6 @@
 
 #define ASSERT_CREATED(obj) do { if ((obj) == NULL) { SDL_Log("Error: %s is null", #obj); SDL_Quit(); exit(1); }} while (0)
 
-typedef union Vec4 {
-    struct {
-        float x, y, z, w;
-    };
-    struct {
-        float r, g, b, a;
-    };
-} Vec4;
-
-typedef struct Rect {
-    float x, y, w, h;
-} Rect;
-
-typedef struct Vec2 {
-    float x, y;
-} Vec2;
-
 typedef struct Texture {
     SDL_GPUTexture *handle;
     int w, h, d;
@@ -53,62 +57,39 @@ typedef struct Texture {
 #define FONT_SIZE 24.0f
 #define ATLAS_WIDTH 512
 #define ATLAS_HEIGHT 512
+// The minimap image lives in the font texture, below the glyphs, so it
+// draws in the same batch
+#define MINIMAP_MAX_ROWS 1024
+#define TEXTURE_HEIGHT (ATLAS_HEIGHT + MINIMAP_MAX_ROWS)
+#define MINIMAP_WIDTH (MINIMAP_COLS * 2)
+// Minimap work per frame while catching up on a big file
+#define MINIMAP_SCAN_LINES 20000
+#define MINIMAP_BLOCKS 2048
+// Off-screen lines wrapped per frame after a resize or edit
+#define WRAP_BUDGET 5000
+#define WRAP_MAX_ROWS 1024
+
+#define LINE_HEIGHT 20
+// Lines lexed per frame while catching up on a big file
+#define SYNTAX_BUDGET 50000
+
+static const Vec4 token_colors[TOKEN_COUNT] = {
+    [TOKEN_TEXT] = {{1.0f, 1.0f, 1.0f, 1.0f}},
+    [TOKEN_KEYWORD] = {{1.0f, 0.8f, 0.3f, 1.0f}},
+    [TOKEN_TYPE] = {{0.5f, 0.8f, 1.0f, 1.0f}},
+    [TOKEN_NUMBER] = {{1.0f, 0.6f, 1.0f, 1.0f}},
+    [TOKEN_STRING] = {{1.0f, 1.0f, 0.6f, 1.0f}},
+    [TOKEN_COMMENT] = {{0.7f, 0.7f, 0.7f, 1.0f}},
+    [TOKEN_PREPROC] = {{1.0f, 0.5f, 0.5f, 1.0f}},
+};
 
 typedef struct {
     Texture texture;
     stbtt_packedchar char_data[96];
+    FontMetrics metrics;
     float scale;
 } Font;
 
-typedef struct VertInput {
-    Rect dst_rect;
-    Rect src_rect;
-    Vec4 border_color;
-    Vec4 corner_radii;
-    Vec4 colors[4];
-    float edge_softness;
-    float border_thickness;
-    float use_texture;
-    float _padding[1]; // std140 alignment
-} VertInput;
-
-typedef struct VertStore {
-    VertInput *data;
-    int size;
-    int capacity;
-} VertStore;
-
-VertStore make_vert_store() {
-    VertInput *data = malloc(1024 * sizeof(VertInput));
-    return (VertStore){
-        .data = data,
-        .size = 0,
-        .capacity = 1024,
-    };
-}
-
-void push_vert(VertStore *store, VertInput input) {
-    if (store->size == store->capacity) {
-        printf("push capacity %d -> %d\n", store->capacity, store->capacity * 2);
-        store->capacity *= 2;
-        store->data = realloc(store->data, store->capacity * sizeof(VertInput));
-    }
-
-    store->data[store->size] = input;
-    store->size++;
-}
-
-void vert_clear(VertStore *store) {
-    store->size = 0;
-}
-
-void free_vert_store(VertStore *store) {
-    free(store->data);
-    store->data = NULL;
-    store->size = 0;
-    store->capacity = 0;
-}
-
 SDL_GPUShader *load_shader(
     SDL_GPUDevice *gpu,
     char *filename,
@@ -231,81 +212,30 @@ Font load_font(SDL_GPUDevice *gpu, const char* font_path) {
     u8 *font_buffer = read_file(font_path, &font_size);
     printf("font file size: %zd\n", font_size);
 
-    u8 *atlas_data = malloc(ATLAS_WIDTH * ATLAS_HEIGHT);
-
-    stbtt_pack_context pack_context = {0};
-
-    stbtt_pack_range pack_range = {0};
-    pack_range.font_size = FONT_SIZE;
-    pack_range.first_unicode_codepoint_in_range = 32;
-    pack_range.num_chars = 96;
-    pack_range.chardata_for_range = font.char_data;
-
-    stbtt_PackBegin(&pack_context, atlas_data, ATLAS_WIDTH, ATLAS_HEIGHT, 0, 1, NULL);
-    stbtt_PackFontRanges(&pack_context, font_buffer, 0, &pack_range, 1);
-
-    stbtt_PackEnd(&pack_context);
-
-	/*u32* pixels = malloc(ATLAS_WIDTH * ATLAS_HEIGHT * sizeof(u32));*/
-	/*const SDL_PixelFormatDetails *format = SDL_GetPixelFormatDetails(SDL_PIXELFORMAT_RGBA32);*/
-	/*for(int i = 0; i < ATLAS_WIDTH * ATLAS_HEIGHT; i++) {*/
-
-		/*pixels[i] = SDL_MapRGBA(format, NULL, 0xff, 0xff, 0xff, atlas_data[i]);*/
-	/*}*/
+    // The minimap image lives in the rows below the glyphs
+    u8 *pixels = text_atlas_build(&font.metrics, font.char_data, font_buffer, FONT_SIZE, ATLAS_WIDTH, ATLAS_HEIGHT, TEXTURE_HEIGHT);
+    font.texture = load_texture_bytes(gpu, pixels, ATLAS_WIDTH, TEXTURE_HEIGHT, 4);
 
-    u8 *pixels = malloc(ATLAS_WIDTH * ATLAS_HEIGHT * 4);
-    for (int i = 0; i < ATLAS_WIDTH * ATLAS_HEIGHT; i++) {
-        pixels[i*4] = 0;
-        pixels[i*4 + 1] = 0;
-        pixels[i*4 + 2] = 0;
-        pixels[i * 4 + 3] = atlas_data[i];
-    }
-    /*font.texture = load_texture_bytes(gpu, atlas_data, ATLAS_WIDTH, ATLAS_HEIGHT, 1);*/
-    font.texture = load_texture_bytes(gpu, pixels, ATLAS_WIDTH, ATLAS_HEIGHT, 4);
-
-	free(pixels);
-
-    /*font.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, ATLAS_WIDTH, ATLAS_HEIGHT);*/
-    /*SDL_SetTextureBlendMode(font.texture, SDL_BLENDMODE_BLEND);*/
-    /*SDL_UpdateTexture(font.texture, NULL, pixels, ATLAS_WIDTH * sizeof(Uint32));*/
-    /**/
-
-    free(atlas_data);
+    free(pixels);
     free(font_buffer);
 
     return font;
 }
 
 void draw_text(VertStore *store, Font *font, const char *text, float x, float y) {
-    u8 r, g, b, a;
-    y += font->scale;
-    while (*text) {
-        if (*text >= 32 && *text < 128) {
-            stbtt_aligned_quad quad;
-            stbtt_GetPackedQuad(font->char_data, ATLAS_WIDTH, ATLAS_HEIGHT, *text - 32, &x, &y, &quad, 1);
-
-            VertInput vert = {
-                .dst_rect = (Rect){quad.x0, quad.y0, quad.x1 - quad.x0, quad.y1 - quad.y0},
-                /* .src_rect = (Rect){quad.s0 * ATLAS_WIDTH, quad.t0 * ATLAS_HEIGHT, (quad.s1 - quad.s0) * ATLAS_WIDTH, (quad.t1 - quad.t0) * ATLAS_HEIGHT}, */
-                /* .src_rect = (Rect){quad.s0, quad.t0, (quad.s1 - quad.s0), (quad.t1 - quad.t0)}, */
-                .src_rect = (Rect){quad.s0, quad.t0, (quad.s1 - quad.s0), (quad.t1 - quad.t0)},
-                .corner_radii = {0.0f, 0.0f, 0.0f, 0.0f},
-                .border_color = {1.0f, 1.0f, 1.0f, 1.0f},
-                .colors = {
-                    (Vec4){1.0f, 1.0f, 1.0f, 1.0f},
-                    (Vec4){1.0f, 1.0f, 1.0f, 1.0f},
-                    (Vec4){1.0f, 1.0f, 1.0f, 1.0f},
-                    (Vec4){1.0f, 1.0f, 1.0f, 1.0f},
-                },
-                .edge_softness = 1.0f,
-                .border_thickness = 1.0f,
-                .use_texture = 1.0f,
-            };
-            push_vert(store, vert);
-        }
-        text++;
-    }
+    text_layout_batch(store, &font->metrics, text, (int)strlen(text), x, y + font->scale, true, NULL, NULL);
+}
 
+// Draws one line of source, colored by token starting from lexer `state`,
+// one visual row per LINE_HEIGHT with row k + 1 starting at breaks[k].
+// `kinds` is scratch space at least as long as the line.
+void draw_code_line(VertStore *store, Font *font, const char *text, int len, u8 state, u8 *kinds, const int *breaks, int rows, float x, float y) {
+    syntax_scan_line(text, state, kinds);
+    for (int row = 0; row < rows; row++) {
+        int start = row ? breaks[row - 1] : 0;
+        int end = row + 1 < rows ? breaks[row] : len;
+        text_layout_batch(store, &font->metrics, text + start, end - start, x, y + row * LINE_HEIGHT + font->scale, true, kinds + start, token_colors);
+    }
 	/*   float start_x = x;*/
 	/**/
 	/*   Uint8 r, g, b, a;*/
@@ -338,12 +268,288 @@ void draw_text(VertStore *store, Font *font, const char *text, float x, float y)
 	/*   }*/
 }
 
-int main(int argc, char *argv[]) {
+// The open document plus everything cached per line of it
+typedef struct Editor {
+    Document doc;
+    SyntaxCache syntax;
+    Minimap minimap;
+    Wrap wrap;
+    char *line; // scratch for the text of one line
+    size_t line_capacity;
+    char *scan; // scratch for runs of lines fed to the minimap
+    size_t scan_capacity;
+    u8 *kinds;
+    size_t kinds_capacity;
+    size_t cursor_line;
+    size_t cursor_col;
+    u32 version; // bumped on every edit
+} Editor;
+
+void editor_open(Editor *editor, const char *filename) {
+    size_t file_size = 0;
+    char *data = (char *)read_file(filename, &file_size);
+    *editor = (Editor){0};
+    doc_init(&editor->doc, data, file_size);
+    syntax_init(&editor->syntax, (int)doc_line_count(&editor->doc));
+    minimap_init(&editor->minimap, (int)doc_line_count(&editor->doc), MINIMAP_MAX_ROWS);
+    wrap_init(&editor->wrap, (int)doc_line_count(&editor->doc), 0.0f);
+    printf("file_size: %zd\nline_count: %zd\n", file_size, doc_line_count(&editor->doc));
+}
+
+void editor_close(Editor *editor) {
+    doc_free(&editor->doc);
+    syntax_free(&editor->syntax);
+    minimap_free(&editor->minimap);
+    wrap_free(&editor->wrap);
+    free(editor->line);
+    free(editor->scan);
+    free(editor->kinds);
+}
+
+const char *editor_get_line(void *user, int line) {
+    Editor *editor = user;
+    doc_get_line(&editor->doc, line, &editor->line, &editor->line_capacity);
+    return editor->line;
+}
+
+// Only the caches of the lines an edit touched are thrown away
+void editor_apply(Editor *editor, DocEdit edit) {
+    editor->version++;
+    syntax_lines_changed(&editor->syntax, edit.line, edit.removed, edit.inserted);
+    minimap_lines_changed(&editor->minimap, edit.line, edit.removed, edit.inserted);
+    wrap_lines_changed(&editor->wrap, edit.line, edit.removed, edit.inserted);
+}
 
+// Visual row of byte `col` of `line` and its x within that row
+int editor_locate(Editor *editor, Font *font, size_t line, size_t col, float *x) {
+    int breaks[WRAP_MAX_ROWS];
+    int len = (int)doc_get_line(&editor->doc, line, &editor->line, &editor->line_capacity);
+    int rows = wrap_line(&editor->wrap, &font->metrics, (int)line, editor->line, len, breaks, WRAP_MAX_ROWS);
+    if (rows > WRAP_MAX_ROWS) rows = WRAP_MAX_ROWS;
+    int row = 0;
+    while (row + 1 < rows && (size_t)breaks[row] <= col) row++;
+    int start = row ? breaks[row - 1] : 0;
+    *x = text_measure(&font->metrics, editor->line + start, (int)col - start, true);
+    return wrap_line_row(&editor->wrap, (int)line) + row;
+}
 
-    size_t file_size = 0, line_count = 0;
-    char **buf = read_file_lines("render.c", &file_size, &line_count);
-    printf("file_size: %zd\nline_count: %zd\n", file_size, line_count);
+void editor_update_minimap(Editor *editor) {
+    int first, count;
+    if (minimap_next_scan(&editor->minimap, MINIMAP_SCAN_LINES, &first, &count)) {
+        size_t start = doc_line_offset(&editor->doc, first);
+        size_t end = first + count < (int)doc_line_count(&editor->doc) ? doc_line_offset(&editor->doc, first + count) : doc_length(&editor->doc);
+        if (end - start > editor->scan_capacity) {
+            editor->scan_capacity = end - start;
+            editor->scan = realloc(editor->scan, editor->scan_capacity);
+        }
+        doc_copy(&editor->doc, start, end - start, editor->scan);
+        minimap_scan(&editor->minimap, first, count, editor->scan, end - start);
+    }
+    minimap_update(&editor->minimap, MINIMAP_BLOCKS);
+}
+
+size_t editor_cursor_offset(Editor *editor) {
+    return doc_line_offset(&editor->doc, editor->cursor_line) + editor->cursor_col;
+}
+
+void editor_insert(Editor *editor, const char *text, size_t len) {
+    editor_apply(editor, doc_insert(&editor->doc, editor_cursor_offset(editor), text, len));
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            editor->cursor_line++;
+            editor->cursor_col = 0;
+        } else {
+            editor->cursor_col++;
+        }
+    }
+}
+
+void editor_backspace(Editor *editor) {
+    size_t count = 1;
+    if (editor->cursor_col > 0) {
+        editor->cursor_col--;
+    } else if (editor->cursor_line > 0) {
+        // Joining lines removes the whole break, \r\n included
+        editor->cursor_line--;
+        editor->cursor_col = doc_line_length(&editor->doc, editor->cursor_line);
+        count = doc_line_offset(&editor->doc, editor->cursor_line + 1) - editor_cursor_offset(editor);
+    } else {
+        return;
+    }
+    editor_apply(editor, doc_delete(&editor->doc, editor_cursor_offset(editor), count));
+}
+
+void editor_move(Editor *editor, int lines, int cols) {
+    size_t line_count = doc_line_count(&editor->doc);
+    if (lines < 0 && editor->cursor_line < (size_t)-lines) editor->cursor_line = 0;
+    else editor->cursor_line += lines;
+    if (editor->cursor_line >= line_count) editor->cursor_line = line_count - 1;
+
+    size_t len = doc_line_length(&editor->doc, editor->cursor_line);
+    if (cols < 0 && editor->cursor_col < (size_t)-cols) editor->cursor_col = 0;
+    else editor->cursor_col += cols;
+    if (editor->cursor_col > len) editor->cursor_col = len;
+}
+
+#define SEARCH_CHUNK (1 << 20)
+#define SEARCH_MAX_THREADS 8
+#define SEARCH_MAX_NEEDLE 256
+
+typedef struct SearchChunk {
+    size_t *offsets;
+    int count;
+    int capacity;
+    SDL_AtomicInt done;
+} SearchChunk;
+
+typedef struct SearchMatch {
+    size_t line;
+    size_t col;
+} SearchMatch;
+
+// Find-in-file. The document is copied once per version so workers can
+// scan it without locking; they claim 1 MB chunks and the UI thread picks
+// up finished chunks in order, so matches show up sorted as they stream in.
+typedef struct Search {
+    char *text;
+    size_t len;
+    u32 version;
+    char needle[SEARCH_MAX_NEEDLE];
+    size_t needle_len;
+
+    SearchChunk *chunks;
+    int chunk_count;
+    SDL_AtomicInt next_chunk;
+    SDL_AtomicInt cancel;
+    SDL_Thread *threads[SEARCH_MAX_THREADS];
+    int thread_count;
+
+    // UI thread only
+    int polled;
+    SearchMatch *matches;
+    int match_count;
+    int match_capacity;
+} Search;
+
+int search_worker(void *data) {
+    Search *search = data;
+    while (!SDL_GetAtomicInt(&search->cancel)) {
+        int i = SDL_AddAtomicInt(&search->next_chunk, 1);
+        if (i >= search->chunk_count) break;
+        SearchChunk *chunk = &search->chunks[i];
+        size_t begin = (size_t)i * SEARCH_CHUNK;
+        size_t end = begin + SEARCH_CHUNK < search->len ? begin + SEARCH_CHUNK : search->len;
+        search_range(search->text, search->len, begin, end, search->needle, search->needle_len, &chunk->offsets, &chunk->count, &chunk->capacity);
+        SDL_SetAtomicInt(&chunk->done, 1);
+    }
+    return 0;
+}
+
+void search_stop(Search *search) {
+    SDL_SetAtomicInt(&search->cancel, 1);
+    for (int i = 0; i < search->thread_count; i++) {
+        SDL_WaitThread(search->threads[i], NULL);
+    }
+    search->thread_count = 0;
+    for (int i = 0; i < search->chunk_count; i++) {
+        free(search->chunks[i].offsets);
+    }
+    free(search->chunks);
+    search->chunks = NULL;
+    search->chunk_count = 0;
+    search->polled = 0;
+    search->match_count = 0;
+}
+
+void search_start(Search *search, Editor *editor, const char *needle, size_t needle_len) {
+    search_stop(search);
+    if (needle_len == 0 || needle_len >= SEARCH_MAX_NEEDLE) return;
+    memcpy(search->needle, needle, needle_len);
+    search->needle_len = needle_len;
+
+    if (!search->text || search->version != editor->version) {
+        free(search->text);
+        search->len = doc_length(&editor->doc);
+        search->text = malloc(search->len + 1);
+        doc_copy(&editor->doc, 0, search->len, search->text);
+        search->version = editor->version;
+    }
+
+    search->chunk_count = (int)((search->len + SEARCH_CHUNK - 1) / SEARCH_CHUNK);
+    search->chunks = calloc(search->chunk_count ? search->chunk_count : 1, sizeof(SearchChunk));
+    SDL_SetAtomicInt(&search->next_chunk, 0);
+    SDL_SetAtomicInt(&search->cancel, 0);
+
+    // Small files are searched right here, big ones in the background
+    if (search->chunk_count <= 1) {
+        search_worker(search);
+        return;
+    }
+    int threads = SDL_GetNumLogicalCPUCores() - 1;
+    if (threads < 1) threads = 1;
+    if (threads > SEARCH_MAX_THREADS) threads = SEARCH_MAX_THREADS;
+    if (threads > search->chunk_count) threads = search->chunk_count;
+    for (int i = 0; i < threads; i++) {
+        SDL_Thread *thread = SDL_CreateThread(search_worker, "search", search);
+        if (thread) search->threads[search->thread_count++] = thread;
+    }
+    // Without any workers nothing would ever mark a chunk done
+    if (search->thread_count == 0) {
+        SDL_Log("Error creating search threads: %s", SDL_GetError());
+        search_worker(search);
+    }
+}
+
+// Moves finished chunks into the match list, mapped to line and column
+void search_poll(Search *search, Editor *editor) {
+    size_t line = 0, line_start = 0, next_start = 0;
+    for (; search->polled < search->chunk_count; search->polled++) {
+        SearchChunk *chunk = &search->chunks[search->polled];
+        if (!SDL_GetAtomicInt(&chunk->done)) break;
+        for (int i = 0; i < chunk->count; i++) {
+            size_t offset = chunk->offsets[i];
+            // Matches are sorted, so most land on the line of the last one
+            if (offset < line_start || offset >= next_start) {
+                line = doc_offset_line(&editor->doc, offset);
+                line_start = doc_line_offset(&editor->doc, line);
+                next_start = line + 1 < doc_line_count(&editor->doc) ? doc_line_offset(&editor->doc, line + 1) : (size_t)-1;
+            }
+            if (search->match_count == search->match_capacity) {
+                search->match_capacity = search->match_capacity ? search->match_capacity * 2 : 256;
+                search->matches = realloc(search->matches, search->match_capacity * sizeof(SearchMatch));
+            }
+            search->matches[search->match_count++] = (SearchMatch){line, offset - line_start};
+        }
+        free(chunk->offsets);
+        chunk->offsets = NULL;
+    }
+}
+
+bool search_running(Search *search) {
+    return search->polled < search->chunk_count;
+}
+
+// Index of the first match on or after `line`
+int search_first_match(Search *search, size_t line) {
+    int lo = 0, hi = search->match_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (search->matches[mid].line < line) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void search_free(Search *search) {
+    search_stop(search);
+    free(search->text);
+    free(search->matches);
+}
+
+int main(int argc, char *argv[]) {
+
+    Editor editor;
+    editor_open(&editor, "render.c");
 
 
     float scroll_offset = 0;
@@ -351,16 +557,20 @@ int main(int argc, char *argv[]) {
 
     int width = 800;
     int height = 600;
+    bool minimap_drag = false;
+    minimap_resize(&editor.minimap, height < MINIMAP_MAX_ROWS ? height : MINIMAP_MAX_ROWS);
+    wrap_set_width(&editor.wrap, (float)(width - MINIMAP_WIDTH));
 
     ASSERT_CALL(SDL_Init(SDL_INIT_VIDEO));
 
-    SDL_Window *window = SDL_CreateWindow("Playground", width, height, 0);
+    SDL_Window *window = SDL_CreateWindow("Playground", width, height, SDL_WINDOW_RESIZABLE);
     ASSERT_CREATED(window);
 
     // GPU Init
     SDL_GPUDevice *gpu = SDL_CreateGPUDevice(SDL_GPU_SHADERFORMAT_SPIRV, true, NULL);
     ASSERT_CREATED(gpu);
     ASSERT_CALL(SDL_ClaimWindowForGPUDevice(gpu, window));
+    SDL_StartTextInput(window);
 
     // Shaders
     SDL_GPUShader *vertex_shader = load_shader(gpu, "shaders/2d.vert.spv", SDL_GPU_SHADERSTAGE_VERTEX, 0, 0, 1, 1);
@@ -462,6 +672,14 @@ int main(int argc, char *argv[]) {
 
     u64 buf_capacity = store.capacity;
 
+    SDL_GPUTransferBuffer *minimap_transfer_buffer = SDL_CreateGPUTransferBuffer(
+        gpu,
+        &(SDL_GPUTransferBufferCreateInfo){
+            .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
+            .size = MINIMAP_COLS * MINIMAP_MAX_ROWS * 4,
+        }
+    );
+
     /*VertInput vertices[2] = {*/
     /*    (VertInput){*/
     /*        .dst_rect = (Rect){100.0f, 100.0f, 400.0f, 400.0f},*/
@@ -497,6 +715,11 @@ int main(int argc, char *argv[]) {
 
     /*unsigned int buf_size = 2 * sizeof(VertInput);*/
 
+    Search search = {0};
+    bool finding = false;
+    char query[SEARCH_MAX_NEEDLE];
+    size_t query_len = 0;
+
     // Main loop
     bool quit = false;
     SDL_Event event;
@@ -508,25 +731,81 @@ int main(int argc, char *argv[]) {
                     quit = true;
                     break;
                 case SDL_EVENT_KEY_DOWN:
-                    if (event.key.key == SDLK_Q) {
+                    if (event.key.key == SDLK_Q && (event.key.mod & SDL_KMOD_CTRL)) {
                         quit = true;
+                    } else if (event.key.key == SDLK_F && (event.key.mod & SDL_KMOD_CTRL)) {
+                        finding = true;
+                    } else if (finding) {
+                        if (event.key.key == SDLK_ESCAPE) {
+                            finding = false;
+                            query_len = 0;
+                            search_stop(&search);
+                        } else if (event.key.key == SDLK_BACKSPACE && query_len > 0) {
+                            search_start(&search, &editor, query, --query_len);
+                        } else if (event.key.key == SDLK_RETURN && search.match_count > 0) {
+                            // Jump to the next match after the cursor, wrapping around
+                            int i = search_first_match(&search, editor.cursor_line + 1);
+                            if (i == search.match_count) i = 0;
+                            editor.cursor_line = search.matches[i].line;
+                            editor.cursor_col = search.matches[i].col;
+                            float x;
+                            scroll_offset = height / 2 - (float)editor_locate(&editor, &font, editor.cursor_line, editor.cursor_col, &x) * LINE_HEIGHT;
+                        }
+                    } else if (event.key.key == SDLK_RETURN) {
+                        editor_insert(&editor, "\n", 1);
+                    } else if (event.key.key == SDLK_BACKSPACE) {
+                        editor_backspace(&editor);
+                    } else if (event.key.key == SDLK_UP) {
+                        editor_move(&editor, -1, 0);
+                    } else if (event.key.key == SDLK_DOWN) {
+                        editor_move(&editor, 1, 0);
+                    } else if (event.key.key == SDLK_LEFT) {
+                        editor_move(&editor, 0, -1);
+                    } else if (event.key.key == SDLK_RIGHT) {
+                        editor_move(&editor, 0, 1);
+                    }
+                    break;
+                case SDL_EVENT_TEXT_INPUT:
+                    if (finding) {
+                        size_t len = strlen(event.text.text);
+                        if (query_len + len < SEARCH_MAX_NEEDLE) {
+                            memcpy(query + query_len, event.text.text, len);
+                            query_len += len;
+                            search_start(&search, &editor, query, query_len);
+                        }
+                    } else {
+                        editor_insert(&editor, event.text.text, strlen(event.text.text));
                     }
                     break;
                 case SDL_EVENT_MOUSE_BUTTON_DOWN:
                     if (event.button.button == SDL_BUTTON_LEFT) {
-                        mouse_down = true;
+                        if (event.button.x >= width - MINIMAP_WIDTH) {
+                            minimap_drag = true;
+                            scroll_offset = height / 2 - (float)wrap_line_row(&editor.wrap, (int)event.button.y << editor.minimap.shift) * LINE_HEIGHT;
+                        } else {
+                            mouse_down = true;
+                        }
                     }
                     break;
                 case SDL_EVENT_MOUSE_BUTTON_UP:
                     if (event.button.button == SDL_BUTTON_LEFT) {
                         mouse_down = false;
+                        minimap_drag = false;
                     }
                     break;
                 case SDL_EVENT_MOUSE_MOTION:
-                    if (mouse_down) {
+                    if (minimap_drag) {
+                        scroll_offset = height / 2 - (float)wrap_line_row(&editor.wrap, (int)event.motion.y << editor.minimap.shift) * LINE_HEIGHT;
+                    } else if (mouse_down) {
                         scroll_offset += event.motion.yrel;
                     }
                     break;
+                case SDL_EVENT_WINDOW_RESIZED:
+                    width = event.window.data1;
+                    height = event.window.data2;
+                    minimap_resize(&editor.minimap, height < MINIMAP_MAX_ROWS ? height : MINIMAP_MAX_ROWS);
+                    wrap_set_width(&editor.wrap, (float)(width - MINIMAP_WIDTH));
+                    break;
                 case SDL_EVENT_MOUSE_WHEEL:
                     scroll_offset += event.wheel.y * 20.0f;
                     break;
@@ -536,9 +815,78 @@ int main(int argc, char *argv[]) {
 
         store.size = 0;
 
-        for (int i = 0; i < line_count; i++) {
-            draw_text(&store, &font, buf[i], 0, i * 20 + scroll_offset);
+        int line_count = (int)doc_line_count(&editor.doc);
+        int first_row = (int)SDL_floorf(-scroll_offset / LINE_HEIGHT) - 1;
+        int last_row = (int)SDL_ceilf((height - scroll_offset) / LINE_HEIGHT);
+        if (first_row < 0) first_row = 0;
+        int row_in_line;
+        int first_line = wrap_row_line(&editor.wrap, first_row, &row_in_line);
+        int last_line = wrap_row_line(&editor.wrap, last_row, &row_in_line) + 1;
+        if (last_line > line_count) last_line = line_count;
+
+        // Offsets into an old copy of the document are meaningless, so an
+        // edit restarts the search on a fresh one
+        if (query_len > 0 && search.version != editor.version) {
+            search_start(&search, &editor, query, query_len);
+        }
+        search_poll(&search, &editor);
+        for (int m = search_first_match(&search, first_line); m < search.match_count && search.matches[m].line < (size_t)last_line; m++) {
+            SearchMatch match = search.matches[m];
+            float x0, x1;
+            int row0 = editor_locate(&editor, &font, match.line, match.col, &x0);
+            size_t len = doc_line_length(&editor.doc, match.line);
+            size_t end = match.col + search.needle_len < len ? match.col + search.needle_len : len;
+            int row1 = editor_locate(&editor, &font, match.line, end, &x1);
+            // A match split by a wrap gets a box on each row
+            for (int row = row0; row <= row1; row++) {
+                float left = row == row0 ? x0 : 0.0f;
+                float right = row == row1 ? x1 : editor.wrap.width;
+                Rect box = {left - 2.0f, row * LINE_HEIGHT + scroll_offset + 2.0f, right - left + 4.0f, LINE_HEIGHT + 4.0f};
+                draw_box(&store, box, (Vec4){{0.9f, 0.6f, 0.1f, 0.6f}}, 4.0f, 0.0f, (Vec4){0});
+            }
+        }
+
+        syntax_update(&editor.syntax, editor_get_line, &editor, last_line, SYNTAX_BUDGET);
+        // Wrapping a visible line can change its row count, so rows are
+        // counted as the lines are laid out
+        int row = wrap_line_row(&editor.wrap, first_line);
+        for (int i = first_line; i < line_count && row < last_row; i++) {
+            int breaks[WRAP_MAX_ROWS];
+            int len = (int)doc_get_line(&editor.doc, i, &editor.line, &editor.line_capacity);
+            if (editor.kinds_capacity < editor.line_capacity) {
+                editor.kinds_capacity = editor.line_capacity;
+                editor.kinds = realloc(editor.kinds, editor.kinds_capacity);
+            }
+            int rows = wrap_line(&editor.wrap, &font.metrics, i, editor.line, len, breaks, WRAP_MAX_ROWS);
+            draw_code_line(&store, &font, editor.line, len, syntax_line_state(&editor.syntax, i), editor.kinds, breaks, rows < WRAP_MAX_ROWS ? rows : WRAP_MAX_ROWS, 0, row * LINE_HEIGHT + scroll_offset);
+            row += rows;
         }
+        wrap_update(&editor.wrap, &font.metrics, editor_get_line, &editor, WRAP_BUDGET);
+
+        float cursor_x;
+        int cursor_row = editor_locate(&editor, &font, editor.cursor_line, editor.cursor_col, &cursor_x);
+        draw_rect(&store, (Rect){cursor_x, cursor_row * LINE_HEIGHT + scroll_offset + 4.0f, 2.0f, FONT_SIZE}, (Vec4){{1.0f, 1.0f, 1.0f, 1.0f}});
+
+        // Minimap: the cached image plus a box over the visible lines
+        editor_update_minimap(&editor);
+        Minimap *minimap = &editor.minimap;
+        float lines_per_row = (float)(1 << minimap->shift);
+        draw_rect(&store, (Rect){(float)(width - MINIMAP_WIDTH), 0.0f, MINIMAP_WIDTH, (float)height}, (Vec4){{0.1f, 0.1f, 0.1f, 1.0f}});
+        draw_image(&store,
+                   (Rect){(float)(width - MINIMAP_WIDTH), 0.0f, MINIMAP_WIDTH, (float)minimap->row_count},
+                   (Rect){0.0f, (float)ATLAS_HEIGHT / TEXTURE_HEIGHT, (float)MINIMAP_COLS / ATLAS_WIDTH, (float)minimap->row_count / TEXTURE_HEIGHT},
+                   (Vec4){{0.8f, 0.8f, 0.8f, 1.0f}});
+        float view_rows = (last_line - first_line) / lines_per_row;
+        Rect view = {(float)(width - MINIMAP_WIDTH), first_line / lines_per_row, MINIMAP_WIDTH, view_rows > 2.0f ? view_rows : 2.0f};
+        draw_rect(&store, view, (Vec4){{1.0f, 1.0f, 1.0f, 0.2f}});
+
+        if (finding) {
+            char status[SEARCH_MAX_NEEDLE + 64];
+            snprintf(status, sizeof(status), "Find: %.*s  (%d%s)", (int)query_len, query, search.match_count, search_running(&search) ? "..." : "");
+            draw_rect(&store, (Rect){0.0f, height - LINE_HEIGHT - 8.0f, (float)width, LINE_HEIGHT + 8.0f}, (Vec4){{0.1f, 0.1f, 0.1f, 1.0f}});
+            draw_text(&store, &font, status, 4.0f, height - LINE_HEIGHT - 4.0f);
+        }
+
         if (buf_capacity != store.capacity) {
             SDL_ReleaseGPUTransferBuffer(gpu, vertex_data_transfer_buffer);
             vertex_data_transfer_buffer = SDL_CreateGPUTransferBuffer(
@@ -599,6 +947,37 @@ int main(int argc, char *argv[]) {
                 },
                 true
             );
+
+            // Only the minimap rows that changed since the last upload
+            if (minimap->dirty_from < minimap->dirty_until) {
+                int rows = minimap->dirty_until - minimap->dirty_from;
+                u8 *pixels = SDL_MapGPUTransferBuffer(gpu, minimap_transfer_buffer, true);
+                const u8 *src = minimap->image + minimap->dirty_from * MINIMAP_COLS;
+                for (int i = 0; i < rows * MINIMAP_COLS; i++) {
+                    pixels[i * 4] = 0xff;
+                    pixels[i * 4 + 1] = 0xff;
+                    pixels[i * 4 + 2] = 0xff;
+                    pixels[i * 4 + 3] = src[i];
+                }
+                SDL_UnmapGPUTransferBuffer(gpu, minimap_transfer_buffer);
+                SDL_UploadToGPUTexture(
+                    copy_pass,
+                    &(SDL_GPUTextureTransferInfo){
+                        .transfer_buffer = minimap_transfer_buffer,
+                        .offset = 0,
+                    },
+                    &(SDL_GPUTextureRegion){
+                        .texture = font.texture.handle,
+                        .x = 0,
+                        .y = ATLAS_HEIGHT + minimap->dirty_from,
+                        .w = MINIMAP_COLS,
+                        .h = rows,
+                        .d = 1,
+                    },
+                    false
+                );
+                minimap->dirty_from = minimap->dirty_until = 0;
+            }
             SDL_EndGPUCopyPass(copy_pass);
 
 
@@ -629,8 +1008,8 @@ int main(int argc, char *argv[]) {
             );
 
             SDL_BindGPUVertexStorageBuffers(render_pass, 0, &vertex_data_buffer, 1);
-            SDL_PushGPUVertexUniformData(cmdbuf, 0, &(Vec2){800.0f, 600.0f}, sizeof(Vec2));
-            SDL_PushGPUFragmentUniformData(cmdbuf, 0, &(Vec2){800.0f, 600.0f}, sizeof(Vec2));
+            SDL_PushGPUVertexUniformData(cmdbuf, 0, &(Vec2){(float)width, (float)height}, sizeof(Vec2));
+            SDL_PushGPUFragmentUniformData(cmdbuf, 0, &(Vec2){(float)width, (float)height}, sizeof(Vec2));
 
             SDL_DrawGPUPrimitives(render_pass, store.size * 6, 1, 0, 0);
             SDL_EndGPURenderPass(render_pass);
@@ -643,8 +1022,12 @@ int main(int argc, char *argv[]) {
 	SDL_ReleaseGPUGraphicsPipeline(gpu, pipeline);
 	SDL_ReleaseGPUSampler(gpu, sampler);
 	SDL_ReleaseGPUTexture(gpu, texture.handle);
+	font_metrics_free(&font.metrics);
+	search_free(&search);
+	editor_close(&editor);
 	SDL_ReleaseGPUTransferBuffer(gpu, vertex_data_transfer_buffer);
 	SDL_ReleaseGPUBuffer(gpu, vertex_data_buffer);
+	SDL_ReleaseGPUTransferBuffer(gpu, minimap_transfer_buffer);
     SDL_DestroyGPUDevice(gpu);
     SDL_DestroyWindow(window);
     SDL_Quit();
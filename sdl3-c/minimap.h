@@ -0,0 +1,369 @@
+// Code minimap: a tiny density picture of the whole document.
+//
+// Every line is summarized once into a 32-bit mask with one bit per
+// MINIMAP_CELL_CHARS columns that contain ink. Masks are summed per block of
+// MINIMAP_BLOCK lines, and blocks are averaged pairwise into a pyramid, so a
+// minimap row covering 2^k lines is one node of the pyramid no matter how
+// big the file is. Edits only recompute the masks, blocks and pyramid nodes
+// they touch, and the image rows that changed are reported so the caller
+// can upload just those. The masks sit in a gap buffer so inserting lines
+// only moves the masks between this edit and the last one.
+//
+// In exactly one C or C++ file in your project:
+// #define MINIMAP_IMPLEMENTATION
+// #include "minimap.h"
+
+#ifndef MINIMAP_H
+#define MINIMAP_H
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MINIMAP_SSE2
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+#define MINIMAP_COLS 32
+#define MINIMAP_CELL_CHARS 4
+#define MINIMAP_BLOCK_SHIFT 6
+#define MINIMAP_BLOCK (1 << MINIMAP_BLOCK_SHIFT)
+#define MINIMAP_MAX_LEVELS 32
+
+typedef struct Minimap {
+    u32 *mask; // per line, with a gap of capacity - count entries at gap_start
+    int count;
+    int capacity;
+    int gap_start;
+    int scan_from, scan_until;   // lines whose masks are stale
+    int block_from, block_until; // blocks that need recounting
+
+    // level[0][b * MINIMAP_COLS + c] is the ink density (0-255) of column c
+    // over block b; each level above averages pairs of the one below
+    u8 *level[MINIMAP_MAX_LEVELS];
+    int level_size[MINIMAP_MAX_LEVELS];
+    int level_capacity[MINIMAP_MAX_LEVELS];
+
+    int shift; // each image row covers 1 << shift lines
+    int max_rows;
+    int row_count;
+    u8 *image; // MINIMAP_COLS x max_rows densities
+    int dirty_from, dirty_until; // image rows changed, for the caller to upload
+} Minimap;
+
+void minimap_init(Minimap *m, int line_count, int max_rows);
+void minimap_free(Minimap *m);
+
+// The image is at most `max_rows` tall. Changing it redraws every row.
+void minimap_resize(Minimap *m, int max_rows);
+
+// Lines [line, line + removed) were replaced by `inserted` new lines.
+void minimap_lines_changed(Minimap *m, int line, int removed, int inserted);
+
+u32 minimap_line_mask(const char *line, size_t len);
+
+static inline u32 minimap_mask(const Minimap *m, int line) {
+    return m->mask[line < m->gap_start ? line : line + m->capacity - m->count];
+}
+
+// Next run of stale lines, at most `budget` long. Returns false if none.
+bool minimap_next_scan(const Minimap *m, int budget, int *first, int *count);
+
+// `text` holds lines [first, first + count) separated by '\n'.
+void minimap_scan(Minimap *m, int first, int count, const char *text, size_t len);
+
+// Recounts at most `budget` blocks whose lines are all scanned, then
+// refreshes the pyramid and image rows above them. Returns blocks done.
+int minimap_update(Minimap *m, int budget);
+
+#ifdef MINIMAP_IMPLEMENTATION
+
+// Byte i of minimap_spread[x] is bit i of x, so adding these up counts
+// eight columns at once without any byte overflowing (at most 64 lines)
+static u64 minimap_spread[256];
+
+static void minimap_mark_rows(Minimap *m, int from, int until) {
+    if (from >= until) return;
+    if (m->dirty_from >= m->dirty_until) {
+        m->dirty_from = from;
+        m->dirty_until = until;
+    } else {
+        if (from < m->dirty_from) m->dirty_from = from;
+        if (until > m->dirty_until) m->dirty_until = until;
+    }
+}
+
+static int minimap_pick_shift(const Minimap *m) {
+    int shift = 0;
+    while (((m->count + (1 << shift) - 1) >> shift) > m->max_rows) shift++;
+    return shift;
+}
+
+void minimap_init(Minimap *m, int line_count, int max_rows) {
+    if (!minimap_spread[255]) {
+        for (int x = 0; x < 256; x++) {
+            u64 v = 0;
+            for (int i = 0; i < 8; i++) {
+                if (x & (1 << i)) v |= (u64)1 << (i * 8);
+            }
+            minimap_spread[x] = v;
+        }
+    }
+    memset(m, 0, sizeof(*m));
+    m->count = line_count;
+    m->capacity = line_count > 0 ? line_count : 1;
+    m->mask = calloc(m->capacity, sizeof(u32));
+    m->gap_start = line_count;
+    m->scan_until = line_count;
+    m->block_until = (line_count + MINIMAP_BLOCK - 1) >> MINIMAP_BLOCK_SHIFT;
+    minimap_resize(m, max_rows);
+}
+
+void minimap_free(Minimap *m) {
+    free(m->mask);
+    for (int i = 0; i < MINIMAP_MAX_LEVELS; i++) free(m->level[i]);
+    free(m->image);
+    memset(m, 0, sizeof(*m));
+}
+
+void minimap_resize(Minimap *m, int max_rows) {
+    m->max_rows = max_rows > 0 ? max_rows : 1;
+    m->image = realloc(m->image, m->max_rows * MINIMAP_COLS);
+    memset(m->image, 0, m->max_rows * MINIMAP_COLS);
+    m->shift = -1; // forces a full redraw on the next update
+}
+
+void minimap_lines_changed(Minimap *m, int line, int removed, int inserted) {
+    int count = m->count - removed + inserted;
+    int delta = inserted - removed;
+
+    // Move the gap to just after the replaced lines, drop them into it,
+    // and take the inserted lines back out of it
+    int gap = m->capacity - m->count;
+    int to = line + removed;
+    if (to < m->gap_start) {
+        memmove(m->mask + to + gap, m->mask + to, (m->gap_start - to) * sizeof(u32));
+    } else {
+        memmove(m->mask + m->gap_start, m->mask + m->gap_start + gap, (to - m->gap_start) * sizeof(u32));
+    }
+    if (count > m->capacity) {
+        int tail = m->count - to;
+        int capacity = m->capacity;
+        while (count > capacity) capacity *= 2;
+        m->mask = realloc(m->mask, capacity * sizeof(u32));
+        memmove(m->mask + capacity - tail, m->mask + m->capacity - tail, tail * sizeof(u32));
+        m->capacity = capacity;
+    }
+    m->gap_start = line + inserted;
+    m->count = count;
+
+    if (m->scan_from < m->scan_until) {
+        if (m->scan_until > line + removed) m->scan_until += delta;
+        else if (m->scan_until > line) m->scan_until = line + inserted;
+        if (m->scan_from > line + removed) m->scan_from += delta;
+        if (line < m->scan_from) m->scan_from = line;
+        if (line + inserted > m->scan_until) m->scan_until = line + inserted;
+    } else {
+        m->scan_from = line;
+        m->scan_until = line + inserted;
+    }
+
+    // Lines after the edit moved, so every block from here on changes
+    int block_count = (count + MINIMAP_BLOCK - 1) >> MINIMAP_BLOCK_SHIFT;
+    int from = line >> MINIMAP_BLOCK_SHIFT;
+    int until = delta ? block_count : ((line + inserted - 1) >> MINIMAP_BLOCK_SHIFT) + 1;
+    if (m->block_from < m->block_until) {
+        if (from > m->block_from) from = m->block_from;
+        if (until < m->block_until) until = m->block_until;
+    }
+    m->block_from = from;
+    m->block_until = until < block_count ? until : block_count;
+}
+
+u32 minimap_line_mask(const char *s, size_t len) {
+    u32 mask = 0;
+    size_t i = 0;
+    size_t end = len < MINIMAP_COLS * MINIMAP_CELL_CHARS ? len : MINIMAP_COLS * MINIMAP_CELL_CHARS;
+#ifdef MINIMAP_SSE2
+    // Tabs move the column, so lines with one take the scalar path
+    for (; i + 16 <= end; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')))) break;
+        u32 blank = (u32)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        u32 ink = ~blank & 0xffff;
+        // Any of each group of four bits -> one cell bit
+        ink |= ink >> 1;
+        ink |= ink >> 2;
+        ink &= 0x1111;
+        mask |= ((ink | ink >> 3 | ink >> 6 | ink >> 9) & 0xf) << (i / MINIMAP_CELL_CHARS);
+    }
+#endif
+    for (size_t col = i; i < len && col < MINIMAP_COLS * MINIMAP_CELL_CHARS; i++) {
+        if (s[i] == '\t') {
+            col = (col / 4 + 1) * 4;
+            continue;
+        }
+        if (s[i] != ' ' && s[i] != '\r') mask |= 1u << (col / MINIMAP_CELL_CHARS);
+        col++;
+    }
+    return mask;
+}
+
+bool minimap_next_scan(const Minimap *m, int budget, int *first, int *count) {
+    if (m->scan_from >= m->scan_until) return false;
+    *first = m->scan_from;
+    *count = m->scan_until - m->scan_from < budget ? m->scan_until - m->scan_from : budget;
+    return true;
+}
+
+void minimap_scan(Minimap *m, int first, int count, const char *text, size_t len) {
+    const char *p = text, *end = text + len;
+    for (int i = first; i < first + count; i++) {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *line_end = nl ? nl : end;
+        m->mask[i < m->gap_start ? i : i + m->capacity - m->count] = minimap_line_mask(p, line_end - p);
+        p = nl ? nl + 1 : end;
+    }
+    if (first <= m->scan_from && first + count > m->scan_from) m->scan_from = first + count;
+}
+
+// Per-column ink counts over lines [from, until), at most 64 of them
+static void minimap_count(const Minimap *m, int from, int until, u8 *counts) {
+    u64 acc[4] = {0};
+    for (int i = from; i < until; i++) {
+        u32 x = minimap_mask(m, i);
+        acc[0] += minimap_spread[x & 0xff];
+        acc[1] += minimap_spread[(x >> 8) & 0xff];
+        acc[2] += minimap_spread[(x >> 16) & 0xff];
+        acc[3] += minimap_spread[x >> 24];
+    }
+    memcpy(counts, acc, MINIMAP_COLS); // little endian: byte c is column c
+}
+
+static void minimap_reserve_level(Minimap *m, int j, int size) {
+    if (size > m->level_capacity[j]) {
+        int old = m->level_capacity[j];
+        m->level_capacity[j] = size * 2;
+        m->level[j] = realloc(m->level[j], m->level_capacity[j] * MINIMAP_COLS);
+        memset(m->level[j] + old * MINIMAP_COLS, 0, (m->level_capacity[j] - old) * MINIMAP_COLS);
+    }
+    m->level_size[j] = size;
+}
+
+static void minimap_draw_row(Minimap *m, int r) {
+    u8 *out = m->image + r * MINIMAP_COLS;
+    if (m->shift >= MINIMAP_BLOCK_SHIFT) {
+        memcpy(out, m->level[m->shift - MINIMAP_BLOCK_SHIFT] + r * MINIMAP_COLS, MINIMAP_COLS);
+        return;
+    }
+    int from = r << m->shift;
+    int until = from + (1 << m->shift) < m->count ? from + (1 << m->shift) : m->count;
+    u8 counts[MINIMAP_COLS];
+    minimap_count(m, from, until, counts);
+    for (int c = 0; c < MINIMAP_COLS; c++) {
+        out[c] = (u8)(counts[c] * 255 >> m->shift);
+    }
+}
+
+int minimap_update(Minimap *m, int budget) {
+    int block_count = (m->count + MINIMAP_BLOCK - 1) >> MINIMAP_BLOCK_SHIFT;
+
+    int shift = minimap_pick_shift(m);
+    int row_count = (m->count + (1 << shift) - 1) >> shift;
+    bool redraw = shift != m->shift;
+    if (row_count != m->row_count) {
+        // Rows past the end have to be cleared
+        if (row_count < m->row_count) {
+            memset(m->image + row_count * MINIMAP_COLS, 0, (m->row_count - row_count) * MINIMAP_COLS);
+            minimap_mark_rows(m, row_count, m->row_count);
+        }
+        m->row_count = row_count;
+    }
+    m->shift = shift;
+
+    // Blocks can only be counted once all of their lines are scanned
+    int from = m->block_from;
+    int until = m->block_until < block_count ? m->block_until : block_count;
+    if (m->scan_from < m->scan_until && (m->scan_from >> MINIMAP_BLOCK_SHIFT) < until) {
+        until = m->scan_from >> MINIMAP_BLOCK_SHIFT;
+    }
+    if (until - from > budget) until = from + budget;
+    int done = until > from ? until - from : 0;
+
+    int levels = 1;
+    minimap_reserve_level(m, 0, block_count);
+    for (int size = block_count; size > 1 && levels < MINIMAP_MAX_LEVELS; levels++) {
+        size = (size + 1) / 2;
+        minimap_reserve_level(m, levels, size);
+    }
+
+    if (from < until) {
+        for (int b = from; b < until; b++) {
+            u8 counts[MINIMAP_COLS];
+            int line = b << MINIMAP_BLOCK_SHIFT;
+            minimap_count(m, line, line + MINIMAP_BLOCK < m->count ? line + MINIMAP_BLOCK : m->count, counts);
+            u8 *out = m->level[0] + b * MINIMAP_COLS;
+            for (int c = 0; c < MINIMAP_COLS; c++) {
+                out[c] = (u8)(counts[c] * 255 / MINIMAP_BLOCK);
+            }
+        }
+
+        // Average pairs up the pyramid, a node missing its right half
+        // counts it as empty
+        for (int j = 1, lo = from, hi = until; j < levels; j++) {
+            lo >>= 1;
+            hi = (hi + 1) >> 1;
+            for (int n = lo; n < hi; n++) {
+                const u8 *a = m->level[j - 1] + 2 * n * MINIMAP_COLS;
+                u8 *out = m->level[j] + n * MINIMAP_COLS;
+                if (2 * n + 1 < m->level_size[j - 1]) {
+#ifdef MINIMAP_SSE2
+                    __m128i a0 = _mm_loadu_si128((const __m128i *)a);
+                    __m128i a1 = _mm_loadu_si128((const __m128i *)(a + 16));
+                    __m128i b0 = _mm_loadu_si128((const __m128i *)(a + MINIMAP_COLS));
+                    __m128i b1 = _mm_loadu_si128((const __m128i *)(a + MINIMAP_COLS + 16));
+                    _mm_storeu_si128((__m128i *)out, _mm_avg_epu8(a0, b0));
+                    _mm_storeu_si128((__m128i *)(out + 16), _mm_avg_epu8(a1, b1));
+#else
+                    for (int c = 0; c < MINIMAP_COLS; c++) {
+                        out[c] = (u8)((a[c] + a[MINIMAP_COLS + c] + 1) >> 1);
+                    }
+#endif
+                } else {
+                    for (int c = 0; c < MINIMAP_COLS; c++) out[c] = (u8)((a[c] + 1) >> 1);
+                }
+            }
+        }
+
+        m->block_from = until;
+        if (m->block_from >= m->block_until) m->block_from = m->block_until = 0;
+    }
+
+    if (redraw) {
+        from = 0;
+        until = row_count;
+    } else if (from < until) {
+        from = (from << MINIMAP_BLOCK_SHIFT) >> shift;
+        until = (((until << MINIMAP_BLOCK_SHIFT) - 1) >> shift) + 1;
+        if (until > row_count) until = row_count;
+    }
+    for (int r = from; r < until; r++) {
+        minimap_draw_row(m, r);
+    }
+    minimap_mark_rows(m, from, until);
+    return done;
+}
+
+#endif // MINIMAP_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MINIMAP_H
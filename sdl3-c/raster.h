@@ -0,0 +1,575 @@
+// Software renderer for the 2D pipeline: draws a VertStore into an RGBA8
+// framebuffer the way shaders/2d.vert.hlsl and 2d.frag.hlsl do on the GPU,
+// for machines without one.
+//
+// Quads are binned into 64x64 screen tiles in draw order, then a pool of
+// threads shades whole tiles, so no two threads ever touch the same pixel
+// and blending stays in order. Shading runs four pixels at a time with
+// SSE2. Setting `reference` shades one pixel at a time with a line by line
+// transcription of the HLSL instead, to check the fast path against.
+//
+// In exactly one C or C++ file in your project:
+// #define RASTER_IMPLEMENTATION
+// #include "raster.h"
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTER_SSE2
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "draw.h"
+
+#define RASTER_TILE 64
+#define RASTER_MAX_THREADS 32
+
+typedef struct RasterTexture {
+    const u8 *pixels; // RGBA8
+    int w, h;
+} RasterTexture;
+
+enum {
+    RASTER_FLAT,     // untextured without a border: the shader skips the SDF
+    RASTER_SDF,      // rounded box with a border
+    RASTER_TEXTURED,
+};
+
+// A VertInput with everything the shader would derive per pixel hoisted out
+typedef struct RasterQuad {
+    int kind;
+    bool gradient;
+    int x0, y0, x1, y1; // covered pixels, exclusive end
+    int ix0, iy0, ix1, iy1; // pixels shading to the plain vertex color
+    bool opaque;            // ...which are then a constant to store
+    u32 fill;
+    float x, y, inv_w, inv_h;
+    float u0, v0, du, dv;
+    Vec4 colors[4];
+    // Rounded box in the shader's units, where the screen is 2 tall
+    float cx, cy, scale;
+    float hx, hy, radii[4];
+    float hx2, hy2, radii2[4];
+    Vec4 border;
+} RasterQuad;
+
+typedef struct Raster {
+    int width, height;
+    u8 *pixels; // RGBA8, width * height
+    Vec4 clear_color;
+    bool reference;
+
+    RasterQuad *quads;
+    int quad_count;
+    int quad_capacity;
+    RasterTexture texture;
+
+    int tiles_x, tiles_y;
+    int *bin_start; // tiles_x * tiles_y + 1
+    int *bins;      // quad indices, in draw order per tile
+    int bin_capacity;
+
+    // Thread pool; tiles are handed out under the lock
+#ifdef _WIN32
+    HANDLE threads[RASTER_MAX_THREADS];
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE work, done;
+#else
+    pthread_t threads[RASTER_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+#endif
+    int thread_count;
+    u32 generation;
+    int next_tile;
+    int active;
+    bool quit;
+} Raster;
+
+// `thread_count` includes the calling thread.
+void raster_init(Raster *r, int width, int height, int thread_count);
+void raster_resize(Raster *r, int width, int height);
+void raster_free(Raster *r);
+
+// Clears to clear_color and draws `count` instances, sampling `texture`.
+void raster_draw(Raster *r, const VertInput *verts, int count, const RasterTexture *texture);
+
+#ifdef RASTER_IMPLEMENTATION
+
+#ifdef _WIN32
+#define RASTER_LOCK(r) EnterCriticalSection(&(r)->lock)
+#define RASTER_UNLOCK(r) LeaveCriticalSection(&(r)->lock)
+#define RASTER_WAIT(r, cond) SleepConditionVariableCS(&(r)->cond, &(r)->lock, INFINITE)
+#define RASTER_WAKE_ALL(r, cond) WakeAllConditionVariable(&(r)->cond)
+#else
+#define RASTER_LOCK(r) pthread_mutex_lock(&(r)->lock)
+#define RASTER_UNLOCK(r) pthread_mutex_unlock(&(r)->lock)
+#define RASTER_WAIT(r, cond) pthread_cond_wait(&(r)->cond, &(r)->lock)
+#define RASTER_WAKE_ALL(r, cond) pthread_cond_broadcast(&(r)->cond)
+#endif
+
+static inline float raster_smoothstep(float e0, float e1, float x) {
+    float t = (x - e0) / (e1 - e0);
+    t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+    return t * t * (3.0f - 2.0f * t);
+}
+
+static inline float raster_sdf_rounded_box(float px, float py, float bx, float by, const float *r) {
+    float rx = px > 0.0f ? r[0] : r[2];
+    float ry = px > 0.0f ? r[1] : r[3];
+    rx = py > 0.0f ? rx : ry;
+    float qx = fabsf(px) - bx + rx;
+    float qy = fabsf(py) - by + rx;
+    float mx = qx > 0.0f ? qx : 0.0f, my = qy > 0.0f ? qy : 0.0f;
+    float inside = qx > qy ? qx : qy;
+    return (inside < 0.0f ? inside : 0.0f) + sqrtf(mx * mx + my * my) - rx;
+}
+
+static inline u8 raster_unorm(float x) {
+    x = x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x;
+    return (u8)(x * 255.0f + 0.5f);
+}
+
+// One pixel, following 2d.frag.hlsl and the pipeline's blend state
+static void raster_shade_reference(const Raster *r, const RasterQuad *q, int i, int j, u8 *dst) {
+    float px = i + 0.5f, py = j + 0.5f;
+    float u = (px - q->x) * q->inv_w, v = (py - q->y) * q->inv_h;
+
+    // The quad is two triangles split from corner 0 to corner 2
+    float color[4];
+    for (int c = 0; c < 4; c++) {
+        const float *c0 = &q->colors[0].x, *c1 = &q->colors[1].x, *c2 = &q->colors[2].x, *c3 = &q->colors[3].x;
+        color[c] = v >= u ? (1.0f - v) * c0[c] + (v - u) * c1[c] + u * c2[c]
+                          : v * c2[c] + (u - v) * c3[c] + (1.0f - u) * c0[c];
+    }
+
+    float src[4];
+    if (q->kind == RASTER_TEXTURED) {
+        const RasterTexture *t = &r->texture;
+        float tu = (q->u0 + q->du * u) * t->w, tv = (q->v0 + q->dv * v) * t->h;
+        int tx = (int)floorf(tu), ty = (int)floorf(tv);
+        tx = tx < 0 ? 0 : tx >= t->w ? t->w - 1 : tx;
+        ty = ty < 0 ? 0 : ty >= t->h ? t->h - 1 : ty;
+        const u8 *texel = t->pixels + (ty * t->w + tx) * 4;
+        for (int c = 0; c < 4; c++) src[c] = color[c] * (texel[c] / 255.0f);
+    } else {
+        float sx = (px - q->cx) * q->scale, sy = (py - q->cy) * q->scale;
+        float d = raster_sdf_rounded_box(sx, sy, q->hx, q->hy, q->radii);
+        float d2 = 0.0f;
+        if (q->kind != RASTER_FLAT) d2 = raster_sdf_rounded_box(sx, sy, q->hx2, q->hy2, q->radii2);
+        float border[4] = {q->border.r, q->border.g, q->border.b, (1.0f - raster_smoothstep(0.0f, 0.003f, d)) * q->border.a};
+        float t = 1.0f - raster_smoothstep(0.0f, 0.005f, d2);
+        for (int c = 0; c < 4; c++) src[c] = border[c] + (color[c] - border[c]) * t;
+    }
+
+    float sa = src[3];
+    for (int c = 0; c < 3; c++) dst[c] = raster_unorm(src[c] * sa + dst[c] / 255.0f * (1.0f - sa));
+    dst[3] = raster_unorm(sa * sa + dst[3] / 255.0f * (1.0f - sa));
+}
+
+#ifdef RASTER_SSE2
+
+static inline __m128 raster_smoothstep4(float e1, __m128 x) {
+    __m128 t = _mm_mul_ps(x, _mm_set1_ps(1.0f / e1));
+    t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(t, t)));
+}
+
+static inline __m128 raster_sdf4(__m128 px, float py, float bx, float by, const float *r) {
+    __m128 right = _mm_cmpgt_ps(px, _mm_setzero_ps());
+    float a = py > 0.0f ? r[0] : r[1], b = py > 0.0f ? r[2] : r[3];
+    __m128 rx = _mm_or_ps(_mm_and_ps(right, _mm_set1_ps(a)), _mm_andnot_ps(right, _mm_set1_ps(b)));
+    __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 qx = _mm_add_ps(_mm_sub_ps(_mm_and_ps(px, abs_mask), _mm_set1_ps(bx)), rx);
+    __m128 qy = _mm_add_ps(_mm_set1_ps(fabsf(py) - by), rx);
+    __m128 mx = _mm_max_ps(qx, _mm_setzero_ps()), my = _mm_max_ps(qy, _mm_setzero_ps());
+    __m128 inside = _mm_min_ps(_mm_max_ps(qx, qy), _mm_setzero_ps());
+    __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(mx, mx), _mm_mul_ps(my, my)));
+    return _mm_sub_ps(_mm_add_ps(inside, len), rx);
+}
+
+// Pixels [i, i + n) of row j, n <= 4, structure of arrays across the lanes
+static void raster_shade4(const Raster *r, const RasterQuad *q, int kind, int i, int j, int n, u8 *dst) {
+    u32 buffer[4];
+    u32 *out = (u32 *)dst;
+    if (n < 4) {
+        memcpy(buffer, dst, n * 4);
+        out = buffer;
+    }
+    __m128i pixels = _mm_loadu_si128((const __m128i *)out);
+
+    __m128 px = _mm_add_ps(_mm_set1_ps(i + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    float py = j + 0.5f;
+    __m128 u = _mm_mul_ps(_mm_sub_ps(px, _mm_set1_ps(q->x)), _mm_set1_ps(q->inv_w));
+    float v = (py - q->y) * q->inv_h;
+    __m128 vv = _mm_set1_ps(v);
+
+    __m128 color[4];
+    if (q->gradient) {
+        __m128 lower = _mm_cmpge_ps(vv, u);
+        __m128 wa0 = _mm_set1_ps(1.0f - v), wa1 = _mm_sub_ps(vv, u), wa2 = u;
+        __m128 wb2 = vv, wb3 = _mm_sub_ps(u, vv), wb0 = _mm_sub_ps(_mm_set1_ps(1.0f), u);
+        for (int c = 0; c < 4; c++) {
+            const float *c0 = &q->colors[0].x, *c1 = &q->colors[1].x, *c2 = &q->colors[2].x, *c3 = &q->colors[3].x;
+            __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wa0, _mm_set1_ps(c0[c])), _mm_mul_ps(wa1, _mm_set1_ps(c1[c]))), _mm_mul_ps(wa2, _mm_set1_ps(c2[c])));
+            __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wb2, _mm_set1_ps(c2[c])), _mm_mul_ps(wb3, _mm_set1_ps(c3[c]))), _mm_mul_ps(wb0, _mm_set1_ps(c0[c])));
+            color[c] = _mm_or_ps(_mm_and_ps(lower, a), _mm_andnot_ps(lower, b));
+        }
+    } else {
+        for (int c = 0; c < 4; c++) color[c] = _mm_set1_ps((&q->colors[0].x)[c]);
+    }
+
+    __m128 src[4];
+    __m128i byte = _mm_set1_epi32(0xff);
+    __m128 inv255 = _mm_set1_ps(1.0f / 255.0f);
+    if (kind == RASTER_FLAT) {
+        for (int c = 0; c < 4; c++) src[c] = color[c];
+    } else if (kind == RASTER_TEXTURED) {
+        const RasterTexture *t = &r->texture;
+        __m128 tu = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(q->u0), _mm_mul_ps(_mm_set1_ps(q->du), u)), _mm_set1_ps((float)t->w));
+        tu = _mm_min_ps(_mm_max_ps(tu, _mm_setzero_ps()), _mm_set1_ps((float)(t->w - 1)));
+        int ty = (int)floorf((q->v0 + q->dv * v) * t->h);
+        ty = ty < 0 ? 0 : ty >= t->h ? t->h - 1 : ty;
+        // Clamped to >= 0 above, so truncation is floor
+        u32 tx[4];
+        _mm_storeu_si128((__m128i *)tx, _mm_cvttps_epi32(tu));
+        const u32 *row = (const u32 *)t->pixels + ty * t->w;
+        __m128i texels = _mm_setr_epi32((int)row[tx[0]], (int)row[tx[1]], (int)row[tx[2]], (int)row[tx[3]]);
+        for (int c = 0; c < 4; c++) {
+            __m128 channel = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, c * 8), byte)), inv255);
+            src[c] = _mm_mul_ps(color[c], channel);
+        }
+    } else {
+        __m128 sx = _mm_mul_ps(_mm_sub_ps(px, _mm_set1_ps(q->cx)), _mm_set1_ps(q->scale));
+        float sy = (py - q->cy) * q->scale;
+        __m128 d = raster_sdf4(sx, sy, q->hx, q->hy, q->radii);
+        __m128 d2 = raster_sdf4(sx, sy, q->hx2, q->hy2, q->radii2);
+        __m128 t = _mm_sub_ps(_mm_set1_ps(1.0f), raster_smoothstep4(0.005f, d2));
+        __m128 border[4] = {
+            _mm_set1_ps(q->border.r),
+            _mm_set1_ps(q->border.g),
+            _mm_set1_ps(q->border.b),
+            _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), raster_smoothstep4(0.003f, d)), _mm_set1_ps(q->border.a)),
+        };
+        for (int c = 0; c < 4; c++) {
+            src[c] = _mm_add_ps(border[c], _mm_mul_ps(_mm_sub_ps(color[c], border[c]), t));
+        }
+    }
+
+    __m128 sa = src[3];
+    __m128 keep = _mm_sub_ps(_mm_set1_ps(1.0f), sa);
+    __m128i result = _mm_setzero_si128();
+    for (int c = 0; c < 4; c++) {
+        __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, c * 8), byte)), inv255);
+        __m128 s = c < 3 ? _mm_mul_ps(src[c], sa) : _mm_mul_ps(sa, sa);
+        __m128 o = _mm_add_ps(s, _mm_mul_ps(d, keep));
+        o = _mm_min_ps(_mm_max_ps(o, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        __m128i q8 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(o, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+        result = _mm_or_si128(result, _mm_slli_epi32(q8, c * 8));
+    }
+    _mm_storeu_si128((__m128i *)out, result);
+    if (n < 4) memcpy(dst, buffer, n * 4);
+}
+
+#endif // RASTER_SSE2
+
+// Pixels [x0, x1) of row j, treating the quad as `kind`
+static void raster_span(const Raster *r, const RasterQuad *q, int kind, int x0, int x1, int j, u8 *row) {
+#ifdef RASTER_SSE2
+    for (int i = x0; i < x1; i += 4) raster_shade4(r, q, kind, i, j, x1 - i < 4 ? x1 - i : 4, row + i * 4);
+#else
+    RasterQuad flat = *q;
+    flat.kind = kind;
+    for (int i = x0; i < x1; i++) raster_shade_reference(r, &flat, i, j, row + i * 4);
+#endif
+}
+
+static void raster_shade_tile(Raster *r, int tile) {
+    int tx = tile % r->tiles_x, ty = tile / r->tiles_x;
+    int x0 = tx * RASTER_TILE, y0 = ty * RASTER_TILE;
+    int x1 = x0 + RASTER_TILE < r->width ? x0 + RASTER_TILE : r->width;
+    int y1 = y0 + RASTER_TILE < r->height ? y0 + RASTER_TILE : r->height;
+
+    u8 bytes[4] = {
+        raster_unorm(r->clear_color.r), raster_unorm(r->clear_color.g),
+        raster_unorm(r->clear_color.b), raster_unorm(r->clear_color.a),
+    };
+    u32 clear;
+    memcpy(&clear, bytes, 4);
+    for (int j = y0; j < y1; j++) {
+        u32 *row = (u32 *)r->pixels + (size_t)j * r->width;
+        for (int i = x0; i < x1; i++) row[i] = clear;
+    }
+
+    for (int b = r->bin_start[tile]; b < r->bin_start[tile + 1]; b++) {
+        const RasterQuad *q = &r->quads[r->bins[b]];
+        int qx0 = q->x0 > x0 ? q->x0 : x0, qx1 = q->x1 < x1 ? q->x1 : x1;
+        int qy0 = q->y0 > y0 ? q->y0 : y0, qy1 = q->y1 < y1 ? q->y1 : y1;
+        for (int j = qy0; j < qy1; j++) {
+            u8 *row = r->pixels + (size_t)j * r->width * 4;
+            if (r->reference) {
+                for (int i = qx0; i < qx1; i++) raster_shade_reference(r, q, i, j, row + i * 4);
+                continue;
+            }
+            // Split the row around the interior, where the SDF is skipped
+            int a = qx1, b = qx1;
+            if (j >= q->iy0 && j < q->iy1) {
+                a = q->ix0 < qx0 ? qx0 : q->ix0 > qx1 ? qx1 : q->ix0;
+                b = q->ix1 < a ? a : q->ix1 > qx1 ? qx1 : q->ix1;
+            }
+            raster_span(r, q, q->kind, qx0, a, j, row);
+            if (q->opaque) {
+                for (int i = a; i < b; i++) ((u32 *)row)[i] = q->fill;
+            } else {
+                raster_span(r, q, RASTER_FLAT, a, b, j, row);
+            }
+            raster_span(r, q, q->kind, b, qx1, j, row);
+        }
+    }
+}
+
+static void raster_run_tiles(Raster *r) {
+    for (;;) {
+        RASTER_LOCK(r);
+        int tile = r->next_tile++;
+        RASTER_UNLOCK(r);
+        if (tile >= r->tiles_x * r->tiles_y) break;
+        raster_shade_tile(r, tile);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI raster_worker(void *data) {
+#else
+static void *raster_worker(void *data) {
+#endif
+    Raster *r = data;
+    u32 seen = 0;
+    for (;;) {
+        RASTER_LOCK(r);
+        while (r->generation == seen && !r->quit) RASTER_WAIT(r, work);
+        seen = r->generation;
+        bool quit = r->quit;
+        RASTER_UNLOCK(r);
+        if (quit) break;
+
+        raster_run_tiles(r);
+
+        RASTER_LOCK(r);
+        if (--r->active == 0) RASTER_WAKE_ALL(r, done);
+        RASTER_UNLOCK(r);
+    }
+    return 0;
+}
+
+void raster_init(Raster *r, int width, int height, int thread_count) {
+    memset(r, 0, sizeof(*r));
+    r->clear_color = (Vec4){{0.0f, 0.0f, 0.0f, 1.0f}};
+    raster_resize(r, width, height);
+#ifdef _WIN32
+    InitializeCriticalSection(&r->lock);
+    InitializeConditionVariable(&r->work);
+    InitializeConditionVariable(&r->done);
+#else
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->work, NULL);
+    pthread_cond_init(&r->done, NULL);
+#endif
+    if (thread_count > RASTER_MAX_THREADS) thread_count = RASTER_MAX_THREADS;
+    for (int i = 0; i + 1 < thread_count; i++) {
+#ifdef _WIN32
+        r->threads[r->thread_count++] = CreateThread(NULL, 0, raster_worker, r, 0, NULL);
+#else
+        pthread_create(&r->threads[r->thread_count++], NULL, raster_worker, r);
+#endif
+    }
+}
+
+void raster_resize(Raster *r, int width, int height) {
+    r->width = width;
+    r->height = height;
+    r->pixels = realloc(r->pixels, (size_t)width * height * 4);
+    r->tiles_x = (width + RASTER_TILE - 1) / RASTER_TILE;
+    r->tiles_y = (height + RASTER_TILE - 1) / RASTER_TILE;
+    r->bin_start = realloc(r->bin_start, (r->tiles_x * r->tiles_y + 1) * sizeof(int));
+}
+
+void raster_free(Raster *r) {
+    RASTER_LOCK(r);
+    r->quit = true;
+    RASTER_WAKE_ALL(r, work);
+    RASTER_UNLOCK(r);
+    for (int i = 0; i < r->thread_count; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(r->threads[i], INFINITE);
+        CloseHandle(r->threads[i]);
+#else
+        pthread_join(r->threads[i], NULL);
+#endif
+    }
+#ifdef _WIN32
+    DeleteCriticalSection(&r->lock);
+#else
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->work);
+    pthread_cond_destroy(&r->done);
+#endif
+    free(r->pixels);
+    free(r->quads);
+    free(r->bin_start);
+    free(r->bins);
+    memset(r, 0, sizeof(*r));
+}
+
+static bool raster_setup(const Raster *r, const VertInput *in, RasterQuad *q) {
+    const Rect *d = &in->dst_rect;
+    // Pixel centers inside the rect, left and top edges inclusive
+    q->x0 = (int)ceilf(d->x - 0.5f);
+    q->y0 = (int)ceilf(d->y - 0.5f);
+    q->x1 = (int)ceilf(d->x + d->w - 0.5f);
+    q->y1 = (int)ceilf(d->y + d->h - 0.5f);
+    if (q->x0 < 0) q->x0 = 0;
+    if (q->y0 < 0) q->y0 = 0;
+    if (q->x1 > r->width) q->x1 = r->width;
+    if (q->y1 > r->height) q->y1 = r->height;
+    if (q->x0 >= q->x1 || q->y0 >= q->y1) return false;
+
+    q->x = d->x;
+    q->y = d->y;
+    q->inv_w = 1.0f / d->w;
+    q->inv_h = 1.0f / d->h;
+    q->u0 = in->src_rect.x;
+    q->v0 = in->src_rect.y;
+    q->du = in->src_rect.w;
+    q->dv = in->src_rect.h;
+    memcpy(q->colors, in->colors, sizeof(q->colors));
+    q->gradient = memcmp(&in->colors[0], &in->colors[1], sizeof(Vec4) * 3) != 0 ||
+                  memcmp(&in->colors[0], &in->colors[3], sizeof(Vec4)) != 0;
+    q->kind = in->use_texture > 0.0f ? RASTER_TEXTURED : in->border_thickness > 0.0f ? RASTER_SDF : RASTER_FLAT;
+
+    // 2d.frag.hlsl works in units of half the screen height
+    q->scale = 2.0f / r->height;
+    q->cx = d->x + d->w / 2;
+    q->cy = d->y + d->h / 2;
+    q->hx = d->w / r->height;
+    q->hy = d->h / r->height;
+    float bt = in->border_thickness;
+    q->hx2 = (d->w - (bt * 2 + 2)) / r->height;
+    q->hy2 = (d->h - (bt * 2 + 2)) / r->height;
+    const float *radii = &in->corner_radii.x;
+    for (int i = 0; i < 4; i++) {
+        q->radii[i] = radii[i] * q->scale;
+        q->radii2[i] = (radii[i] - (bt + 2)) * q->scale;
+    }
+    q->border = in->border_color;
+
+    // Where d2 <= 0 the shader returns the vertex color: everywhere for a
+    // flat quad, and inside the inner box shrunk by its largest radius for
+    // a bordered one
+    q->ix0 = q->iy0 = q->ix1 = q->iy1 = 0;
+    if (q->kind == RASTER_FLAT) {
+        q->ix0 = q->x0;
+        q->iy0 = q->y0;
+        q->ix1 = q->x1;
+        q->iy1 = q->y1;
+    } else if (q->kind == RASTER_SDF) {
+        float largest = 0.0f;
+        for (int i = 0; i < 4; i++) largest = fabsf(q->radii2[i]) > largest ? fabsf(q->radii2[i]) : largest;
+        float ex = (q->hx2 - largest) / q->scale, ey = (q->hy2 - largest) / q->scale;
+        if (ex > 0.0f && ey > 0.0f) {
+            q->ix0 = (int)ceilf(q->cx - ex - 0.5f);
+            q->iy0 = (int)ceilf(q->cy - ey - 0.5f);
+            q->ix1 = (int)floorf(q->cx + ex - 0.5f) + 1;
+            q->iy1 = (int)floorf(q->cy + ey - 0.5f) + 1;
+        }
+    }
+    const Vec4 *c = &in->colors[0];
+    q->opaque = !q->gradient && c->a == 1.0f;
+    u8 fill[4] = {raster_unorm(c->r), raster_unorm(c->g), raster_unorm(c->b), 255};
+    memcpy(&q->fill, fill, 4);
+    return true;
+}
+
+void raster_draw(Raster *r, const VertInput *verts, int count, const RasterTexture *texture) {
+    if (texture) r->texture = *texture;
+    if (count > r->quad_capacity) {
+        r->quad_capacity = count * 2;
+        r->quads = realloc(r->quads, r->quad_capacity * sizeof(RasterQuad));
+    }
+    r->quad_count = 0;
+    for (int i = 0; i < count; i++) {
+        RasterQuad *q = &r->quads[r->quad_count];
+        if (verts[i].use_texture > 0.0f && !r->texture.pixels) continue;
+        if (raster_setup(r, &verts[i], q)) r->quad_count++;
+    }
+
+    // Bin in two passes: count per tile, then fill in draw order
+    int tile_count = r->tiles_x * r->tiles_y;
+    memset(r->bin_start, 0, (tile_count + 1) * sizeof(int));
+    for (int i = 0; i < r->quad_count; i++) {
+        const RasterQuad *q = &r->quads[i];
+        for (int ty = q->y0 / RASTER_TILE; ty <= (q->y1 - 1) / RASTER_TILE; ty++) {
+            for (int tx = q->x0 / RASTER_TILE; tx <= (q->x1 - 1) / RASTER_TILE; tx++) {
+                r->bin_start[ty * r->tiles_x + tx + 1]++;
+            }
+        }
+    }
+    for (int t = 0; t < tile_count; t++) r->bin_start[t + 1] += r->bin_start[t];
+    if (r->bin_start[tile_count] > r->bin_capacity) {
+        r->bin_capacity = r->bin_start[tile_count] * 2;
+        r->bins = realloc(r->bins, r->bin_capacity * sizeof(int));
+    }
+    int *fill = malloc(tile_count * sizeof(int));
+    memcpy(fill, r->bin_start, tile_count * sizeof(int));
+    for (int i = 0; i < r->quad_count; i++) {
+        const RasterQuad *q = &r->quads[i];
+        for (int ty = q->y0 / RASTER_TILE; ty <= (q->y1 - 1) / RASTER_TILE; ty++) {
+            for (int tx = q->x0 / RASTER_TILE; tx <= (q->x1 - 1) / RASTER_TILE; tx++) {
+                r->bins[fill[ty * r->tiles_x + tx]++] = i;
+            }
+        }
+    }
+    free(fill);
+
+    RASTER_LOCK(r);
+    r->generation++;
+    r->next_tile = 0;
+    r->active = r->thread_count;
+    RASTER_WAKE_ALL(r, work);
+    RASTER_UNLOCK(r);
+
+    raster_run_tiles(r);
+
+    RASTER_LOCK(r);
+    while (r->active > 0) RASTER_WAIT(r, done);
+    RASTER_UNLOCK(r);
+}
+
+#undef RASTER_LOCK
+#undef RASTER_UNLOCK
+#undef RASTER_WAIT
+#undef RASTER_WAKE_ALL
+
+#endif // RASTER_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RASTER_H
@@ -11,6 +11,17 @@
 #define PJP_IMPLEMENTATION
 #include "pjp.h"
 
+#include "types.h"
+
+#define DRAW_IMPLEMENTATION
+#include "draw.h"
+
+#define TEXT_IMPLEMENTATION
+#include "text.h"
+
+#define DRAW_SDL_IMPLEMENTATION
+#include "draw_sdl.h"
+
 #define ASSERT_CALL(call) \
     do { \
         if (!(call)) { \
@@ -26,10 +37,20 @@
 #define ATLAS_WIDTH 512
 #define ATLAS_HEIGHT 512
 
+#define LINE_HEIGHT 20
+#define MARGIN 20
+
+// Rendered text is cached in full-width strips of the document so scrolling
+// only has to blit, and only newly exposed strips get rasterized.
+#define TILE_HEIGHT 256
+#define TILE_CACHE_BYTES (32 * 1024 * 1024)
+
 typedef struct {
     SDL_Texture* texture;
     stbtt_packedchar char_data[96];
-    float scale;
+    FontMetrics metrics;
+    VertStore store;
+    DrawSDL draw;
 } Font;
 
 Font load_font(SDL_Renderer* renderer, const char* font_path) {
@@ -38,67 +59,132 @@ Font load_font(SDL_Renderer* renderer, const char* font_path) {
     unsigned char *font_buffer = read_file(font_path, &font_size);
     printf("font file size: %zd\n", font_size);
 
-    unsigned char *atlas_data = malloc(ATLAS_WIDTH * ATLAS_HEIGHT);
+    u8 *pixels = text_atlas_build(&font.metrics, font.char_data, font_buffer, FONT_SIZE, ATLAS_WIDTH, ATLAS_HEIGHT, ATLAS_HEIGHT);
+    font.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, ATLAS_WIDTH, ATLAS_HEIGHT);
+    SDL_SetTextureBlendMode(font.texture, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureScaleMode(font.texture, SDL_SCALEMODE_NEAREST);
+    SDL_UpdateTexture(font.texture, NULL, pixels, ATLAS_WIDTH * 4);
+    font.store = make_vert_store();
 
-    stbtt_pack_context pack_context = {0};
+    free(pixels);
+    free(font_buffer);
 
-    stbtt_pack_range pack_range = {0};
-    pack_range.font_size = FONT_SIZE;
-    pack_range.first_unicode_codepoint_in_range = 32;
-    pack_range.num_chars = 96;
-    pack_range.chardata_for_range = font.char_data;
+    return font;
+}
 
-    stbtt_PackBegin(&pack_context, atlas_data, ATLAS_WIDTH, ATLAS_HEIGHT, 0, 1, NULL);
-    stbtt_PackFontRanges(&pack_context, font_buffer, 0, &pack_range, 1);
+void free_font(Font *font) {
+    SDL_DestroyTexture(font->texture);
+    font_metrics_free(&font->metrics);
+    free_vert_store(&font->store);
+    draw_sdl_free(&font->draw);
+}
 
-    stbtt_PackEnd(&pack_context);
+// Queues text with its baseline at y; flush_text draws everything queued
+void draw_text(Font *font, const char *text, float x, float y) {
+    text_layout_batch(&font->store, &font->metrics, text, (int)strlen(text), x, y, true, NULL, NULL);
+}
 
-	Uint32* pixels = malloc(ATLAS_WIDTH * ATLAS_HEIGHT * sizeof(Uint32));
-	const SDL_PixelFormatDetails *format = SDL_GetPixelFormatDetails(SDL_PIXELFORMAT_RGBA32);
-	for(int i = 0; i < ATLAS_WIDTH * ATLAS_HEIGHT; i++) {
-		pixels[i] = SDL_MapRGBA(format, NULL, 0xff, 0xff, 0xff, atlas_data[i]);
-	}
+void flush_text(SDL_Renderer *renderer, Font *font) {
+    draw_sdl_render(&font->draw, renderer, font->store.data, font->store.size, font->texture);
+    vert_clear(&font->store);
+}
 
-    font.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, ATLAS_WIDTH, ATLAS_HEIGHT);
-    SDL_SetTextureBlendMode(font.texture, SDL_BLENDMODE_BLEND);
-    SDL_UpdateTexture(font.texture, NULL, pixels, ATLAS_WIDTH * sizeof(Uint32));
+typedef struct Tile {
+    SDL_Texture *texture;
+    int index; // strip of the document this holds, -1 when free
+    Uint64 last_used;
+} Tile;
+
+typedef struct TileCache {
+    Tile *tiles;
+    int count;
+    int width;
+    int height;
+    Uint64 frame;
+} TileCache;
+
+void tile_cache_free(TileCache *cache) {
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->tiles[i].texture) SDL_DestroyTexture(cache->tiles[i].texture);
+    }
+    free(cache->tiles);
+    *cache = (TileCache){0};
+}
 
-	free(pixels);
+// (Re)creates the cache for a given output size, as many tiles as fit in the
+// budget but always more than a frame shows, so a frame never evicts its own
+void tile_cache_resize(TileCache *cache, int width, int height) {
+    tile_cache_free(cache);
+    cache->width = width;
+    cache->height = height;
+    // A partly scrolled strip at both edges on top of the whole ones
+    int visible = height / TILE_HEIGHT + 2;
+    cache->count = TILE_CACHE_BYTES / (width * TILE_HEIGHT * 4);
+    if (cache->count < visible + 1) cache->count = visible + 1;
+    cache->tiles = calloc(cache->count, sizeof(Tile));
+    for (int i = 0; i < cache->count; i++) {
+        cache->tiles[i].index = -1;
+    }
+}
 
-    free(atlas_data);
-    free(font_buffer);
+// Call whenever the document or font changes
+void tile_cache_invalidate(TileCache *cache) {
+    for (int i = 0; i < cache->count; i++) {
+        cache->tiles[i].index = -1;
+    }
+}
 
-    return font;
+void render_tile(SDL_Renderer *renderer, Font *font, char **lines, size_t line_count, Tile *tile) {
+    float top = (float)tile->index * TILE_HEIGHT;
+
+    SDL_SetRenderTarget(renderer, tile->texture);
+    SDL_SetRenderDrawColor(renderer, 0, 100, 100, 255);
+    SDL_RenderClear(renderer);
+
+    // Glyphs reach FONT_SIZE above the baseline and a bit below it, so
+    // include the lines that straddle the strip edges
+    int first = (int)SDL_floorf((top - MARGIN - FONT_SIZE / 2) / LINE_HEIGHT);
+    int last = (int)SDL_ceilf((top + TILE_HEIGHT - MARGIN + FONT_SIZE) / LINE_HEIGHT);
+    if (first < 0) first = 0;
+    if (last > (int)line_count - 1) last = (int)line_count - 1;
+
+    for (int i = first; i <= last; i++) {
+        draw_text(font, lines[i], MARGIN, MARGIN + i * LINE_HEIGHT - top);
+    }
+    flush_text(renderer, font);
+
+    SDL_SetRenderTarget(renderer, NULL);
 }
 
-void draw_text(SDL_Renderer* renderer, Font* font, const char *text, float x, float y) {
-    Uint8 r, g, b, a;
-	SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
-	SDL_SetTextureColorMod(font->texture, r, g, b);
-	SDL_SetTextureAlphaMod(font->texture, a);
-
-    while (*text) {
-        if (*text >= 32 && *text < 128) {
-            stbtt_aligned_quad quad;
-            stbtt_GetPackedQuad(font->char_data, ATLAS_WIDTH, ATLAS_HEIGHT, *text - 32, &x, &y, &quad, 1);
-            
-            SDL_FRect src_rect = {
-                quad.s0 * ATLAS_WIDTH,
-                quad.t0 * ATLAS_HEIGHT,
-                (quad.s1 - quad.s0) * ATLAS_WIDTH,
-                (quad.t1 - quad.t0) * ATLAS_HEIGHT
-            };
-            
-            SDL_FRect dst_rect = {
-                quad.x0,
-                quad.y0,
-                quad.x1 - quad.x0,
-                quad.y1 - quad.y0
-            };
-            SDL_RenderTexture(renderer, font->texture, &src_rect, &dst_rect);
+// Returns the texture for strip `index`, rasterizing it into the least
+// recently used slot if it isn't cached. Strips already drawn this frame are
+// never evicted. NULL if the strip has no text or every slot is in use.
+SDL_Texture *tile_cache_get(SDL_Renderer *renderer, TileCache *cache, Font *font, char **lines, size_t line_count, int index) {
+    float doc_height = MARGIN + line_count * LINE_HEIGHT + FONT_SIZE;
+    if (index < 0 || (float)index * TILE_HEIGHT > doc_height) return NULL;
+
+    Tile *slot = NULL;
+    for (int i = 0; i < cache->count; i++) {
+        Tile *tile = &cache->tiles[i];
+        if (tile->index == index) {
+            tile->last_used = cache->frame;
+            return tile->texture;
         }
-        ++text;
+        if (tile->index != -1 && tile->last_used == cache->frame) continue;
+        if (!slot || (slot->index != -1 && (tile->index == -1 || tile->last_used < slot->last_used))) {
+            slot = tile;
+        }
+    }
+    if (!slot) return NULL;
+
+    if (!slot->texture) {
+        slot->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, cache->width, TILE_HEIGHT);
+        SDL_SetTextureBlendMode(slot->texture, SDL_BLENDMODE_NONE);
     }
+    slot->index = index;
+    slot->last_used = cache->frame;
+    render_tile(renderer, font, lines, line_count, slot);
+    return slot->texture;
 }
 
 int main(int argc, char *argv[]) {
@@ -123,6 +209,8 @@ int main(int argc, char *argv[]) {
 
     Font font = load_font(renderer, "../res/fonts/vera/Vera.ttf");
 
+    TileCache tiles = {0};
+
     bool quit = false;
     SDL_Event event;
     while (!quit) {
@@ -135,6 +223,10 @@ int main(int argc, char *argv[]) {
                 case SDL_EVENT_KEY_DOWN:
                     if (event.key.key == SDLK_Q) {
                         quit = true;
+                    } else if (event.key.key == SDLK_R) {
+                        free(buf);
+                        buf = read_file_lines("render.c", &file_size, &line_count);
+                        tile_cache_invalidate(&tiles);
                     }
                     break;
                 case SDL_EVENT_MOUSE_BUTTON_DOWN:
@@ -161,9 +253,23 @@ int main(int argc, char *argv[]) {
         SDL_SetRenderDrawColor(renderer, 0, 100, 100, 255);
         SDL_RenderClear(renderer);
 
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        for (int i = 0; i < line_count; i++) {
-            draw_text(renderer, &font, buf[i], 20, 20 + i * 20 + scroll_offset);
+        int out_w, out_h;
+        SDL_GetCurrentRenderOutputSize(renderer, &out_w, &out_h);
+        if (out_w != tiles.width || out_h != tiles.height) {
+            tile_cache_resize(&tiles, out_w, out_h);
+        }
+        tiles.frame++;
+
+        // Glyphs are snapped to whole pixels anyway, so snap the strips too
+        float offset = SDL_floorf(scroll_offset);
+        int first_tile = (int)SDL_floorf(-offset / TILE_HEIGHT);
+        int last_tile = (int)SDL_floorf((out_h - offset) / TILE_HEIGHT);
+        for (int t = first_tile; t <= last_tile; t++) {
+            SDL_Texture *texture = tile_cache_get(renderer, &tiles, &font, buf, line_count, t);
+            if (texture) {
+                SDL_FRect dst_rect = {0.0f, t * TILE_HEIGHT + offset, (float)out_w, TILE_HEIGHT};
+                SDL_RenderTexture(renderer, texture, NULL, &dst_rect);
+            }
         }
 
 
@@ -190,6 +296,8 @@ int main(int argc, char *argv[]) {
         SDL_RenderPresent(renderer);
     }
 
+    tile_cache_free(&tiles);
+    free_font(&font);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -0,0 +1,127 @@
+// Substring search over raw document bytes.
+//
+// Candidates are found 16 or 32 positions at a time by comparing the first
+// and last byte of the needle against two shifted loads of the haystack;
+// only positions where both match are checked with memcmp. On source code
+// that rejects almost everything without touching the needle again.
+//
+// In exactly one C or C++ file in your project:
+// #define SEARCH_IMPLEMENTATION
+// #include "search.h"
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SEARCH_SSE2
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SEARCH_AVX2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+#define SEARCH_NOT_FOUND ((size_t)-1)
+
+// Offset of the first occurrence of `needle` in hay[0, len), or
+// SEARCH_NOT_FOUND. Only matches lying entirely inside the range count.
+size_t search_find(const char *hay, size_t len, const char *needle, size_t needle_len);
+
+// Appends the offset of every occurrence (overlapping ones included) of
+// `needle` starting in hay[begin, end) to *out, growing it as needed.
+// Matches may run up to `len`. Returns the number found.
+int search_range(const char *hay, size_t len, size_t begin, size_t end, const char *needle, size_t needle_len, size_t **out, int *count, int *capacity);
+
+#ifdef SEARCH_IMPLEMENTATION
+
+static inline int search_ctz(u32 x) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+size_t search_find(const char *hay, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len == 0 || needle_len > len) return SEARCH_NOT_FOUND;
+    if (needle_len == 1) {
+        const char *p = memchr(hay, needle[0], len);
+        return p ? (size_t)(p - hay) : SEARCH_NOT_FOUND;
+    }
+
+    size_t last = needle_len - 1;
+    size_t i = 0;
+#if defined(SEARCH_AVX2)
+    __m256i first_byte = _mm256_set1_epi8(needle[0]);
+    __m256i last_byte = _mm256_set1_epi8(needle[last]);
+    for (; i + last + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(hay + i + last));
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first_byte), _mm256_cmpeq_epi8(b, last_byte)));
+        while (mask) {
+            size_t at = i + search_ctz(mask);
+            if (memcmp(hay + at + 1, needle + 1, last - 1) == 0) return at;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(SEARCH_SSE2)
+    __m128i first_byte = _mm_set1_epi8(needle[0]);
+    __m128i last_byte = _mm_set1_epi8(needle[last]);
+    for (; i + last + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(hay + i + last));
+        u32 mask = (u32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first_byte), _mm_cmpeq_epi8(b, last_byte)));
+        while (mask) {
+            size_t at = i + search_ctz(mask);
+            if (memcmp(hay + at + 1, needle + 1, last - 1) == 0) return at;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i + last < len; i++) {
+        if (hay[i] == needle[0] && hay[i + last] == needle[last] && memcmp(hay + i + 1, needle + 1, last - 1) == 0) {
+            return i;
+        }
+    }
+    return SEARCH_NOT_FOUND;
+}
+
+int search_range(const char *hay, size_t len, size_t begin, size_t end, const char *needle, size_t needle_len, size_t **out, int *count, int *capacity) {
+    int found = 0;
+    // Stop the window where a match could no longer start before `end`
+    size_t limit = end + needle_len - 1 < len ? end + needle_len - 1 : len;
+    for (size_t at = begin; at < end;) {
+        size_t i = search_find(hay + at, limit - at, needle, needle_len);
+        if (i == SEARCH_NOT_FOUND) break;
+        if (*count == *capacity) {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            *out = realloc(*out, *capacity * sizeof(size_t));
+        }
+        (*out)[(*count)++] = at + i;
+        found++;
+        at += i + 1;
+    }
+    return found;
+}
+
+#endif // SEARCH_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SEARCH_H
@@ -0,0 +1,273 @@
+// Incremental C syntax highlighting.
+//
+// The only state carried from one line to the next is a single byte
+// (inside a block comment, a continued string, ...), so we keep that byte
+// for the end of every line. Any visible line can then be colored on its
+// own. An edit re-lexes forward from the changed line only until the end
+// states match what they were before.
+//
+// In exactly one C or C++ file in your project:
+// #define SYNTAX_IMPLEMENTATION
+// #include "syntax.h"
+
+#ifndef SYNTAX_H
+#define SYNTAX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+enum {
+    TOKEN_TEXT,
+    TOKEN_KEYWORD,
+    TOKEN_TYPE,
+    TOKEN_NUMBER,
+    TOKEN_STRING,
+    TOKEN_COMMENT,
+    TOKEN_PREPROC,
+    TOKEN_COUNT,
+};
+
+// Lexer state at a line boundary
+enum {
+    SYNTAX_NORMAL,
+    SYNTAX_BLOCK_COMMENT,
+    SYNTAX_STRING,  // string continued with a backslash
+    SYNTAX_PREPROC, // directive continued with a backslash
+    SYNTAX_UNKNOWN = 0xff,
+};
+
+typedef struct SyntaxCache {
+    u8 *end_state;
+    int count;
+    int capacity;
+    int valid;       // end_state[0, valid) is known
+    int relex_from;  // first line of a pending edit, -1 if none
+    int relex_until; // lines before this are re-lexed even if their state matches
+} SyntaxCache;
+
+void syntax_init(SyntaxCache *cache, int line_count);
+void syntax_free(SyntaxCache *cache);
+
+// Lexes one line starting in `state` and returns the state at its end. If
+// `kinds` is not NULL it receives a TOKEN_* for every byte of the line.
+u8 syntax_scan_line(const char *line, u8 state, u8 *kinds);
+
+// Lines [line, line + removed) were replaced by `inserted` new lines.
+void syntax_lines_changed(SyntaxCache *cache, int line, int removed, int inserted);
+
+// Returns the NUL-terminated text of a line. The pointer only has to stay
+// valid until the next call.
+typedef const char *(*SyntaxGetLine)(void *user, int line);
+
+// Brings end states up to date through line `upto`, lexing at most `budget`
+// lines so a huge file never stalls a frame. Returns the lines lexed.
+int syntax_update(SyntaxCache *cache, SyntaxGetLine get_line, void *user, int upto, int budget);
+
+// State at the start of `line`. Lines past the known range start as normal.
+static inline u8 syntax_line_state(const SyntaxCache *cache, int line) {
+    if (line == 0 || line > cache->valid) return SYNTAX_NORMAL;
+    return cache->end_state[line - 1];
+}
+
+#ifdef SYNTAX_IMPLEMENTATION
+
+static const char *syntax_keywords[] = {
+    "break", "case", "continue", "default", "do", "else", "for", "goto", "if",
+    "return", "sizeof", "switch", "while", "typedef", "static", "const",
+    "extern", "inline", "volatile", "register", "restrict", "true", "false",
+    "NULL", NULL,
+};
+
+static const char *syntax_types[] = {
+    "void", "char", "short", "int", "long", "float", "double", "signed",
+    "unsigned", "bool", "struct", "union", "enum", "size_t", "i8", "i16",
+    "i32", "i64", "u8", "u16", "u32", "u64", "f32", "f64", NULL,
+};
+
+static bool syntax_in_list(const char **list, const char *s, int len) {
+    for (; *list; list++) {
+        if ((int)strlen(*list) == len && memcmp(*list, s, len) == 0) return true;
+    }
+    return false;
+}
+
+static inline bool syntax_is_ident(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+#define SYNTAX_MARK(from, to, kind) do { if (kinds) memset(kinds + (from), (kind), (to) - (from)); } while (0)
+
+// Skips to just past the closing `quote`, or to the end of the line
+static int syntax_skip_quoted(const char *s, int i, char quote) {
+    while (s[i] && s[i] != quote) {
+        if (s[i] == '\\' && s[i + 1]) i++;
+        i++;
+    }
+    return s[i] ? i + 1 : i;
+}
+
+u8 syntax_scan_line(const char *s, u8 state, u8 *kinds) {
+    int i = 0, len;
+    u8 base = state == SYNTAX_PREPROC ? TOKEN_PREPROC : TOKEN_TEXT;
+
+    if (state == SYNTAX_BLOCK_COMMENT) {
+        const char *end = strstr(s, "*/");
+        if (!end) {
+            len = (int)strlen(s);
+            SYNTAX_MARK(0, len, TOKEN_COMMENT);
+            return SYNTAX_BLOCK_COMMENT;
+        }
+        i = (int)(end - s) + 2;
+        SYNTAX_MARK(0, i, TOKEN_COMMENT);
+    } else if (state == SYNTAX_STRING) {
+        i = syntax_skip_quoted(s, 0, '"');
+        SYNTAX_MARK(0, i, TOKEN_STRING);
+        if (!s[i] && i > 0 && s[i - 1] == '\\') return SYNTAX_STRING;
+    }
+
+    bool line_start = true;
+    while (s[i]) {
+        char c = s[i];
+        int start = i;
+        if (c == ' ' || c == '\t') {
+            SYNTAX_MARK(i, i + 1, base);
+            i++;
+            continue;
+        }
+
+        if (c == '/' && s[i + 1] == '/') {
+            len = i + (int)strlen(s + i);
+            SYNTAX_MARK(i, len, TOKEN_COMMENT);
+            return SYNTAX_NORMAL;
+        } else if (c == '/' && s[i + 1] == '*') {
+            const char *end = strstr(s + i + 2, "*/");
+            if (!end) {
+                len = i + (int)strlen(s + i);
+                SYNTAX_MARK(i, len, TOKEN_COMMENT);
+                return SYNTAX_BLOCK_COMMENT;
+            }
+            i = (int)(end - s) + 2;
+            SYNTAX_MARK(start, i, TOKEN_COMMENT);
+        } else if (c == '"' || c == '\'') {
+            i = syntax_skip_quoted(s, i + 1, c);
+            SYNTAX_MARK(start, i, TOKEN_STRING);
+            if (!s[i] && c == '"' && s[i - 1] == '\\') return SYNTAX_STRING;
+        } else if (c == '#' && line_start) {
+            base = TOKEN_PREPROC;
+            i++;
+            SYNTAX_MARK(start, i, TOKEN_PREPROC);
+        } else if ((c >= '0' && c <= '9') || (c == '.' && s[i + 1] >= '0' && s[i + 1] <= '9')) {
+            while (syntax_is_ident(s[i]) || s[i] == '.') i++;
+            SYNTAX_MARK(start, i, TOKEN_NUMBER);
+        } else if (syntax_is_ident(c)) {
+            while (syntax_is_ident(s[i])) i++;
+            if (kinds) {
+                u8 kind = base;
+                if (base != TOKEN_PREPROC) {
+                    if (syntax_in_list(syntax_keywords, s + start, i - start)) kind = TOKEN_KEYWORD;
+                    else if (syntax_in_list(syntax_types, s + start, i - start)) kind = TOKEN_TYPE;
+                }
+                SYNTAX_MARK(start, i, kind);
+            }
+        } else {
+            i++;
+            SYNTAX_MARK(start, i, base);
+        }
+        line_start = false;
+    }
+
+    if (base == TOKEN_PREPROC && i > 0 && s[i - 1] == '\\') return SYNTAX_PREPROC;
+    return SYNTAX_NORMAL;
+}
+
+#undef SYNTAX_MARK
+
+void syntax_init(SyntaxCache *cache, int line_count) {
+    cache->count = line_count;
+    cache->capacity = line_count > 0 ? line_count : 1;
+    cache->end_state = malloc(cache->capacity);
+    memset(cache->end_state, SYNTAX_UNKNOWN, cache->capacity);
+    cache->valid = 0;
+    cache->relex_from = -1;
+    cache->relex_until = 0;
+}
+
+void syntax_free(SyntaxCache *cache) {
+    free(cache->end_state);
+    *cache = (SyntaxCache){0};
+}
+
+void syntax_lines_changed(SyntaxCache *cache, int line, int removed, int inserted) {
+    int count = cache->count - removed + inserted;
+    int delta = inserted - removed;
+    if (count > cache->capacity) {
+        while (count > cache->capacity) cache->capacity *= 2;
+        cache->end_state = realloc(cache->end_state, cache->capacity);
+    }
+    memmove(cache->end_state + line + inserted, cache->end_state + line + removed, cache->count - line - removed);
+    memset(cache->end_state + line, SYNTAX_UNKNOWN, inserted);
+    cache->count = count;
+
+    if (cache->valid > line + removed) {
+        cache->valid += delta;
+    } else if (cache->valid > line) {
+        cache->valid = line;
+    }
+    if (line >= cache->valid) return;
+
+    if (cache->relex_from < 0) {
+        cache->relex_from = line;
+        cache->relex_until = line + inserted;
+    } else {
+        if (cache->relex_until > line + removed) cache->relex_until += delta;
+        if (cache->relex_from > line + removed) cache->relex_from += delta;
+        if (line < cache->relex_from) cache->relex_from = line;
+        if (line + inserted > cache->relex_until) cache->relex_until = line + inserted;
+    }
+}
+
+int syntax_update(SyntaxCache *cache, SyntaxGetLine get_line, void *user, int upto, int budget) {
+    int scanned = 0;
+    if (upto > cache->count) upto = cache->count;
+
+    if (cache->relex_from >= 0) {
+        int i = cache->relex_from;
+        u8 state = syntax_line_state(cache, i);
+        bool converged = false;
+        for (; i < cache->valid && scanned < budget; i++, scanned++) {
+            u8 old = cache->end_state[i];
+            state = cache->end_state[i] = syntax_scan_line(get_line(user, i), state, NULL);
+            if (i + 1 >= cache->relex_until && state == old) {
+                converged = true;
+                break;
+            }
+        }
+        if (converged || i >= cache->valid) {
+            cache->relex_from = -1;
+        } else {
+            cache->relex_from = i;
+        }
+    }
+
+    while (cache->valid < upto && scanned < budget) {
+        int i = cache->valid;
+        cache->end_state[i] = syntax_scan_line(get_line(user, i), syntax_line_state(cache, i), NULL);
+        cache->valid++;
+        scanned++;
+    }
+    return scanned;
+}
+
+#endif // SYNTAX_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SYNTAX_H
@@ -0,0 +1,335 @@
+// Text layout helpers on top of stb_truetype.
+//
+// stb_truetype.h must be included before this file.
+//
+// In exactly one C or C++ file in your project:
+// #define TEXT_IMPLEMENTATION
+// #include "text.h"
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXT_SSE2
+#endif
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#define TEXT_SSE41
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TEXT_AVX2
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "draw.h"
+
+#define TEXT_FIRST_CHAR 32
+#define TEXT_NUM_CHARS 96
+
+typedef struct KernEntry {
+    u32 key; // (glyph1 << 16) | glyph2, 0 = empty slot
+    float advance; // in pixels
+} KernEntry;
+
+// Per-font metrics, built once at load time so layout never has to go back
+// to the font file. Characters are indexed from TEXT_FIRST_CHAR.
+typedef struct FontMetrics {
+    float scale;
+    float advance[TEXT_NUM_CHARS];
+    u16 glyph[TEXT_NUM_CHARS];
+    u8 has_kern[TEXT_NUM_CHARS]; // glyph appears on the left of any pair
+    KernEntry *kern;
+    u32 kern_shift;
+    int kern_count;
+    // Instance for each glyph with the pen at the origin. dst_rect.xy holds
+    // the offset from the pen plus 0.5 so placement is just floor(pen + xy).
+    VertInput quad[TEXT_NUM_CHARS];
+} FontMetrics;
+
+bool font_metrics_init(FontMetrics *m, const u8 *ttf, float pixel_height);
+void font_metrics_set_atlas(FontMetrics *m, const stbtt_packedchar *char_data, int atlas_w, int atlas_h);
+void font_metrics_free(FontMetrics *m);
+
+// Packs the printable ASCII glyphs of `ttf` into the top atlas_w x atlas_h of
+// a texture_h tall texture, and sets up `m` for it. Returns the texture as
+// white RGBA8 with the coverage in alpha, so vertex colors tint it; rows
+// below the atlas are left clear for the caller. Free with free().
+u8 *text_atlas_build(FontMetrics *m, stbtt_packedchar *char_data, const u8 *ttf, float pixel_height, int atlas_w, int atlas_h, int texture_h);
+
+// Lays out `len` bytes of `text` with the pen starting at (x, baseline) and
+// appends one instance per drawable glyph to `store`. Returns the final pen x.
+// If `kinds` is not NULL, each glyph is colored palette[kinds[byte]].
+float text_layout_batch(VertStore *store, const FontMetrics *m, const char *text, int len, float x, float baseline, bool kerning, const u8 *kinds, const Vec4 *palette);
+
+// Pen advance over the first `len` bytes of `text`, as text_layout_batch
+// would place it.
+float text_measure(const FontMetrics *m, const char *text, int len, bool kerning);
+
+// Pen x before each of the `len` bytes of `text`, plus the end in out[len].
+void text_prefix_widths(const FontMetrics *m, const char *text, int len, bool kerning, float *out);
+
+static inline u32 text_kern_slot(u32 key, u32 shift) {
+    return (key * 0x9E3779B1u) >> shift;
+}
+
+// Kerning adjustment between two character indices (char - TEXT_FIRST_CHAR).
+static inline float font_metrics_kern(const FontMetrics *m, int c1, int c2) {
+    if (!m->has_kern[c1]) return 0.0f;
+    u32 key = ((u32)m->glyph[c1] << 16) | m->glyph[c2];
+    u32 mask = (1u << (32 - m->kern_shift)) - 1;
+    for (u32 i = text_kern_slot(key, m->kern_shift);; i = (i + 1) & mask) {
+        if (m->kern[i].key == key) return m->kern[i].advance;
+        if (m->kern[i].key == 0) return 0.0f;
+    }
+}
+
+#ifdef TEXT_IMPLEMENTATION
+
+bool font_metrics_init(FontMetrics *m, const u8 *ttf, float pixel_height) {
+    stbtt_fontinfo info;
+    memset(m, 0, sizeof(*m));
+    if (!stbtt_InitFont(&info, ttf, stbtt_GetFontOffsetForIndex(ttf, 0))) return false;
+    m->scale = stbtt_ScaleForPixelHeight(&info, pixel_height);
+
+    for (int i = 0; i < TEXT_NUM_CHARS; i++) {
+        int advance, lsb;
+        m->glyph[i] = (u16)stbtt_FindGlyphIndex(&info, TEXT_FIRST_CHAR + i);
+        stbtt_GetGlyphHMetrics(&info, m->glyph[i], &advance, &lsb);
+        m->advance[i] = advance * m->scale;
+    }
+
+    int len = stbtt_GetKerningTableLength(&info);
+    stbtt_kerningentry *table = malloc(sizeof(*table) * (len > 0 ? len : 1));
+    len = stbtt_GetKerningTable(&info, table, len);
+
+    // Only keep pairs where both glyphs are ones we can actually draw
+    u8 drawable[65536 / 8] = {0};
+    for (int i = 0; i < TEXT_NUM_CHARS; i++) {
+        drawable[m->glyph[i] >> 3] |= 1 << (m->glyph[i] & 7);
+    }
+#define TEXT_DRAWABLE(g) ((g) != 0 && (drawable[(g) >> 3] & (1 << ((g) & 7))))
+
+    int count = 0;
+    for (int i = 0; i < len; i++) {
+        if (TEXT_DRAWABLE(table[i].glyph1) && TEXT_DRAWABLE(table[i].glyph2) && table[i].advance != 0) {
+            table[count++] = table[i];
+        }
+    }
+
+    // Open addressing, kept at most half full
+    u32 bits = 4;
+    while ((1u << bits) < (u32)count * 2) bits++;
+    m->kern_shift = 32 - bits;
+    m->kern = calloc(1u << bits, sizeof(KernEntry));
+    m->kern_count = count;
+    u32 mask = (1u << bits) - 1;
+    for (int i = 0; i < count; i++) {
+        u32 key = ((u32)table[i].glyph1 << 16) | (u32)table[i].glyph2;
+        u32 slot = text_kern_slot(key, m->kern_shift);
+        while (m->kern[slot].key != 0) slot = (slot + 1) & mask;
+        m->kern[slot] = (KernEntry){key, table[i].advance * m->scale};
+    }
+    for (int i = 0; i < TEXT_NUM_CHARS; i++) {
+        for (int j = 0; j < count && !m->has_kern[i]; j++) {
+            m->has_kern[i] = table[j].glyph1 == m->glyph[i];
+        }
+    }
+#undef TEXT_DRAWABLE
+
+    free(table);
+    return true;
+}
+
+void font_metrics_set_atlas(FontMetrics *m, const stbtt_packedchar *char_data, int atlas_w, int atlas_h) {
+    float ipw = 1.0f / atlas_w, iph = 1.0f / atlas_h;
+    for (int i = 0; i < TEXT_NUM_CHARS; i++) {
+        const stbtt_packedchar *b = &char_data[i];
+        m->quad[i] = (VertInput){
+            .dst_rect = (Rect){b->xoff + 0.5f, b->yoff + 0.5f, b->xoff2 - b->xoff, b->yoff2 - b->yoff},
+            .src_rect = (Rect){b->x0 * ipw, b->y0 * iph, (b->x1 - b->x0) * ipw, (b->y1 - b->y0) * iph},
+            .corner_radii = {{0.0f, 0.0f, 0.0f, 0.0f}},
+            .border_color = {{1.0f, 1.0f, 1.0f, 1.0f}},
+            .colors = {
+                {{1.0f, 1.0f, 1.0f, 1.0f}},
+                {{1.0f, 1.0f, 1.0f, 1.0f}},
+                {{1.0f, 1.0f, 1.0f, 1.0f}},
+                {{1.0f, 1.0f, 1.0f, 1.0f}},
+            },
+            .edge_softness = 1.0f,
+            .border_thickness = 1.0f,
+            .use_texture = 1.0f,
+        };
+    }
+}
+
+u8 *text_atlas_build(FontMetrics *m, stbtt_packedchar *char_data, const u8 *ttf, float pixel_height, int atlas_w, int atlas_h, int texture_h) {
+    u8 *coverage = malloc(atlas_w * atlas_h);
+    stbtt_pack_context pack_context = {0};
+    stbtt_pack_range pack_range = {
+        .font_size = pixel_height,
+        .first_unicode_codepoint_in_range = TEXT_FIRST_CHAR,
+        .num_chars = TEXT_NUM_CHARS,
+        .chardata_for_range = char_data,
+    };
+    stbtt_PackBegin(&pack_context, coverage, atlas_w, atlas_h, 0, 1, NULL);
+    stbtt_PackFontRanges(&pack_context, ttf, 0, &pack_range, 1);
+    stbtt_PackEnd(&pack_context);
+
+    font_metrics_init(m, ttf, pixel_height);
+    font_metrics_set_atlas(m, char_data, atlas_w, texture_h);
+
+    u8 *pixels = calloc((size_t)atlas_w * texture_h, 4);
+    for (int i = 0; i < atlas_w * atlas_h; i++) {
+        pixels[i * 4 + 0] = 0xff;
+        pixels[i * 4 + 1] = 0xff;
+        pixels[i * 4 + 2] = 0xff;
+        pixels[i * 4 + 3] = coverage[i];
+    }
+    free(coverage);
+    return pixels;
+}
+
+#define TEXT_BATCH 256
+
+float text_layout_batch(VertStore *store, const FontMetrics *m, const char *text, int len, float x, float baseline, bool kerning, const u8 *kinds, const Vec4 *palette) {
+    // Padded so the vector loops can run past the end of a block
+    u8 idx[TEXT_BATCH + 8];
+    u8 kind[TEXT_BATCH];
+    float step[TEXT_BATCH + 8];
+    float pen[TEXT_BATCH + 8];
+    int prev = -1;
+    int i = 0;
+
+    while (i < len) {
+        int n = 0;
+        for (; i < len && n < TEXT_BATCH; i++) {
+            u8 c = (u8)((u8)text[i] - TEXT_FIRST_CHAR);
+            if (c < TEXT_NUM_CHARS) {
+                if (kinds) kind[n] = kinds[i];
+                idx[n++] = c;
+            }
+        }
+        if (n == 0) break;
+        memset(idx + n, 0, 8);
+
+        // Advance of each glyph
+#ifdef TEXT_AVX2
+        for (int j = 0; j < n; j += 8) {
+            __m256i vi = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(idx + j)));
+            _mm256_storeu_ps(step + j, _mm256_i32gather_ps(m->advance, vi, 4));
+        }
+#else
+        for (int j = 0; j < n + 8; j++) {
+            step[j] = m->advance[idx[j]];
+        }
+#endif
+
+        // Kerning is rare, so it is a scalar fixup on top of the advances
+        if (kerning) {
+            if (prev >= 0) x += font_metrics_kern(m, prev, idx[0]);
+            for (int j = 0; j + 1 < n; j++) {
+                step[j] += font_metrics_kern(m, idx[j], idx[j + 1]);
+            }
+            prev = idx[n - 1];
+        }
+
+        // Exclusive prefix sum of the advances gives each pen position
+#ifdef TEXT_SSE2
+        __m128 carry = _mm_set1_ps(x);
+        for (int j = 0; j < n; j += 4) {
+            __m128 v = _mm_loadu_ps(step + j);
+            __m128 e = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4));
+            e = _mm_add_ps(e, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(e), 4)));
+            e = _mm_add_ps(e, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(e), 8)));
+            e = _mm_add_ps(e, carry);
+            _mm_storeu_ps(pen + j, e);
+            e = _mm_add_ps(e, v);
+            carry = _mm_shuffle_ps(e, e, 0xff);
+        }
+#else
+        float sum = x;
+        for (int j = 0; j < n; j++) {
+            pen[j] = sum;
+            sum += step[j];
+        }
+#endif
+
+        // Copy each glyph's template and move it to its pen position
+        VertInput *out = reserve_verts(store, n);
+        for (int j = 0; j < n; j++) {
+            const VertInput *t = &m->quad[idx[j]];
+            out[j] = *t;
+#ifdef TEXT_SSE41
+            __m128 r = _mm_add_ps(_mm_loadu_ps(&t->dst_rect.x), _mm_setr_ps(pen[j], baseline, 0.0f, 0.0f));
+            _mm_storeu_ps(&out[j].dst_rect.x, _mm_blend_ps(r, _mm_floor_ps(r), 0x3));
+#else
+            out[j].dst_rect.x = floorf(pen[j] + t->dst_rect.x);
+            out[j].dst_rect.y = floorf(baseline + t->dst_rect.y);
+#endif
+            if (kinds) {
+                Vec4 color = palette[kind[j]];
+                out[j].colors[0] = color;
+                out[j].colors[1] = color;
+                out[j].colors[2] = color;
+                out[j].colors[3] = color;
+            }
+        }
+        store->size += n;
+        x = pen[n - 1] + step[n - 1];
+    }
+    return x;
+}
+
+float text_measure(const FontMetrics *m, const char *text, int len, bool kerning) {
+    float x = 0.0f;
+    int prev = -1;
+    for (int i = 0; i < len; i++) {
+        u8 c = (u8)((u8)text[i] - TEXT_FIRST_CHAR);
+        if (c >= TEXT_NUM_CHARS) continue;
+        if (kerning && prev >= 0) x += font_metrics_kern(m, prev, c);
+        x += m->advance[c];
+        prev = c;
+    }
+    return x;
+}
+
+void text_prefix_widths(const FontMetrics *m, const char *text, int len, bool kerning, float *out) {
+    float x = 0.0f;
+    int prev = -1;
+    for (int i = 0; i < len; i++) {
+        u8 c = (u8)((u8)text[i] - TEXT_FIRST_CHAR);
+        if (c < TEXT_NUM_CHARS) {
+            if (kerning && prev >= 0) x += font_metrics_kern(m, prev, c);
+            out[i] = x;
+            x += m->advance[c];
+            prev = c;
+        } else {
+            out[i] = x;
+        }
+    }
+    out[len] = x;
+}
+
+void font_metrics_free(FontMetrics *m) {
+    free(m->kern);
+    m->kern = NULL;
+    m->kern_count = 0;
+}
+
+#endif // TEXT_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TEXT_H
@@ -1,3 +1,6 @@
+#ifndef TYPES_H
+#define TYPES_H
+
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -13,3 +16,5 @@ typedef uint64_t u64;
 
 typedef float f32;
 typedef double f64;
+
+#endif // TYPES_H
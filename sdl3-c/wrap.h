@@ -0,0 +1,432 @@
+// Soft wrapping of document lines to a pixel width.
+//
+// The prefix widths of recently drawn lines are cached, so a resize finds
+// the new break points by binary search instead of measuring glyphs again.
+// Every line's visual row count is kept in blocks of a few hundred lines,
+// with Fenwick trees over the blocks' line and row totals. "Which visual
+// row is this line on" and "which line is on this visual row" find their
+// block in O(log n) and scan within it, and inserting or removing a line
+// only moves the rest of its block. The trees are rebuilt, which is
+// O(n / WRAP_BLOCK), only when blocks split or empty. Lines that were never
+// wrapped, or not since the last width change, count with their old (or a
+// guessed) row count and are wrapped lazily, a budget at a time.
+//
+// text.h must be included before this file.
+//
+// In exactly one C or C++ file in your project:
+// #define WRAP_IMPLEMENTATION
+// #include "wrap.h"
+
+#ifndef WRAP_H
+#define WRAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+#define WRAP_CACHE_LINES 256
+#define WRAP_STALE 0x8000 // row count is from an old width, or a guess
+#define WRAP_BLOCK 256     // lines per block; blocks split at twice this
+
+typedef struct WrapCacheEntry {
+    int line; // -1 if empty
+    int len;
+    int capacity;
+    u32 last_used;
+    float *prefix; // len + 1 entries
+} WrapCacheEntry;
+
+typedef struct WrapBlock {
+    u16 *rows; // visual rows per line, | WRAP_STALE if not wrapped at `width`
+    int count;
+    int capacity;
+    int total; // visual rows in the block
+} WrapBlock;
+
+typedef struct Wrap {
+    float width;
+    int count;
+    WrapBlock *blocks;
+    int block_count;
+    int block_capacity;
+    int *line_tree; // Fenwick trees over the blocks' count and total, 1-based
+    int *row_tree;
+    int stale_from; // no stale lines before this one
+    WrapCacheEntry cache[WRAP_CACHE_LINES];
+    u32 frame;
+    float *scratch;
+    int scratch_capacity;
+} Wrap;
+
+// Returns the NUL-terminated text of a line, valid until the next call.
+typedef const char *(*WrapGetLine)(void *user, int line);
+
+void wrap_init(Wrap *w, int line_count, float width);
+void wrap_free(Wrap *w);
+
+// Marks every line stale. Cached lines re-wrap without measuring.
+void wrap_set_width(Wrap *w, float width);
+
+// Lines [line, line + removed) were replaced by `inserted` new lines.
+void wrap_lines_changed(Wrap *w, int line, int removed, int inserted);
+
+// Wraps one line and caches its prefix widths. Writes the byte offset where
+// each visual row after the first starts into `breaks` (up to max_breaks)
+// and returns the row count.
+int wrap_line(Wrap *w, const FontMetrics *m, int line, const char *text, int len, int *breaks, int max_breaks);
+
+// Wraps at most `budget` stale lines without caching them.
+int wrap_update(Wrap *w, const FontMetrics *m, WrapGetLine get_line, void *user, int budget);
+
+// First visual row of `line`.
+int wrap_line_row(Wrap *w, int line);
+
+// Line shown on visual row `row`, and which of its rows that is.
+int wrap_row_line(Wrap *w, int row, int *row_in_line);
+
+int wrap_total_rows(Wrap *w);
+
+#ifdef WRAP_IMPLEMENTATION
+
+static void wrap_build_tree(Wrap *w) {
+    int n = w->block_count;
+    for (int i = 1; i <= n; i++) {
+        w->line_tree[i] = w->blocks[i - 1].count;
+        w->row_tree[i] = w->blocks[i - 1].total;
+    }
+    for (int i = 1; i <= n; i++) {
+        int j = i + (i & -i);
+        if (j <= n) {
+            w->line_tree[j] += w->line_tree[i];
+            w->row_tree[j] += w->row_tree[i];
+        }
+    }
+}
+
+static void wrap_tree_add(Wrap *w, int *tree, int block, int delta) {
+    for (int i = block + 1; i <= w->block_count; i += i & -i) tree[i] += delta;
+}
+
+// Sum over the first `blocks` blocks
+static int wrap_tree_sum(const int *tree, int blocks) {
+    int sum = 0;
+    for (int i = blocks; i > 0; i -= i & -i) sum += tree[i];
+    return sum;
+}
+
+// Walks down the implicit tree for the block holding `*value` and leaves
+// what is left of it in `*value`. Returns block_count past the end.
+static int wrap_tree_find(Wrap *w, const int *tree, int *value) {
+    int block = 0;
+    int step = 1;
+    while (step * 2 <= w->block_count) step *= 2;
+    for (; step; step /= 2) {
+        if (block + step <= w->block_count && tree[block + step] <= *value) {
+            block += step;
+            *value -= tree[block];
+        }
+    }
+    return block;
+}
+
+// Block holding `line`, and the line's index in it. `line` == count maps to
+// the end of the last block, so appending has somewhere to go.
+static int wrap_find_line(Wrap *w, int line, int *index) {
+    int block = wrap_tree_find(w, w->line_tree, &line);
+    if (block == w->block_count) {
+        block--;
+        line = w->blocks[block].count;
+    }
+    *index = line;
+    return block;
+}
+
+static int wrap_block_total(const WrapBlock *b) {
+    int total = 0;
+    for (int i = 0; i < b->count; i++) total += b->rows[i] & ~WRAP_STALE;
+    return total;
+}
+
+static void wrap_block_reserve(WrapBlock *b, int count) {
+    if (count <= b->capacity) return;
+    b->capacity = count > WRAP_BLOCK * 2 ? count : WRAP_BLOCK * 2;
+    b->rows = realloc(b->rows, b->capacity * sizeof(u16));
+}
+
+// Opens up `n` empty blocks before block `at`
+static void wrap_insert_blocks(Wrap *w, int at, int n) {
+    if (w->block_count + n > w->block_capacity) {
+        while (w->block_count + n > w->block_capacity) w->block_capacity *= 2;
+        w->blocks = realloc(w->blocks, w->block_capacity * sizeof(WrapBlock));
+        w->line_tree = realloc(w->line_tree, (w->block_capacity + 1) * sizeof(int));
+        w->row_tree = realloc(w->row_tree, (w->block_capacity + 1) * sizeof(int));
+    }
+    memmove(w->blocks + at + n, w->blocks + at, (w->block_count - at) * sizeof(WrapBlock));
+    memset(w->blocks + at, 0, n * sizeof(WrapBlock));
+    w->block_count += n;
+}
+
+static void wrap_remove_block(Wrap *w, int at) {
+    free(w->blocks[at].rows);
+    memmove(w->blocks + at, w->blocks + at + 1, (w->block_count - at - 1) * sizeof(WrapBlock));
+    w->block_count--;
+}
+
+// Cuts an oversized block into WRAP_BLOCK sized ones
+static void wrap_split_block(Wrap *w, int at) {
+    int count = w->blocks[at].count;
+    int pieces = (count + WRAP_BLOCK - 1) / WRAP_BLOCK;
+    wrap_insert_blocks(w, at + 1, pieces - 1);
+    WrapBlock *first = &w->blocks[at];
+    for (int i = 1; i < pieces; i++) {
+        WrapBlock *b = &w->blocks[at + i];
+        int start = i * WRAP_BLOCK;
+        b->count = count - start < WRAP_BLOCK ? count - start : WRAP_BLOCK;
+        wrap_block_reserve(b, b->count);
+        memcpy(b->rows, first->rows + start, b->count * sizeof(u16));
+        b->total = wrap_block_total(b);
+    }
+    first->count = WRAP_BLOCK;
+    first->total = wrap_block_total(first);
+}
+
+static void wrap_set_rows(Wrap *w, int line, int rows) {
+    int index;
+    int at = wrap_find_line(w, line, &index);
+    WrapBlock *b = &w->blocks[at];
+    int old = b->rows[index] & ~WRAP_STALE;
+    b->rows[index] = (u16)(rows < WRAP_STALE ? rows : WRAP_STALE - 1);
+    int delta = b->rows[index] - old;
+    if (delta) {
+        b->total += delta;
+        wrap_tree_add(w, w->row_tree, at, delta);
+    }
+}
+
+void wrap_init(Wrap *w, int line_count, float width) {
+    memset(w, 0, sizeof(*w));
+    w->width = width;
+    w->count = line_count;
+    w->block_count = 1;
+    w->block_capacity = 1;
+    w->blocks = calloc(1, sizeof(WrapBlock));
+    w->line_tree = malloc(2 * sizeof(int));
+    w->row_tree = malloc(2 * sizeof(int));
+    WrapBlock *b = &w->blocks[0];
+    wrap_block_reserve(b, line_count);
+    for (int i = 0; i < line_count; i++) b->rows[i] = WRAP_STALE | 1;
+    b->count = line_count;
+    b->total = line_count;
+    if (line_count > WRAP_BLOCK * 2) wrap_split_block(w, 0);
+    wrap_build_tree(w);
+    for (int i = 0; i < WRAP_CACHE_LINES; i++) w->cache[i].line = -1;
+}
+
+void wrap_free(Wrap *w) {
+    for (int i = 0; i < WRAP_CACHE_LINES; i++) free(w->cache[i].prefix);
+    for (int i = 0; i < w->block_count; i++) free(w->blocks[i].rows);
+    free(w->blocks);
+    free(w->line_tree);
+    free(w->row_tree);
+    free(w->scratch);
+    memset(w, 0, sizeof(*w));
+}
+
+void wrap_set_width(Wrap *w, float width) {
+    if (width == w->width) return;
+    w->width = width;
+    for (int b = 0; b < w->block_count; b++) {
+        WrapBlock *block = &w->blocks[b];
+        for (int i = 0; i < block->count; i++) block->rows[i] |= WRAP_STALE;
+    }
+    w->stale_from = 0;
+}
+
+void wrap_lines_changed(Wrap *w, int line, int removed, int inserted) {
+    int delta = inserted - removed;
+    int index;
+    int at = wrap_find_line(w, line, &index);
+    if (!delta) {
+        // Keep the old row count as the guess so the view does not jump
+        for (int b = at, i = index, left = inserted; left > 0 && b < w->block_count; b++, i = 0) {
+            WrapBlock *block = &w->blocks[b];
+            for (; i < block->count && left > 0; i++, left--) block->rows[i] |= WRAP_STALE;
+        }
+    } else {
+        // Take the removed lines out of every block they span, leaving
+        // emptied blocks in place until the new lines are in
+        int last = at;
+        for (int b = at, i = index, left = removed; left > 0 && b < w->block_count; b++, i = 0) {
+            WrapBlock *block = &w->blocks[b];
+            int n = block->count - i < left ? block->count - i : left;
+            memmove(block->rows + i, block->rows + i + n, (block->count - i - n) * sizeof(u16));
+            block->count -= n;
+            left -= n;
+            last = b;
+        }
+        WrapBlock *block = &w->blocks[at];
+        int old_total = block->total;
+        wrap_block_reserve(block, block->count + inserted);
+        memmove(block->rows + index + inserted, block->rows + index, (block->count - index) * sizeof(u16));
+        for (int i = index; i < index + inserted; i++) block->rows[i] = WRAP_STALE | 1;
+        block->count += inserted;
+        for (int b = at; b <= last; b++) w->blocks[b].total = wrap_block_total(&w->blocks[b]);
+
+        if (last == at && block->count > 0 && block->count <= WRAP_BLOCK * 2) {
+            // The usual single line edit: one block's totals moved
+            wrap_tree_add(w, w->line_tree, at, delta);
+            wrap_tree_add(w, w->row_tree, at, block->total - old_total);
+        } else {
+            for (int b = last; b >= at; b--) {
+                if (w->blocks[b].count == 0 && w->block_count > 1) wrap_remove_block(w, b);
+            }
+            if (at < w->block_count && w->blocks[at].count > WRAP_BLOCK * 2) wrap_split_block(w, at);
+            wrap_build_tree(w);
+        }
+    }
+    w->count += delta;
+    if (line < w->stale_from) w->stale_from = line;
+
+    // Cached prefixes of changed lines are gone, later ones just move
+    for (int i = 0; i < WRAP_CACHE_LINES; i++) {
+        WrapCacheEntry *e = &w->cache[i];
+        if (e->line < line) continue;
+        if (e->line < line + removed) e->line = -1;
+        else e->line += delta;
+    }
+}
+
+// Greedy breaks over prefix widths: each row takes as many bytes as fit,
+// backing up to just after the last space if there is one in the row
+static int wrap_breaks(const float *prefix, int len, const char *text, float width, int *breaks, int max_breaks) {
+    int rows = 1;
+    int start = 0;
+    while (prefix[len] - prefix[start] > width) {
+        // Last j with prefix[j] - prefix[start] <= width
+        float limit = prefix[start] + width;
+        int lo = start + 1, hi = len;
+        while (lo < hi) {
+            int mid = lo + (hi - lo + 1) / 2;
+            if (prefix[mid] <= limit) lo = mid;
+            else hi = mid - 1;
+        }
+        int end = lo;
+        for (int i = end; i > start + 1; i--) {
+            if (text[i - 1] == ' ') {
+                end = i;
+                break;
+            }
+        }
+        if (end >= len) break;
+        if (rows - 1 < max_breaks) breaks[rows - 1] = end;
+        rows++;
+        start = end;
+    }
+    return rows;
+}
+
+int wrap_line(Wrap *w, const FontMetrics *m, int line, const char *text, int len, int *breaks, int max_breaks) {
+    w->frame++;
+    WrapCacheEntry *entry = NULL, *oldest = &w->cache[0];
+    for (int i = 0; i < WRAP_CACHE_LINES; i++) {
+        WrapCacheEntry *e = &w->cache[i];
+        if (e->line == line && e->len == len) {
+            entry = e;
+            break;
+        }
+        if (e->line < 0 || (oldest->line >= 0 && e->last_used < oldest->last_used)) oldest = e;
+    }
+    if (!entry) {
+        entry = oldest;
+        if (len + 1 > entry->capacity) {
+            entry->capacity = len + 1;
+            entry->prefix = realloc(entry->prefix, entry->capacity * sizeof(float));
+        }
+        entry->line = line;
+        entry->len = len;
+        text_prefix_widths(m, text, len, true, entry->prefix);
+    }
+    entry->last_used = w->frame;
+
+    int rows = wrap_breaks(entry->prefix, len, text, w->width, breaks, max_breaks);
+    wrap_set_rows(w, line, rows);
+    return rows;
+}
+
+int wrap_update(Wrap *w, const FontMetrics *m, WrapGetLine get_line, void *user, int budget) {
+    int done = 0;
+    int line = w->stale_from;
+    if (line >= w->count) return 0;
+    int index;
+    for (int at = wrap_find_line(w, line, &index); at < w->block_count && done < budget; at++, index = 0) {
+        WrapBlock *block = &w->blocks[at];
+        int total = block->total;
+        for (; index < block->count && done < budget; index++, line++) {
+            if (!(block->rows[index] & WRAP_STALE)) continue;
+            const char *text = get_line(user, line);
+            int len = (int)strlen(text);
+            if (len + 1 > w->scratch_capacity) {
+                w->scratch_capacity = (len + 1) * 2;
+                w->scratch = realloc(w->scratch, w->scratch_capacity * sizeof(float));
+            }
+            text_prefix_widths(m, text, len, true, w->scratch);
+            int rows = wrap_breaks(w->scratch, len, text, w->width, NULL, 0);
+            block->total -= block->rows[index] & ~WRAP_STALE;
+            block->rows[index] = (u16)(rows < WRAP_STALE ? rows : WRAP_STALE - 1);
+            block->total += block->rows[index];
+            done++;
+        }
+        // One tree update per block rather than per line
+        if (block->total != total) wrap_tree_add(w, w->row_tree, at, block->total - total);
+    }
+    w->stale_from = line;
+    return done;
+}
+
+int wrap_line_row(Wrap *w, int line) {
+    if (line >= w->count) return wrap_total_rows(w);
+    int index;
+    int at = wrap_find_line(w, line, &index);
+    const WrapBlock *block = &w->blocks[at];
+    int row = wrap_tree_sum(w->row_tree, at);
+    for (int i = 0; i < index; i++) row += block->rows[i] & ~WRAP_STALE;
+    return row;
+}
+
+int wrap_row_line(Wrap *w, int row, int *row_in_line) {
+    int at = wrap_tree_find(w, w->row_tree, &row);
+    int line;
+    if (at >= w->block_count) {
+        const WrapBlock *last = &w->blocks[w->block_count - 1];
+        line = w->count - 1;
+        row = last->count > 0 ? (last->rows[last->count - 1] & ~WRAP_STALE) - 1 : 0;
+    } else {
+        const WrapBlock *block = &w->blocks[at];
+        int i = 0;
+        for (; i < block->count - 1; i++) {
+            int rows = block->rows[i] & ~WRAP_STALE;
+            if (row < rows) break;
+            row -= rows;
+        }
+        line = wrap_tree_sum(w->line_tree, at) + i;
+    }
+    if (row_in_line) *row_in_line = row;
+    return line;
+}
+
+int wrap_total_rows(Wrap *w) {
+    return wrap_tree_sum(w->row_tree, w->block_count);
+}
+
+#endif // WRAP_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WRAP_H
@@ -4,10 +4,305 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <math.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "SDL.h"
 #include "SDL_opengl.h"
 
+// Rects use the instance format and shaders of the sdl3-c renderers
+#define DRAW_IMPLEMENTATION
+#include "draw.h"
+#define DRAW_GL_IMPLEMENTATION
+#include "draw_gl.h"
+
+typedef struct Color {
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+    unsigned char a;
+} Color;
+
+// Normalized, as the draw.h instances take colors
+static Vec4 gl_color(Color c) {
+    return {{c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, c.a / 255.0f}};
+}
+
+// Triangles and rects are collected into streaming buffers and drawn with
+// a single call per flush. With ARB_buffer_storage the buffers are mapped
+// once and written in place, split into regions: every flush in a frame
+// draws the next range of the current region, which gets a fence at the
+// end of the frame (or when it fills up), so the CPU never overwrites data
+// the GPU is still reading and only waits on a region frames old.
+// Without it the buffers are orphaned on every flush.
+#define BATCH_MAX_VERTICES 65536 // per region
+#define BATCH_MAX_INDICES (BATCH_MAX_VERTICES / 4 * 6)
+#define BATCH_MAX_RECTS 65536
+#define BATCH_REGIONS 3
+
+// Positions are in pixels; the projection uniform maps them to clip space
+typedef struct Vertex {
+    GLfloat x, y;
+    Color color; // normalized GL_UNSIGNED_BYTE
+} Vertex;
+
+typedef enum BatchMode {
+    BATCH_EMPTY,
+    BATCH_TRIANGLES,
+    BATCH_RECTS,
+    BATCH_MESHES,
+} BatchMode;
+
+// Meshes are uploaded once into shared buffers, and each gl_draw_mesh
+// records an indirect command plus its transform and color. A flush
+// submits every command with one glMultiDrawElementsIndirect, and the
+// vertex shader looks up its draw's data in a texture buffer by
+// gl_DrawIDARB. Without ARB_multi_draw_indirect and
+// ARB_shader_draw_parameters each command is its own
+// glDrawElementsBaseVertex, with the index in a uniform.
+#define MESH_MAX_MESHES 256
+#define MESH_MAX_VERTICES 65536
+#define MESH_MAX_INDICES (MESH_MAX_VERTICES * 3)
+#define MESH_MAX_DRAWS 16384
+
+// Layout fixed by GL for GL_DRAW_INDIRECT_BUFFER
+typedef struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+} DrawElementsIndirectCommand;
+
+// Two RGBA32F texels of the draw data texture buffer
+typedef struct MeshDraw {
+    GLfloat x, y, scale_x, scale_y;
+    GLfloat color[4];
+} MeshDraw;
+
+typedef struct Mesh {
+    GLuint first_index;
+    GLuint index_count;
+    GLint base_vertex;
+} Mesh;
+
+typedef struct MeshBatch {
+    GLuint vao;
+    GLuint vertices;
+    GLuint indices;
+    GLuint commands;
+    GLuint draw_buffer;
+    GLuint draw_texture;
+    bool indirect; // false uses the GL 3.3 fallback
+    GLuint vertex_count;
+    GLuint index_count;
+    Mesh meshes[MESH_MAX_MESHES];
+    int mesh_count;
+    DrawElementsIndirectCommand command_data[MESH_MAX_DRAWS];
+    MeshDraw draw_data[MESH_MAX_DRAWS];
+    int draw_count;
+} MeshBatch;
+
+typedef struct Stream {
+    GLuint buffer;
+    GLsizeiptr region_size; // bytes
+    unsigned char *mapped;  // every region, when persistent
+    unsigned char *data;    // current region, or a staging array when orphaning
+    GLsizeiptr start;       // where the next flush's draw begins
+    GLsizeiptr used;
+} Stream;
+
+typedef struct Batch {
+    GLuint triangle_vao;
+    GLuint rect_vao;
+    Stream vertices;
+    Stream indices;
+    Stream rects;
+    bool persistent;
+    GLsync fences[BATCH_REGIONS];
+    int region;
+    BatchMode mode;
+    int draw_calls;
+    size_t uploaded; // bytes written for the GPU, for --bench
+} Batch;
+
+// GPU time per named scope, from a GL_TIMESTAMP query at each end so
+// scopes can nest. A frame's queries are read PROFILER_FRAMES - 1 frames later,
+// when the GPU is done with them; a result that still isn't available is
+// dropped rather than waited for. Timer queries are core in GL 3.3 and
+// implemented by Mesa's llvmpipe.
+#define PROFILER_FRAMES 3
+#define PROFILER_MAX_SCOPES 16
+#define PROFILER_MAX_RECORDS 64 // scope instances per frame
+#define PROFILER_MAX_DEPTH 8
+#define PROFILER_HISTORY 120    // samples kept per scope
+
+typedef struct ProfilerScope {
+    const char *name;
+    float history[PROFILER_HISTORY]; // ms, a ring
+    int samples;
+    int next;
+} ProfilerScope;
+
+typedef struct ProfilerFrame {
+    GLuint queries[2 * PROFILER_MAX_RECORDS]; // begin, end per record
+    int scopes[PROFILER_MAX_RECORDS];
+    int count;
+} ProfilerFrame;
+
+typedef struct Profiler {
+    bool enabled;
+    bool overlay;
+    ProfilerScope scopes[PROFILER_MAX_SCOPES];
+    int scope_count;
+    ProfilerFrame frames[PROFILER_FRAMES];
+    int frame;
+    int stack[PROFILER_MAX_DEPTH]; // open records
+    int depth;
+    int dropped; // results not ready when read
+} Profiler;
+
+// Frames are read back into a ring of pixel pack buffers, each with a
+// fence, so glReadPixels returns at once and frame N is mapped at frame
+// N + 2, when the GPU has long finished it. The pixels are copied out and
+// queued for an encoder thread, which writes screenshots as PNG and
+// recordings as raw RGBA video.
+#define CAPTURE_FRAMES 3
+#define CAPTURE_QUEUE 8 // frames waiting for the encoder
+
+typedef enum CaptureKind {
+    CAPTURE_NONE = 0,
+    CAPTURE_SCREENSHOT = 1,
+    CAPTURE_VIDEO = 2,
+} CaptureKind;
+
+typedef struct CaptureJob {
+    unsigned char *pixels; // bottom row first, as GL reads them
+    int width;
+    int height;
+    int kinds; // CaptureKind bits
+} CaptureJob;
+
+typedef struct Capture {
+    GLuint pbos[CAPTURE_FRAMES];
+    GLsync fences[CAPTURE_FRAMES];
+    GLsizeiptr sizes[CAPTURE_FRAMES];
+    int widths[CAPTURE_FRAMES];
+    int heights[CAPTURE_FRAMES];
+    int kinds[CAPTURE_FRAMES];
+    int slot;
+    bool screenshot; // requested for the next frame
+    bool recording;
+    int dropped; // frames the encoder couldn't keep up with
+
+    // Shared with the encoder thread
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;
+    CaptureJob queue[CAPTURE_QUEUE];
+    int head;
+    int count;
+    bool busy; // encoding a job taken off the queue
+    bool quit;
+    FILE *video;
+    int video_width;
+    int video_height;
+    int screenshots;
+} Capture;
+
+// With --render-thread, GL submission runs on its own thread. The main
+// thread handles events and records each frame into a FramePacket, which
+// the render thread replays through the batch, so building the next frame
+// overlaps submitting this one and waiting on the swap. Packets go round
+// a single-producer single-consumer ring without locks: each side owns its
+// index, and one semaphore per direction counts the filled and free
+// packets, so a thread only sleeps when the ring is empty or full. At most
+// FRAME_PACKETS frames are in flight; each one adds a frame of latency.
+#define FRAME_PACKETS 2
+
+typedef enum FrameFlags {
+    FRAME_SCREENSHOT = 1,
+    FRAME_TOGGLE_RECORDING = 2,
+    FRAME_TOGGLE_OVERLAY = 4,
+    FRAME_PRINT_PROFILE = 8,
+    FRAME_QUIT = 16, // stops the render thread instead of drawing
+} FrameFlags;
+
+typedef enum FrameCommandType {
+    FRAME_RECTS,
+    FRAME_TRIANGLES,
+} FrameCommandType;
+
+typedef struct FrameCommand {
+    FrameCommandType type;
+    int first; // rect or vertex
+    int count;
+    int first_index;
+    int index_count;
+} FrameCommand;
+
+typedef struct FramePacket {
+    // Set by the main thread
+    float window_width;
+    float window_height;
+    Color clear_color;
+    int flags; // FrameFlags
+    Uint64 input_time; // when this frame's events were polled
+    FrameCommand *commands;
+    int command_count;
+    int command_capacity;
+    VertStore rects;
+    Vertex *vertices;
+    int vertex_count;
+    int vertex_capacity;
+    GLuint *indices;
+    int index_count;
+    int index_capacity;
+
+    // Set by the render thread once the frame is swapped, and read when
+    // the packet comes back to the main thread
+    bool presented;
+    double latency_ms; // input_time to the swap returning
+    int gl_issued;
+    int gl_elided;
+} FramePacket;
+
+typedef struct FrameQueue {
+    FramePacket packets[FRAME_PACKETS];
+    unsigned written; // main thread only
+    unsigned read;    // render thread only
+    SDL_sem *filled;
+    SDL_sem *free;
+    SDL_Thread *thread; // NULL when frames are drawn on the main thread
+} FrameQueue;
+
+// Totals over the packets that came back since the last reset
+typedef struct FrameStats {
+    int frames;
+    double latency_ms;
+    int gl_issued;
+    int gl_elided;
+} FrameStats;
+
+// Last value set through the gl_* state wrappers, so setting the same
+// value again can be skipped. GL_STATE_UNKNOWN forces the next call through,
+// for state changed behind the cache's back.
+#define GL_STATE_UNKNOWN 0xffffffffu
+
+typedef struct GLState {
+    GLuint program;
+    GLuint vao;
+    GLuint array_buffer;
+    GLuint element_buffer; // part of the VAO, so unknown after a VAO change
+    GLuint blend;          // 0, 1 or unknown
+    GLenum blend_src;
+    GLenum blend_dst;
+    GLuint scissor;        // 0, 1 or unknown
+    GLint scissor_box[4];
+    int issued; // calls made since the counters were last reset
+    int elided; // calls skipped
+} GLState;
+
 typedef struct AppState {
     float window_width;
     float window_height;
@@ -15,7 +310,26 @@ typedef struct AppState {
     SDL_Window *window;
     SDL_GLContext context;
     GLuint tri_program_id;
+    GLuint rect_program_id;
     GLuint basic_program_id;
+    GLuint mesh_program_id;          // gl_DrawIDARB
+    GLuint mesh_fallback_program_id; // draw_id uniform
+    GLint tri_projection;
+    GLint rect_screen_size;
+    GLint mesh_projection;
+    GLint mesh_fallback_projection;
+    GLint mesh_fallback_draw_id;
+    GLuint unbatched_vao;
+    Batch batch;
+    MeshBatch meshes;
+    GLState gl;
+    Profiler profiler;
+    Capture capture;
+    FrameQueue frames;
+    FrameStats frame_stats;
+    char *program_cache_dir; // NULL when binaries can't be cached
+    uint64_t driver_hash;
+    int programs_cached;
 } AppState;
 static AppState state = {
     .window_width = 800.0f,
@@ -27,23 +341,43 @@ static AppState state = {
     .basic_program_id = 0,
 };
 
-typedef struct Color {
-    unsigned char r;
-    unsigned char g;
-    unsigned char b;
-    unsigned char a;
-} Color;
-
 const GLchar *TRI_VERT_SRC =
     "#version 330 core\n"
-    "in vec2 position;"
-    "in vec4 color;"
+    "layout(location = 0) in vec2 position;"
+    "layout(location = 1) in vec4 color;"
+    "uniform mat4 projection;"
     "out vec4 v_color;"
     "void main() {"
     "  v_color = color;"
-    "  gl_Position = vec4(position.x, position.y, 0, 1);"
+    "  gl_Position = projection * vec4(position, 0, 1);"
     "}";
 
+// Vertex colors are multiplied by the draw's color, and positions are
+// scaled and offset by its transform
+#define MESH_VERT_BODY \
+    "layout(location = 0) in vec2 position;" \
+    "layout(location = 1) in vec4 color;" \
+    "uniform mat4 projection;" \
+    "uniform samplerBuffer draw_data;" \
+    "out vec4 v_color;" \
+    "void main() {" \
+    "  vec4 transform = texelFetch(draw_data, DRAW_ID * 2);" \
+    "  v_color = color * texelFetch(draw_data, DRAW_ID * 2 + 1);" \
+    "  gl_Position = projection * vec4(transform.xy + position * transform.zw, 0, 1);" \
+    "}"
+
+const GLchar *MESH_VERT_SRC =
+    "#version 330 core\n"
+    "#extension GL_ARB_shader_draw_parameters : require\n"
+    "#define DRAW_ID gl_DrawIDARB\n"
+    MESH_VERT_BODY;
+
+const GLchar *MESH_FALLBACK_VERT_SRC =
+    "#version 330 core\n"
+    "uniform int draw_id;\n"
+    "#define DRAW_ID draw_id\n"
+    MESH_VERT_BODY;
+
 const GLchar* TRI_FRAG_SRC =
     "#version 330 core\n"
     "in vec4 v_color;"
@@ -84,12 +418,119 @@ static GLuint gl_create_shader(GLenum type, const GLchar *src) {
     return id;
 }
 
+// Linked programs are saved with glGetProgramBinary in the user's pref
+// directory, one file per source hash, and loaded with glProgramBinary on
+// the next start. The header records a hash of the driver's vendor,
+// renderer and version strings; a driver change, or a binary the driver
+// rejects, falls back to compiling and rewrites the file.
+#define PROGRAM_CACHE_MAGIC 0x31425047 // "GPB1"
+
+typedef struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t driver_hash;
+    uint64_t source_hash;
+    uint32_t length;
+    uint32_t padding;
+} ProgramCacheHeader;
+
+static uint64_t hash_string(uint64_t hash, const char *s) {
+    // FNV-1a
+    for (; *s; s++) {
+        hash ^= (unsigned char)*s;
+        hash *= 0x100000001b3ull;
+    }
+    return hash ^ 0xff; // separates consecutive strings
+}
+
+static void gl_program_cache_init() {
+    GLint formats = 0;
+    if (GLEW_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    if (formats == 0) {
+        printf("Program binaries unsupported, compiling shaders every start\n");
+        return;
+    }
+    state.program_cache_dir = SDL_GetPrefPath("templates", "sdlgl-cpp");
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hash_string(hash, (const char *)glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char *)glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char *)glGetString(GL_VERSION));
+    state.driver_hash = hash;
+}
+
+static void gl_program_cache_path(char *path, size_t size, uint64_t source_hash) {
+    snprintf(path, size, "%sprogram-%016llx.bin", state.program_cache_dir, (unsigned long long)source_hash);
+}
+
+static GLuint gl_program_cache_load(uint64_t source_hash) {
+    char path[1024];
+    gl_program_cache_path(path, sizeof(path), source_hash);
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    ProgramCacheHeader header;
+    GLuint program = 0;
+    if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == PROGRAM_CACHE_MAGIC &&
+        header.driver_hash == state.driver_hash && header.source_hash == source_hash) {
+        void *binary = malloc(header.length);
+        if (fread(binary, header.length, 1, f) == 1) {
+            program = glCreateProgram();
+            glProgramBinary(program, header.format, binary, header.length);
+            GLint success;
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            if (success == GL_FALSE) {
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+        free(binary);
+    }
+    fclose(f);
+    return program;
+}
+
+static void gl_program_cache_save(GLuint program, uint64_t source_hash) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    void *binary = malloc(length);
+    ProgramCacheHeader header = {};
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.driver_hash = state.driver_hash;
+    header.source_hash = source_hash;
+    glGetProgramBinary(program, length, NULL, &header.format, binary);
+    header.length = (uint32_t)length;
+
+    char path[1024];
+    gl_program_cache_path(path, sizeof(path), source_hash);
+    FILE *f = fopen(path, "wb");
+    if (f) {
+        fwrite(&header, sizeof(header), 1, f);
+        fwrite(binary, length, 1, f);
+        fclose(f);
+    }
+    free(binary);
+}
+
 static GLuint gl_create_program(const char *vert_src, const char *frag_src) {
+    uint64_t source_hash = hash_string(hash_string(0xcbf29ce484222325ull, vert_src), frag_src);
+    if (state.program_cache_dir) {
+        GLuint program = gl_program_cache_load(source_hash);
+        if (program) {
+            state.programs_cached++;
+            return program;
+        }
+    }
+
     GLuint vert = gl_create_shader(GL_VERTEX_SHADER, vert_src);
     GLuint frag = gl_create_shader(GL_FRAGMENT_SHADER, frag_src);
     GLuint program = glCreateProgram();
     glAttachShader(program, vert);
     glAttachShader(program, frag);
+    if (state.program_cache_dir) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(program);
     glDeleteShader(vert);
     glDeleteShader(frag);
@@ -104,9 +545,840 @@ static GLuint gl_create_program(const char *vert_src, const char *frag_src) {
         glDeleteProgram(program);
         return 0;
     }
+    if (state.program_cache_dir) {
+        gl_program_cache_save(program, source_hash);
+    }
     return program;
 }
 
+static void gl_state_reset() {
+    GLState *gl = &state.gl;
+    gl->program = GL_STATE_UNKNOWN;
+    gl->vao = GL_STATE_UNKNOWN;
+    gl->array_buffer = GL_STATE_UNKNOWN;
+    gl->element_buffer = GL_STATE_UNKNOWN;
+    gl->blend = GL_STATE_UNKNOWN;
+    gl->blend_src = GL_STATE_UNKNOWN;
+    gl->blend_dst = GL_STATE_UNKNOWN;
+    gl->scissor = GL_STATE_UNKNOWN;
+    gl->scissor_box[0] = gl->scissor_box[1] = gl->scissor_box[2] = gl->scissor_box[3] = -1;
+}
+
+// True, and counted as issued, when `cached` differs from `value`
+static bool gl_state_changed(GLuint *cached, GLuint value) {
+    if (*cached == value) {
+        state.gl.elided++;
+        return false;
+    }
+    *cached = value;
+    state.gl.issued++;
+    return true;
+}
+
+static void gl_use_program(GLuint program) {
+    if (gl_state_changed(&state.gl.program, program)) glUseProgram(program);
+}
+
+static void gl_bind_vertex_array(GLuint vao) {
+    if (gl_state_changed(&state.gl.vao, vao)) {
+        glBindVertexArray(vao);
+        state.gl.element_buffer = GL_STATE_UNKNOWN;
+    }
+}
+
+// GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+static void gl_bind_buffer(GLenum target, GLuint buffer) {
+    GLuint *cached = target == GL_ELEMENT_ARRAY_BUFFER ? &state.gl.element_buffer : &state.gl.array_buffer;
+    if (gl_state_changed(cached, buffer)) glBindBuffer(target, buffer);
+}
+
+// Deleting a bound buffer or VAO unbinds it
+static void gl_delete_buffer(GLuint buffer) {
+    glDeleteBuffers(1, &buffer);
+    if (state.gl.array_buffer == buffer) state.gl.array_buffer = 0;
+    if (state.gl.element_buffer == buffer) state.gl.element_buffer = 0;
+}
+
+static void gl_delete_vertex_array(GLuint vao) {
+    glDeleteVertexArrays(1, &vao);
+    if (state.gl.vao == vao) state.gl.vao = 0;
+}
+
+static void gl_set_blend(bool enabled) {
+    if (!gl_state_changed(&state.gl.blend, enabled)) return;
+    if (enabled) {
+        glEnable(GL_BLEND);
+    } else {
+        glDisable(GL_BLEND);
+    }
+}
+
+static void gl_blend_func(GLenum src, GLenum dst) {
+    if (state.gl.blend_src == src && state.gl.blend_dst == dst) {
+        state.gl.elided++;
+        return;
+    }
+    state.gl.blend_src = src;
+    state.gl.blend_dst = dst;
+    state.gl.issued++;
+    glBlendFunc(src, dst);
+}
+
+static void gl_set_scissor(bool enabled) {
+    if (!gl_state_changed(&state.gl.scissor, enabled)) return;
+    if (enabled) {
+        glEnable(GL_SCISSOR_TEST);
+    } else {
+        glDisable(GL_SCISSOR_TEST);
+    }
+}
+
+static void gl_scissor(GLint x, GLint y, GLint w, GLint h) {
+    GLint *box = state.gl.scissor_box;
+    if (box[0] == x && box[1] == y && box[2] == w && box[3] == h) {
+        state.gl.elided++;
+        return;
+    }
+    box[0] = x;
+    box[1] = y;
+    box[2] = w;
+    box[3] = h;
+    state.gl.issued++;
+    glScissor(x, y, w, h);
+}
+
+static void gl_stream_init(Stream *stream, GLenum target, GLsizeiptr region_size, bool persistent) {
+    stream->region_size = region_size;
+    glGenBuffers(1, &stream->buffer);
+    gl_bind_buffer(target, stream->buffer);
+    if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, BATCH_REGIONS * region_size, NULL, flags);
+        stream->mapped = (unsigned char *)glMapBufferRange(target, 0, BATCH_REGIONS * region_size, flags);
+    } else {
+        glBufferData(target, region_size, NULL, GL_STREAM_DRAW);
+        stream->data = (unsigned char *)malloc(region_size);
+    }
+}
+
+// Orphans the buffer and uploads what was staged; persistent streams
+// were written in place
+static void gl_stream_upload(Stream *stream, GLenum target, bool persistent) {
+    if (persistent) return;
+    gl_bind_buffer(target, stream->buffer);
+    glBufferData(target, stream->region_size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, stream->used, stream->data);
+}
+
+// Byte offset of the next draw's data within the buffer
+static GLsizeiptr gl_stream_offset(Batch *b, Stream *stream) {
+    return b->persistent ? b->region * stream->region_size + stream->start : 0;
+}
+
+// Points the batch at the next region, first waiting for the GPU to finish
+// the draw that last read it
+static void gl_batch_begin_region(Batch *b) {
+    if (b->persistent) {
+        GLsync fence = b->fences[b->region];
+        if (fence) {
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+            }
+            glDeleteSync(fence);
+            b->fences[b->region] = 0;
+        }
+        Stream *streams[] = {&b->vertices, &b->indices, &b->rects};
+        for (int i = 0; i < 3; i++) {
+            streams[i]->data = streams[i]->mapped + b->region * streams[i]->region_size;
+        }
+    }
+    Stream *streams[] = {&b->vertices, &b->indices, &b->rects};
+    for (int i = 0; i < 3; i++) {
+        streams[i]->start = 0;
+        streams[i]->used = 0;
+    }
+}
+
+static bool gl_batch_init(Batch *b) {
+    memset(b, 0, sizeof(*b));
+    b->persistent = GLEW_ARB_buffer_storage;
+
+    glGenVertexArrays(1, &b->triangle_vao);
+    gl_bind_vertex_array(b->triangle_vao);
+    gl_stream_init(&b->vertices, GL_ARRAY_BUFFER, BATCH_MAX_VERTICES * sizeof(Vertex), b->persistent);
+    gl_stream_init(&b->indices, GL_ELEMENT_ARRAY_BUFFER, BATCH_MAX_INDICES * sizeof(GLuint), b->persistent);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, x));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void *)offsetof(Vertex, color));
+
+    // The rect attributes point into the current region, so they are set
+    // at each flush
+    glGenVertexArrays(1, &b->rect_vao);
+    gl_bind_vertex_array(b->rect_vao);
+    gl_stream_init(&b->rects, GL_ARRAY_BUFFER, BATCH_MAX_RECTS * sizeof(VertInput), b->persistent);
+
+    if (b->persistent && (!b->vertices.mapped || !b->indices.mapped || !b->rects.mapped)) {
+        printf("Error mapping the batch buffers\n");
+        return false;
+    }
+    printf("Batching with %s\n", b->persistent ? "persistently mapped buffers" : "buffer orphaning");
+
+    gl_batch_begin_region(b);
+    return true;
+}
+
+static void gl_batch_free(Batch *b) {
+    for (int i = 0; i < BATCH_REGIONS; i++) {
+        if (b->fences[i]) glDeleteSync(b->fences[i]);
+    }
+    Stream *streams[] = {&b->vertices, &b->indices, &b->rects};
+    for (int i = 0; i < 3; i++) {
+        if (!b->persistent) free(streams[i]->data);
+        gl_delete_buffer(streams[i]->buffer);
+    }
+    gl_delete_vertex_array(b->triangle_vao);
+    gl_delete_vertex_array(b->rect_vao);
+    memset(b, 0, sizeof(*b));
+}
+
+static void gl_meshes_init(MeshBatch *mb) {
+    memset(mb, 0, sizeof(*mb));
+    mb->indirect = state.mesh_program_id != 0;
+
+    glGenVertexArrays(1, &mb->vao);
+    gl_bind_vertex_array(mb->vao);
+    glGenBuffers(1, &mb->vertices);
+    gl_bind_buffer(GL_ARRAY_BUFFER, mb->vertices);
+    glBufferData(GL_ARRAY_BUFFER, MESH_MAX_VERTICES * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+    glGenBuffers(1, &mb->indices);
+    gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mb->indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, MESH_MAX_INDICES * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, x));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void *)offsetof(Vertex, color));
+
+    glGenBuffers(1, &mb->draw_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, mb->draw_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(mb->draw_data), NULL, GL_STREAM_DRAW);
+    glGenTextures(1, &mb->draw_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, mb->draw_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mb->draw_buffer);
+
+    if (mb->indirect) {
+        glGenBuffers(1, &mb->commands);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mb->commands);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(mb->command_data), NULL, GL_STREAM_DRAW);
+    }
+    printf("Drawing meshes with %s\n", mb->indirect ? "glMultiDrawElementsIndirect" : "one draw call each");
+}
+
+static void gl_meshes_free(MeshBatch *mb) {
+    gl_delete_buffer(mb->vertices);
+    gl_delete_buffer(mb->indices);
+    glDeleteBuffers(1, &mb->draw_buffer);
+    glDeleteBuffers(1, &mb->commands);
+    glDeleteTextures(1, &mb->draw_texture);
+    gl_delete_vertex_array(mb->vao);
+    memset(mb, 0, sizeof(*mb));
+}
+
+// Copies a mesh into the shared buffers; returns its id for gl_draw_mesh,
+// or -1 when the buffers are full
+int gl_mesh_create(const Vertex vertex_data[], int vertex_count, const GLuint index_data[], int index_count) {
+    MeshBatch *mb = &state.meshes;
+    if (mb->mesh_count == MESH_MAX_MESHES || mb->vertex_count + vertex_count > MESH_MAX_VERTICES ||
+        mb->index_count + index_count > MESH_MAX_INDICES) {
+        printf("Error: no room for a mesh of %d vertices, %d indices\n", vertex_count, index_count);
+        return -1;
+    }
+    Mesh *mesh = &mb->meshes[mb->mesh_count];
+    mesh->first_index = mb->index_count;
+    mesh->index_count = index_count;
+    mesh->base_vertex = mb->vertex_count;
+
+    gl_bind_vertex_array(mb->vao);
+    gl_bind_buffer(GL_ARRAY_BUFFER, mb->vertices);
+    glBufferSubData(GL_ARRAY_BUFFER, mb->vertex_count * sizeof(Vertex), vertex_count * sizeof(Vertex), vertex_data);
+    gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mb->indices);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, mb->index_count * sizeof(GLuint), index_count * sizeof(GLuint), index_data);
+    mb->vertex_count += vertex_count;
+    mb->index_count += index_count;
+    return mb->mesh_count++;
+}
+
+static void gl_meshes_flush(MeshBatch *mb, const float *projection) {
+    glBindBuffer(GL_TEXTURE_BUFFER, mb->draw_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(mb->draw_data), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, mb->draw_count * sizeof(MeshDraw), mb->draw_data);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, mb->draw_texture);
+    gl_bind_vertex_array(mb->vao);
+
+    if (mb->indirect) {
+        gl_use_program(state.mesh_program_id);
+        glUniformMatrix4fv(state.mesh_projection, 1, GL_FALSE, projection);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mb->commands);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(mb->command_data), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, mb->draw_count * sizeof(DrawElementsIndirectCommand), mb->command_data);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, mb->draw_count, 0);
+        state.batch.draw_calls++;
+    } else {
+        gl_use_program(state.mesh_fallback_program_id);
+        glUniformMatrix4fv(state.mesh_fallback_projection, 1, GL_FALSE, projection);
+        for (int i = 0; i < mb->draw_count; i++) {
+            const DrawElementsIndirectCommand *command = &mb->command_data[i];
+            glUniform1i(state.mesh_fallback_draw_id, i);
+            glDrawElementsBaseVertex(GL_TRIANGLES, command->count, GL_UNSIGNED_INT,
+                                     (void *)(command->first_index * sizeof(GLuint)), command->base_vertex);
+        }
+        state.batch.draw_calls += mb->draw_count;
+    }
+    mb->draw_count = 0;
+}
+
+// Pixel to clip space, y down
+static void gl_projection(float *m) {
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = 2.0f / state.window_width;
+    m[5] = -2.0f / state.window_height;
+    m[10] = 1.0f;
+    m[12] = -1.0f;
+    m[13] = 1.0f;
+    m[15] = 1.0f;
+}
+
+// Draws everything batched so far in one call
+void gl_batch_flush(Batch *b) {
+    if (b->mode == BATCH_EMPTY) return;
+    float projection[16];
+    gl_projection(projection);
+    gl_set_blend(true);
+    gl_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    if (b->mode == BATCH_TRIANGLES) {
+        gl_use_program(state.tri_program_id);
+        glUniformMatrix4fv(state.tri_projection, 1, GL_FALSE, projection);
+        gl_bind_vertex_array(b->triangle_vao);
+        gl_stream_upload(&b->vertices, GL_ARRAY_BUFFER, b->persistent);
+        gl_stream_upload(&b->indices, GL_ELEMENT_ARRAY_BUFFER, b->persistent);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)((b->indices.used - b->indices.start) / sizeof(GLuint)), GL_UNSIGNED_INT,
+                                 (void *)gl_stream_offset(b, &b->indices),
+                                 (GLint)(gl_stream_offset(b, &b->vertices) / sizeof(Vertex)));
+    } else if (b->mode == BATCH_MESHES) {
+        gl_meshes_flush(&state.meshes, projection);
+        b->mode = BATCH_EMPTY;
+        return;
+    } else {
+        gl_use_program(state.rect_program_id);
+        glUniform2f(state.rect_screen_size, state.window_width, state.window_height);
+        gl_bind_vertex_array(b->rect_vao);
+        gl_stream_upload(&b->rects, GL_ARRAY_BUFFER, b->persistent);
+        gl_bind_buffer(GL_ARRAY_BUFFER, b->rects.buffer);
+        draw_gl_set_attributes((size_t)gl_stream_offset(b, &b->rects));
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)((b->rects.used - b->rects.start) / sizeof(VertInput)));
+    }
+    b->draw_calls++;
+
+    // The next draw carries on in the same region; staging arrays start over
+    Stream *streams[] = {&b->vertices, &b->indices, &b->rects};
+    for (int i = 0; i < 3; i++) {
+        if (!b->persistent) streams[i]->used = 0;
+        streams[i]->start = streams[i]->used;
+    }
+    b->mode = BATCH_EMPTY;
+}
+
+// Fences the current region and moves on to the next
+static void gl_batch_next_region(Batch *b) {
+    if (b->persistent) {
+        b->fences[b->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        b->region = (b->region + 1) % BATCH_REGIONS;
+    }
+    gl_batch_begin_region(b);
+}
+
+// Draws what is left and retires the frame's region; call before swapping
+void gl_batch_end_frame(Batch *b) {
+    gl_batch_flush(b);
+    gl_batch_next_region(b);
+}
+
+// Switching between triangles and rects flushes, to keep draw order
+static void gl_batch_set_mode(Batch *b, BatchMode mode) {
+    if (b->mode != mode) {
+        gl_batch_flush(b);
+        b->mode = mode;
+    }
+}
+
+// Room for `vertex_count` vertices and `index_count` indices, flushing
+// first if they don't fit. Indices the caller writes are offset by *base.
+static Vertex *gl_batch_reserve(Batch *b, int vertex_count, int index_count, GLuint **indices, GLuint *base) {
+    if (vertex_count > BATCH_MAX_VERTICES || index_count > BATCH_MAX_INDICES) {
+        printf("Error: %d vertices, %d indices don't fit in a batch\n", vertex_count, index_count);
+        return NULL;
+    }
+    gl_batch_set_mode(b, BATCH_TRIANGLES);
+    GLsizeiptr vertex_bytes = vertex_count * sizeof(Vertex), index_bytes = index_count * sizeof(GLuint);
+    if (b->vertices.used + vertex_bytes > b->vertices.region_size || b->indices.used + index_bytes > b->indices.region_size) {
+        gl_batch_flush(b);
+        gl_batch_next_region(b);
+        b->mode = BATCH_TRIANGLES;
+    }
+    Vertex *vertices = (Vertex *)(b->vertices.data + b->vertices.used);
+    *indices = (GLuint *)(b->indices.data + b->indices.used);
+    *base = (GLuint)((b->vertices.used - b->vertices.start) / sizeof(Vertex));
+    b->vertices.used += vertex_bytes;
+    b->indices.used += index_bytes;
+    b->uploaded += vertex_bytes + index_bytes;
+    return vertices;
+}
+
+// Clips everything drawn after this to a rect in pixels, until
+// gl_clear_clip. Flushes what was drawn under the old clip.
+void gl_set_clip(float x, float y, float w, float h) {
+    gl_batch_flush(&state.batch);
+    gl_set_scissor(true);
+    gl_scissor((GLint)x, (GLint)(state.window_height - y - h), (GLint)w, (GLint)h);
+}
+
+void gl_clear_clip() {
+    gl_batch_flush(&state.batch);
+    gl_set_scissor(false);
+}
+
+// Draws mesh `mesh` scaled by (scale_x, scale_y) and moved to (x, y),
+// with its vertex colors multiplied by `color`
+void gl_draw_mesh(int mesh, float x, float y, float scale_x, float scale_y, Color color) {
+    MeshBatch *mb = &state.meshes;
+    if (mesh < 0 || mesh >= mb->mesh_count) return;
+    gl_batch_set_mode(&state.batch, BATCH_MESHES);
+    if (mb->draw_count == MESH_MAX_DRAWS) {
+        gl_batch_flush(&state.batch);
+        state.batch.mode = BATCH_MESHES;
+    }
+    const Mesh *m = &mb->meshes[mesh];
+    mb->command_data[mb->draw_count] = (DrawElementsIndirectCommand){m->index_count, 1, m->first_index, m->base_vertex, 0};
+    mb->draw_data[mb->draw_count] = (MeshDraw){
+        x, y, scale_x, scale_y,
+        {color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f},
+    };
+    mb->draw_count++;
+    state.batch.uploaded += sizeof(MeshDraw) + (mb->indirect ? sizeof(DrawElementsIndirectCommand) : 0);
+}
+
+// Room for up to `count` rects, fewer when the region fills up first
+static VertInput *gl_batch_reserve_rects(Batch *b, int count, int *reserved) {
+    gl_batch_set_mode(b, BATCH_RECTS);
+    if (b->rects.used + (GLsizeiptr)sizeof(VertInput) > b->rects.region_size) {
+        gl_batch_flush(b);
+        gl_batch_next_region(b);
+        b->mode = BATCH_RECTS;
+    }
+    int room = (int)((b->rects.region_size - b->rects.used) / sizeof(VertInput));
+    *reserved = count < room ? count : room;
+    VertInput *rects = (VertInput *)(b->rects.data + b->rects.used);
+    b->rects.used += *reserved * sizeof(VertInput);
+    b->uploaded += *reserved * sizeof(VertInput);
+    return rects;
+}
+
+static void gl_profiler_init(Profiler *p) {
+    memset(p, 0, sizeof(*p));
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    if (bits == 0) {
+        printf("GL_TIMESTAMP queries unsupported, GPU profiler disabled\n");
+        return;
+    }
+    for (int i = 0; i < PROFILER_FRAMES; i++) {
+        glGenQueries(2 * PROFILER_MAX_RECORDS, p->frames[i].queries);
+    }
+    p->enabled = true;
+}
+
+static void gl_profiler_free(Profiler *p) {
+    if (p->enabled) {
+        for (int i = 0; i < PROFILER_FRAMES; i++) {
+            glDeleteQueries(2 * PROFILER_MAX_RECORDS, p->frames[i].queries);
+        }
+    }
+    memset(p, 0, sizeof(*p));
+}
+
+// Flushes the batch so the scope covers what was drawn before it ends.
+// `name` must outlive the profiler; scopes are matched by name.
+void gl_profile_begin(const char *name) {
+    Profiler *p = &state.profiler;
+    if (!p->enabled) return;
+    if (p->depth >= PROFILER_MAX_DEPTH) {
+        p->depth++; // too deep to record, only kept for the matching end
+        return;
+    }
+    ProfilerFrame *frame = &p->frames[p->frame];
+    int scope = 0;
+    while (scope < p->scope_count && strcmp(p->scopes[scope].name, name) != 0) scope++;
+    if (scope == PROFILER_MAX_SCOPES || frame->count == PROFILER_MAX_RECORDS) {
+        p->stack[p->depth++] = -1;
+        return;
+    }
+    if (scope == p->scope_count) p->scopes[p->scope_count++].name = name;
+    gl_batch_flush(&state.batch);
+    frame->scopes[frame->count] = scope;
+    glQueryCounter(frame->queries[2 * frame->count], GL_TIMESTAMP);
+    p->stack[p->depth++] = frame->count++;
+}
+
+void gl_profile_end() {
+    Profiler *p = &state.profiler;
+    if (!p->enabled || p->depth == 0) return;
+    p->depth--;
+    if (p->depth >= PROFILER_MAX_DEPTH || p->stack[p->depth] < 0) return;
+    gl_batch_flush(&state.batch);
+    glQueryCounter(p->frames[p->frame].queries[2 * p->stack[p->depth] + 1], GL_TIMESTAMP);
+}
+
+// Call once per frame after the last scope ends. Reads back the oldest
+// frame's queries, which the next frame reuses.
+void gl_profiler_frame_end() {
+    Profiler *p = &state.profiler;
+    if (!p->enabled) return;
+    p->depth = 0;
+    p->frame = (p->frame + 1) % PROFILER_FRAMES;
+    ProfilerFrame *frame = &p->frames[p->frame];
+    for (int i = 0; i < frame->count; i++) {
+        GLint available = 0;
+        glGetQueryObjectiv(frame->queries[2 * i + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            p->dropped++;
+            continue;
+        }
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(frame->queries[2 * i], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame->queries[2 * i + 1], GL_QUERY_RESULT, &end);
+        ProfilerScope *scope = &p->scopes[frame->scopes[i]];
+        scope->history[scope->next] = (float)((end - begin) / 1e6);
+        scope->next = (scope->next + 1) % PROFILER_HISTORY;
+        if (scope->samples < PROFILER_HISTORY) scope->samples++;
+    }
+    frame->count = 0;
+}
+
+// Grows an array to hold `count` more items
+#define FRAME_RESERVE(array, size, capacity, count) \
+    do { \
+        if ((size) + (count) > (capacity)) { \
+            (capacity) = (capacity) ? (capacity) * 2 : 256; \
+            if ((capacity) < (size) + (count)) (capacity) = (size) + (count); \
+            (array) = (decltype(array))realloc((array), (capacity) * sizeof(*(array))); \
+        } \
+    } while (0)
+
+static void frame_packet_reset(FramePacket *packet) {
+    packet->clear_color = {0, 0, 0, 255};
+    packet->flags = 0;
+    packet->command_count = 0;
+    if (!packet->rects.data) packet->rects = make_vert_store();
+    vert_clear(&packet->rects);
+    packet->vertex_count = 0;
+    packet->index_count = 0;
+    packet->presented = false;
+}
+
+static void frame_packet_free(FramePacket *packet) {
+    free(packet->commands);
+    free_vert_store(&packet->rects);
+    free(packet->vertices);
+    free(packet->indices);
+    memset(packet, 0, sizeof(*packet));
+}
+
+void frame_draw_rect(FramePacket *packet, float x, float y, float w, float h, Color color) {
+    FrameCommand *last = packet->command_count ? &packet->commands[packet->command_count - 1] : NULL;
+    if (!last || last->type != FRAME_RECTS) {
+        FRAME_RESERVE(packet->commands, packet->command_count, packet->command_capacity, 1);
+        last = &packet->commands[packet->command_count++];
+        *last = (FrameCommand){FRAME_RECTS, packet->rects.size, 0, 0, 0};
+    }
+    draw_rect(&packet->rects, (Rect){x, y, w, h}, gl_color(color));
+    last->count++;
+}
+
+void frame_draw_triangles(FramePacket *packet, const Vertex vertex_data[], const GLuint index_data[], int vertex_count, int triangle_count) {
+    FRAME_RESERVE(packet->commands, packet->command_count, packet->command_capacity, 1);
+    FRAME_RESERVE(packet->vertices, packet->vertex_count, packet->vertex_capacity, vertex_count);
+    FRAME_RESERVE(packet->indices, packet->index_count, packet->index_capacity, 3 * triangle_count);
+    packet->commands[packet->command_count++] =
+        (FrameCommand){FRAME_TRIANGLES, packet->vertex_count, vertex_count, packet->index_count, 3 * triangle_count};
+    memcpy(packet->vertices + packet->vertex_count, vertex_data, vertex_count * sizeof(Vertex));
+    memcpy(packet->indices + packet->index_count, index_data, 3 * triangle_count * sizeof(GLuint));
+    packet->vertex_count += vertex_count;
+    packet->index_count += 3 * triangle_count;
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_u32_be(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void png_chunk(FILE *f, const char *type, const unsigned char *data, uint32_t len) {
+    unsigned char header[8];
+    put_u32_be(header, len);
+    memcpy(header + 4, type, 4);
+    fwrite(header, 8, 1, f);
+    if (len) fwrite(data, len, 1, f);
+    unsigned char crc[4];
+    put_u32_be(crc, crc32_update(crc32_update(0, header + 4, 4), data, len));
+    fwrite(crc, 4, 1, f);
+}
+
+// RGBA PNG with the image data in stored (uncompressed) deflate blocks,
+// which keeps the encoder dependency free; rows are flipped to top first
+static bool write_png(const char *path, const unsigned char *pixels, int width, int height) {
+    if (width <= 0 || height <= 0) return false;
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    size_t row = 1 + (size_t)width * 4;
+    size_t raw_size = row * height;
+    unsigned char *raw = (unsigned char *)malloc(raw_size);
+    for (int y = 0; y < height; y++) {
+        raw[y * row] = 0; // no filter
+        memcpy(raw + y * row + 1, pixels + (size_t)(height - 1 - y) * width * 4, (size_t)width * 4);
+    }
+
+    size_t blocks = (raw_size + 65534) / 65535;
+    size_t zlib_size = 2 + blocks * 5 + raw_size + 4;
+    unsigned char *zlib = (unsigned char *)malloc(zlib_size);
+    unsigned char *out = zlib;
+    *out++ = 0x78;
+    *out++ = 0x01;
+    uint32_t a = 1, b = 0; // Adler-32
+    for (size_t done = 0; done < raw_size;) {
+        size_t len = raw_size - done < 65535 ? raw_size - done : 65535;
+        *out++ = done + len == raw_size;
+        *out++ = len & 0xff;
+        *out++ = len >> 8;
+        *out++ = ~len & 0xff;
+        *out++ = (~len >> 8) & 0xff;
+        memcpy(out, raw + done, len);
+        for (size_t i = 0; i < len; i++) {
+            a = (a + raw[done + i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        out += len;
+        done += len;
+    }
+    put_u32_be(out, (b << 16) | a);
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    unsigned char ihdr[13] = {};
+    put_u32_be(ihdr, width);
+    put_u32_be(ihdr + 4, height);
+    ihdr[8] = 8; // bits per channel
+    ihdr[9] = 6; // RGBA
+    fwrite(signature, 8, 1, f);
+    png_chunk(f, "IHDR", ihdr, 13);
+    png_chunk(f, "IDAT", zlib, (uint32_t)zlib_size);
+    png_chunk(f, "IEND", NULL, 0);
+    free(zlib);
+    free(raw);
+    return fclose(f) == 0;
+}
+
+static void capture_encode(Capture *c, CaptureJob *job) {
+    if (job->kinds & CAPTURE_SCREENSHOT) {
+        char path[64];
+        snprintf(path, sizeof(path), "screenshot-%04d.png", c->screenshots++);
+        if (write_png(path, job->pixels, job->width, job->height)) {
+            printf("Saved %s\n", path);
+        } else {
+            printf("Error writing %s\n", path);
+        }
+    }
+    if ((job->kinds & CAPTURE_VIDEO) && c->video) {
+        // Raw video has one size; frames from after a resize are skipped
+        if (job->width == c->video_width && job->height == c->video_height) {
+            size_t row = (size_t)job->width * 4;
+            for (int y = job->height - 1; y >= 0; y--) {
+                fwrite(job->pixels + y * row, row, 1, c->video);
+            }
+        }
+    }
+    free(job->pixels);
+}
+
+static int capture_thread(void *data) {
+    Capture *c = (Capture *)data;
+    SDL_LockMutex(c->lock);
+    for (;;) {
+        while (c->count == 0 && !c->quit) SDL_CondWait(c->cond, c->lock);
+        if (c->count == 0) break;
+        CaptureJob job = c->queue[c->head];
+        c->head = (c->head + 1) % CAPTURE_QUEUE;
+        c->count--;
+        c->busy = true;
+        SDL_UnlockMutex(c->lock);
+        capture_encode(c, &job);
+        SDL_LockMutex(c->lock);
+        c->busy = false;
+        SDL_CondBroadcast(c->cond);
+    }
+    SDL_UnlockMutex(c->lock);
+    return 0;
+}
+
+static bool gl_capture_init(Capture *c) {
+    memset(c, 0, sizeof(*c));
+    glGenBuffers(CAPTURE_FRAMES, c->pbos);
+    c->lock = SDL_CreateMutex();
+    c->cond = SDL_CreateCond();
+    c->thread = SDL_CreateThread(capture_thread, "capture", c);
+    if (!c->lock || !c->cond || !c->thread) {
+        printf("Error starting the capture thread: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+// Maps a slot's finished readback and hands a copy to the encoder
+static void gl_capture_collect(Capture *c, int slot) {
+    if (!c->fences[slot]) return;
+    while (glClientWaitSync(c->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+    }
+    glDeleteSync(c->fences[slot]);
+    c->fences[slot] = 0;
+
+    SDL_LockMutex(c->lock);
+    bool full = c->count == CAPTURE_QUEUE;
+    SDL_UnlockMutex(c->lock);
+    if (full) {
+        c->dropped++;
+        return;
+    }
+    GLsizeiptr size = (GLsizeiptr)c->widths[slot] * c->heights[slot] * 4;
+    CaptureJob job = {(unsigned char *)malloc(size), c->widths[slot], c->heights[slot], c->kinds[slot]};
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbos[slot]);
+    void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(job.pixels, mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!mapped) {
+        free(job.pixels);
+        return;
+    }
+
+    SDL_LockMutex(c->lock);
+    c->queue[(c->head + c->count) % CAPTURE_QUEUE] = job;
+    c->count++;
+    SDL_CondBroadcast(c->cond);
+    SDL_UnlockMutex(c->lock);
+}
+
+// Call after the frame is drawn and before the swap
+void gl_capture_frame() {
+    // A minimized window has no pixels to read; leave the ring and any
+    // pending screenshot alone until it has an area again
+    if ((int)state.window_width <= 0 || (int)state.window_height <= 0) return;
+    Capture *c = &state.capture;
+    int kinds = (c->screenshot ? CAPTURE_SCREENSHOT : 0) | (c->recording ? CAPTURE_VIDEO : 0);
+    int oldest = (c->slot + 1) % CAPTURE_FRAMES;
+    gl_capture_collect(c, oldest);
+    if (kinds) {
+        int slot = c->slot;
+        int width = (int)state.window_width, height = (int)state.window_height;
+        GLsizeiptr size = (GLsizeiptr)width * height * 4;
+        gl_batch_flush(&state.batch);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbos[slot]);
+        if (c->sizes[slot] != size) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            c->sizes[slot] = size;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        c->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        c->widths[slot] = width;
+        c->heights[slot] = height;
+        c->kinds[slot] = kinds;
+        c->screenshot = false;
+    }
+    c->slot = oldest;
+}
+
+// Raw RGBA frames, top row first, at the current window size
+bool gl_capture_start_recording(const char *path) {
+    Capture *c = &state.capture;
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        printf("Error opening %s\n", path);
+        return false;
+    }
+    SDL_LockMutex(c->lock);
+    c->video = f;
+    c->video_width = (int)state.window_width;
+    c->video_height = (int)state.window_height;
+    SDL_UnlockMutex(c->lock);
+    c->recording = true;
+    printf("Recording to %s, play with: ffplay -f rawvideo -pixel_format rgba -video_size %dx%d %s\n",
+           path, c->video_width, c->video_height, path);
+    return true;
+}
+
+// Frames still in flight are written before the file is closed
+void gl_capture_stop_recording() {
+    Capture *c = &state.capture;
+    c->recording = false;
+    for (int i = 0; i < CAPTURE_FRAMES; i++) {
+        gl_capture_collect(c, (c->slot + i) % CAPTURE_FRAMES);
+    }
+    SDL_LockMutex(c->lock);
+    while (c->count > 0 || c->busy) SDL_CondWait(c->cond, c->lock);
+    if (c->video) {
+        fclose(c->video);
+        c->video = NULL;
+    }
+    SDL_UnlockMutex(c->lock);
+    if (c->dropped) printf("Capture dropped %d frames\n", c->dropped);
+    c->dropped = 0;
+}
+
+static void gl_capture_free(Capture *c) {
+    for (int i = 0; i < CAPTURE_FRAMES; i++) {
+        gl_capture_collect(c, (c->slot + i) % CAPTURE_FRAMES);
+    }
+    if (c->thread) {
+        SDL_LockMutex(c->lock);
+        c->quit = true;
+        SDL_CondBroadcast(c->cond);
+        SDL_UnlockMutex(c->lock);
+        SDL_WaitThread(c->thread, NULL);
+    }
+    if (c->video) fclose(c->video);
+    glDeleteBuffers(CAPTURE_FRAMES, c->pbos);
+    SDL_DestroyCond(c->cond);
+    SDL_DestroyMutex(c->lock);
+    memset(c, 0, sizeof(*c));
+}
+
 bool app_init() {
 
     // Window
@@ -146,69 +1418,128 @@ bool app_init() {
 
 
     glEnable(GL_MULTISAMPLE);
+    gl_state_reset();
 
     // GL Programs
+    gl_program_cache_init();
+    Uint64 programs_start = SDL_GetPerformanceCounter();
     state.tri_program_id = gl_create_program(TRI_VERT_SRC, TRI_FRAG_SRC);
     if (!state.tri_program_id) {
         return false;
     }
+    state.tri_projection = glGetUniformLocation(state.tri_program_id, "projection");
+    state.rect_program_id = gl_create_program(draw_gl_vertex_source, draw_gl_fragment_source);
+    if (!state.rect_program_id) {
+        return false;
+    }
+    state.rect_screen_size = glGetUniformLocation(state.rect_program_id, "screen_size");
     state.basic_program_id = gl_create_program(BASIC_VERT_SRC, BASIC_FRAG_SRC);
     if (!state.tri_program_id) {
         return false;
     }
+    state.mesh_fallback_program_id = gl_create_program(MESH_FALLBACK_VERT_SRC, TRI_FRAG_SRC);
+    if (!state.mesh_fallback_program_id) {
+        return false;
+    }
+    state.mesh_fallback_projection = glGetUniformLocation(state.mesh_fallback_program_id, "projection");
+    state.mesh_fallback_draw_id = glGetUniformLocation(state.mesh_fallback_program_id, "draw_id");
+    int program_count = 5;
+    if (GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_draw_parameters) {
+        // Falls back on a compile failure too
+        state.mesh_program_id = gl_create_program(MESH_VERT_SRC, TRI_FRAG_SRC);
+        state.mesh_projection = glGetUniformLocation(state.mesh_program_id, "projection");
+        program_count++;
+    }
+
+    // Run twice to compare a cold start (compiled) with a warm one (cached)
+    printf("Created programs in %.2f ms, %d of %d from the binary cache\n",
+           (SDL_GetPerformanceCounter() - programs_start) * 1000.0 / SDL_GetPerformanceFrequency(), state.programs_cached,
+           program_count);
+
+    glGenVertexArrays(1, &state.unbatched_vao);
+    if (!gl_batch_init(&state.batch)) {
+        return false;
+    }
+    gl_meshes_init(&state.meshes);
+    gl_profiler_init(&state.profiler);
+    if (!gl_capture_init(&state.capture)) {
+        return false;
+    }
 
     return true;
 }
 
-void app_update() {
+// The window size goes to the render side through the packet
+void app_update(FramePacket *packet) {
     int w, h;
     SDL_GetWindowSize(state.window, &w, &h);
-    state.window_width = (float)w;
-    state.window_height = (float)h;
+    packet->window_width = (float)w;
+    packet->window_height = (float)h;
 }
 
 void app_quit() {
+    gl_batch_free(&state.batch);
+    gl_meshes_free(&state.meshes);
+    gl_profiler_free(&state.profiler);
+    gl_capture_free(&state.capture);
+    for (int i = 0; i < FRAME_PACKETS; i++) frame_packet_free(&state.frames.packets[i]);
+    gl_delete_vertex_array(state.unbatched_vao);
     glDeleteProgram(state.tri_program_id);
+    glDeleteProgram(state.rect_program_id);
+    glDeleteProgram(state.basic_program_id);
+    glDeleteProgram(state.mesh_program_id);
+    glDeleteProgram(state.mesh_fallback_program_id);
+    SDL_free(state.program_cache_dir);
     SDL_DestroyWindow(state.window);
     state.window = NULL;
     SDL_Quit();
 }
 
-float gl_x(float x) {
-    return -1.0f + 2.0f * x / state.window_width;
-}
-
-float gl_y(float y) {
-    return 1.0f - 2.0f * y / state.window_height;
+// Appends triangles to the batch
+void gl_draw_triangles(const Vertex vertex_data[], const GLuint index_data[], int vertex_count, int triangle_count) {
+    GLuint *indices, base;
+    Vertex *vertices = gl_batch_reserve(&state.batch, vertex_count, 3 * triangle_count, &indices, &base);
+    if (!vertices) return;
+    memcpy(vertices, vertex_data, vertex_count * sizeof(Vertex));
+    for (int i = 0; i < 3 * triangle_count; i++) {
+        indices[i] = index_data[i] + base;
+    }
 }
 
-void gl_draw_triangles(GLfloat vertex_data[], GLuint index_data[], int vertex_count, int triangle_count) {
+// The original path, one buffer pair and draw call per call with 24 bytes
+// of floats per vertex, kept to compare against in --bench. Unlike the
+// original it deletes its buffers.
+void gl_draw_triangles_unbatched(GLfloat vertex_data[], GLuint index_data[], int vertex_count, int triangle_count) {
     GLuint vbo, ibo;
     GLint vertex_pos_location = -1, vertex_color_location = -1;
+    gl_bind_vertex_array(state.unbatched_vao);
     glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, 6 * vertex_count * sizeof(GLfloat), vertex_data, GL_STATIC_DRAW);
 
     glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, 3 * triangle_count * sizeof(GLuint), index_data, GL_STATIC_DRAW);
+    state.batch.uploaded += (6 * vertex_count * sizeof(GLfloat)) + 3 * triangle_count * sizeof(GLuint);
+    state.batch.draw_calls++;
 
     vertex_pos_location = glGetAttribLocation(state.tri_program_id, "position");
     vertex_color_location = glGetAttribLocation(state.tri_program_id, "color");
-    if (vertex_pos_location == -1 || vertex_color_location == -1) {
-        return;
+    if (vertex_pos_location != -1 && vertex_color_location != -1) {
+        float projection[16];
+        gl_projection(projection);
+        gl_set_blend(true);
+        gl_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl_use_program(state.tri_program_id);
+        glUniformMatrix4fv(state.tri_projection, 1, GL_FALSE, projection);
+        glEnableVertexAttribArray(vertex_pos_location);
+        glVertexAttribPointer(vertex_pos_location, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), NULL);
+        glEnableVertexAttribArray(vertex_color_location);
+        glVertexAttribPointer(vertex_color_location, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(2*sizeof(GLfloat)));
+        glDrawElements(GL_TRIANGLES, 3 * triangle_count, GL_UNSIGNED_INT, NULL);
     }
-
-    glUseProgram(state.tri_program_id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glEnableVertexAttribArray(vertex_pos_location);
-    glVertexAttribPointer(vertex_pos_location, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), NULL);
-    glEnableVertexAttribArray(vertex_color_location);
-    glVertexAttribPointer(vertex_color_location, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(2*sizeof(GLfloat)));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glDrawElements(GL_TRIANGLES, 3 * triangle_count, GL_UNSIGNED_INT, NULL);
-    glDisableVertexAttribArray(vertex_pos_location);
-    glUseProgram(0);
+    gl_delete_buffer(vbo);
+    gl_delete_buffer(ibo);
 }
 
 void gl_draw_my_triangle() {
@@ -222,53 +1553,469 @@ void gl_draw_my_triangle() {
     };
     GLuint vbo, vao;
     glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    gl_bind_vertex_array(vao);
 
-    glUseProgram(state.basic_program_id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    gl_use_program(state.basic_program_id);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
+// Appends instances built with draw.h (rects, gradients, rounded boxes) to
+// the batch. Textured ones sample whatever is bound to unit 0.
+void gl_draw_verts(const VertInput *verts, int count) {
+    while (count > 0) {
+        int reserved;
+        VertInput *rects = gl_batch_reserve_rects(&state.batch, count, &reserved);
+        memcpy(rects, verts, reserved * sizeof(VertInput));
+        verts += reserved;
+        count -= reserved;
+    }
+}
+
 void gl_draw_rect(float x, float y, float w, float h, Color color) {
-    float x1 = gl_x(x);
-    float y1 = gl_y(y);
-    float x2 = gl_x(x + w);
-    float y2 = gl_y(y + h);
+    int reserved;
+    *gl_batch_reserve_rects(&state.batch, 1, &reserved) = (VertInput){
+        .dst_rect = {x, y, w, h},
+        .colors = {gl_color(color), gl_color(color), gl_color(color), gl_color(color)},
+    };
+}
 
+// A rect as two batched triangles, 4 vertices and 6 indices
+void gl_draw_rect_triangles(float x, float y, float w, float h, Color color) {
+    Vertex vertex_data[4] = {
+        {x, y, color},
+        {x + w, y, color},
+        {x + w, y + h, color},
+        {x, y + h, color},
+    };
+    GLuint index_data[] = { 0, 1, 2, 3, 0, 2 };
+    gl_draw_triangles(vertex_data, index_data, 4, 2);
+}
+
+void gl_draw_rect_unbatched(float x, float y, float w, float h, Color color) {
     float r = (float)color.r / 255.0f;
     float g = (float)color.g / 255.0f;
     float b = (float)color.b / 255.0f;
     float a = (float)color.a / 255.0f;
 
     GLfloat vertex_data[24] = {
-        x1, y1, r, g, b, a,
-        x2, y1, r, g, b, a,
-        x2, y2, r, g, b, a,
-        x1, y2, r, g, b, a,
+        x, y, r, g, b, a,
+        x + w, y, r, g, b, a,
+        x + w, y + h, r, g, b, a,
+        x, y + h, r, g, b, a,
     };
     GLuint index_data[] = { 0, 1, 2, 3, 0, 2 };
 
-    gl_draw_triangles(vertex_data, index_data, 4, 2);
+    gl_draw_triangles_unbatched(vertex_data, index_data, 4, 2);
+}
+
+static int compare_float(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Average and percentiles in ms over the scope's history
+typedef struct ProfilerStats {
+    float average;
+    float p50;
+    float p95;
+    float p99;
+} ProfilerStats;
+
+static ProfilerStats gl_profiler_stats(const ProfilerScope *scope) {
+    ProfilerStats stats = {};
+    if (scope->samples == 0) return stats;
+    float sorted[PROFILER_HISTORY];
+    memcpy(sorted, scope->history, scope->samples * sizeof(float));
+    qsort(sorted, scope->samples, sizeof(float), compare_float);
+    for (int i = 0; i < scope->samples; i++) stats.average += sorted[i];
+    stats.average /= scope->samples;
+    stats.p50 = sorted[(scope->samples - 1) * 50 / 100];
+    stats.p95 = sorted[(scope->samples - 1) * 95 / 100];
+    stats.p99 = sorted[(scope->samples - 1) * 99 / 100];
+    return stats;
+}
+
+void gl_profiler_print() {
+    Profiler *p = &state.profiler;
+    printf("%-16s %8s %8s %8s %8s\n", "GPU scope (ms)", "avg", "p50", "p95", "p99");
+    for (int i = 0; i < p->scope_count; i++) {
+        ProfilerStats stats = gl_profiler_stats(&p->scopes[i]);
+        printf("%-16s %8.3f %8.3f %8.3f %8.3f\n", p->scopes[i].name, stats.average, stats.p50, stats.p95, stats.p99);
+    }
+    printf("%d results dropped as not ready\n", p->dropped);
+}
+
+// One row per scope in the top left corner: a bar for the average, with
+// ticks at p95 (yellow) and p99 (red). The bars are 200 px at 1/60 s,
+// marked by the white line.
+void gl_profiler_draw_overlay() {
+    const Color palette[] = {{90, 160, 255, 255}, {120, 220, 120, 255}, {220, 140, 255, 255}, {255, 170, 90, 255}};
+    const float x = 10.0f, y = 10.0f, row = 14.0f, scale = 200.0f / (1000.0f / 60.0f);
+    Profiler *p = &state.profiler;
+    if (!p->enabled || p->scope_count == 0) return;
+    gl_draw_rect(x - 4.0f, y - 4.0f, 300.0f, p->scope_count * row + 8.0f, {0, 0, 0, 160});
+    gl_draw_rect(x + 200.0f, y - 4.0f, 1.0f, p->scope_count * row + 8.0f, {255, 255, 255, 255});
+    for (int i = 0; i < p->scope_count; i++) {
+        ProfilerStats stats = gl_profiler_stats(&p->scopes[i]);
+        float top = y + i * row;
+        gl_draw_rect(x, top, fminf(stats.average * scale, 290.0f), row - 4.0f, palette[i % 4]);
+        gl_draw_rect(x + fminf(stats.p95 * scale, 290.0f), top, 2.0f, row - 4.0f, {255, 230, 0, 255});
+        gl_draw_rect(x + fminf(stats.p99 * scale, 290.0f), top, 2.0f, row - 4.0f, {255, 40, 40, 255});
+    }
+}
+
+// Everything GL for one frame, on whichever thread owns the context
+static void app_render_frame(FramePacket *packet) {
+    if (packet->window_width != state.window_width || packet->window_height != state.window_height) {
+        state.window_width = packet->window_width;
+        state.window_height = packet->window_height;
+        glViewport(0, 0, (GLsizei)state.window_width, (GLsizei)state.window_height);
+    }
+    if (packet->flags & FRAME_TOGGLE_OVERLAY) state.profiler.overlay = !state.profiler.overlay;
+    if (packet->flags & FRAME_PRINT_PROFILE) gl_profiler_print();
+    if (packet->flags & FRAME_SCREENSHOT) state.capture.screenshot = true;
+    if (packet->flags & FRAME_TOGGLE_RECORDING) {
+        if (state.capture.recording) {
+            gl_capture_stop_recording();
+        } else {
+            gl_capture_start_recording("capture.rgba");
+        }
+    }
+    state.gl.issued = 0;
+    state.gl.elided = 0;
+
+    gl_profile_begin("frame");
+    Color clear = packet->clear_color;
+    glClearColor(clear.r / 255.0f, clear.g / 255.0f, clear.b / 255.0f, clear.a / 255.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    gl_profile_begin("scene");
+    for (int i = 0; i < packet->command_count; i++) {
+        const FrameCommand *command = &packet->commands[i];
+        if (command->type == FRAME_RECTS) {
+            gl_draw_verts(packet->rects.data + command->first, command->count);
+        } else {
+            gl_draw_triangles(packet->vertices + command->first, packet->indices + command->first_index,
+                              command->count, command->index_count / 3);
+        }
+    }
+    gl_profile_end();
+    if (state.profiler.overlay) {
+        gl_profile_begin("overlay");
+        gl_profiler_draw_overlay();
+        gl_profile_end();
+    }
+    gl_profile_end();
+    gl_batch_end_frame(&state.batch);
+    gl_profiler_frame_end();
+    gl_capture_frame();
+    SDL_GL_SwapWindow(state.window);
+
+    packet->latency_ms = (SDL_GetPerformanceCounter() - packet->input_time) * 1000.0 / SDL_GetPerformanceFrequency();
+    packet->gl_issued = state.gl.issued;
+    packet->gl_elided = state.gl.elided;
+    packet->presented = true;
+}
+
+static int render_thread(void *data) {
+    FrameQueue *q = (FrameQueue *)data;
+    SDL_GL_MakeCurrent(state.window, state.context);
+    for (;;) {
+        SDL_SemWait(q->filled);
+        FramePacket *packet = &q->packets[q->read % FRAME_PACKETS];
+        bool quit = packet->flags & FRAME_QUIT;
+        if (!quit) app_render_frame(packet);
+        q->read++;
+        SDL_SemPost(q->free);
+        if (quit) break;
+    }
+    SDL_GL_MakeCurrent(state.window, NULL);
+    return 0;
+}
+
+static void app_collect_stats(FramePacket *packet) {
+    if (!packet->presented) return;
+    state.frame_stats.frames++;
+    state.frame_stats.latency_ms += packet->latency_ms;
+    state.frame_stats.gl_issued += packet->gl_issued;
+    state.frame_stats.gl_elided += packet->gl_elided;
+    packet->presented = false;
+}
+
+// Hands the GL context to a new render thread
+static bool app_start_render_thread() {
+    FrameQueue *q = &state.frames;
+    q->filled = SDL_CreateSemaphore(0);
+    q->free = SDL_CreateSemaphore(FRAME_PACKETS);
+    SDL_GL_MakeCurrent(state.window, NULL);
+    q->thread = SDL_CreateThread(render_thread, "render", q);
+    if (!q->filled || !q->free || !q->thread) {
+        printf("Error starting the render thread: %s\n", SDL_GetError());
+        SDL_GL_MakeCurrent(state.window, state.context);
+        return false;
+    }
+    return true;
+}
+
+// The next packet to record into; with a render thread this waits while
+// FRAME_PACKETS frames are in flight
+static FramePacket *app_begin_frame() {
+    FrameQueue *q = &state.frames;
+    if (q->thread) SDL_SemWait(q->free);
+    FramePacket *packet = &q->packets[q->written % FRAME_PACKETS];
+    app_collect_stats(packet);
+    frame_packet_reset(packet);
+    return packet;
+}
+
+static void app_end_frame(FramePacket *packet) {
+    FrameQueue *q = &state.frames;
+    if (q->thread) {
+        q->written++;
+        SDL_SemPost(q->filled);
+    } else {
+        app_render_frame(packet);
+    }
+}
+
+// Waits for the frames in flight and takes the GL context back
+static void app_stop_render_thread() {
+    FrameQueue *q = &state.frames;
+    if (!q->thread) return;
+    app_begin_frame()->flags = FRAME_QUIT;
+    q->written++;
+    SDL_SemPost(q->filled);
+    SDL_WaitThread(q->thread, NULL);
+    q->thread = NULL;
+    for (int i = 0; i < FRAME_PACKETS; i++) app_collect_stats(&q->packets[i]);
+    SDL_DestroySemaphore(q->filled);
+    SDL_DestroySemaphore(q->free);
+    SDL_GL_MakeCurrent(state.window, state.context);
+}
+
+#define BENCH_STRESS_RECTS 100000
+
+typedef void (*DrawRectFn)(float x, float y, float w, float h, Color color);
+
+// Draws `frames` frames of `rects` small rects; returns ms per frame
+static double app_bench_frames(DrawRectFn draw_rect, int rects, int frames) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int f = 0; f < frames; f++) {
+        SDL_PumpEvents();
+        glClear(GL_COLOR_BUFFER_BIT);
+        state.batch.draw_calls = 0;
+        state.batch.uploaded = 0;
+        state.gl.issued = 0;
+        state.gl.elided = 0;
+        for (int i = 0; i < rects; i++) {
+            float x = (float)(i * 37 % (int)state.window_width);
+            float y = (float)(i * 53 % (int)state.window_height);
+            draw_rect(x, y, 8.0f, 8.0f, {(unsigned char)i, (unsigned char)(i >> 8), 200, 255});
+        }
+        gl_batch_end_frame(&state.batch);
+        SDL_GL_SwapWindow(state.window);
+    }
+    glFinish();
+    return (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / frames;
+}
+
+// Instanced rects and triangles taking turns every BENCH_MIXED_RUN rects,
+// so the batch flushes many times a frame like mixed UI content does
+#define BENCH_MIXED_RUN 16
+
+static void app_bench_draw_rect_mixed(float x, float y, float w, float h, Color color) {
+    static int count;
+    if (count++ / BENCH_MIXED_RUN % 2) {
+        gl_draw_rect_triangles(x, y, w, h, color);
+    } else {
+        gl_draw_rect(x, y, w, h, color);
+    }
 }
 
-int main(void) {
+// For each path: how many small rects fit in a 60 Hz frame, and the frame
+// time and bytes sent to the GPU for BENCH_STRESS_RECTS rects
+static void app_bench() {
+    SDL_GL_SetSwapInterval(0);
+    const struct {
+        const char *name;
+        DrawRectFn draw_rect;
+    } paths[] = {
+        {"unbatched", gl_draw_rect_unbatched},
+        {"triangles", gl_draw_rect_triangles},
+        {"instanced", gl_draw_rect},
+        {"mixed", app_bench_draw_rect_mixed},
+    };
+    for (int p = 0; p < 4; p++) {
+        int best = 0;
+        for (int rects = 256; rects < (1 << 24); rects += rects / 4) {
+            if (app_bench_frames(paths[p].draw_rect, rects, 8) > 1000.0 / 60.0) break;
+            best = rects;
+        }
+        double ms = app_bench_frames(paths[p].draw_rect, BENCH_STRESS_RECTS, 16);
+        printf("%-9s %8d rects per frame at 60 Hz; %dk rects: %6.2f ms, %5.2f MB uploaded, %d draw calls, "
+               "%d state calls issued, %d elided\n",
+               paths[p].name, best, BENCH_STRESS_RECTS / 1000, ms, state.batch.uploaded / 1e6, state.batch.draw_calls,
+               state.gl.issued, state.gl.elided);
+    }
+}
+
+#define BENCH_MESH_DRAWS 10000
+
+// BENCH_MESH_DRAWS draws per frame, each with its own mesh, transform and
+// color, through glMultiDrawElementsIndirect and the per-draw fallback
+static void app_bench_meshes() {
+    const Color white = {255, 255, 255, 255};
+    Vertex quad[4] = {{0, 0, white}, {1, 0, white}, {1, 1, white}, {0, 1, white}};
+    GLuint quad_indices[6] = {0, 1, 2, 2, 3, 0};
+    Vertex triangle[3] = {{0.5f, 0, white}, {1, 1, {255, 255, 255, 128}}, {0, 1, {255, 255, 255, 128}}};
+    GLuint triangle_indices[3] = {0, 1, 2};
+    Vertex circle[33];
+    GLuint circle_indices[96];
+    circle[0] = (Vertex){0.5f, 0.5f, white};
+    for (int i = 0; i < 32; i++) {
+        float angle = i * 2.0f * (float)M_PI / 32.0f;
+        circle[i + 1] = (Vertex){0.5f + 0.5f * cosf(angle), 0.5f + 0.5f * sinf(angle), white};
+        circle_indices[i * 3] = 0;
+        circle_indices[i * 3 + 1] = i + 1;
+        circle_indices[i * 3 + 2] = (i + 1) % 32 + 1;
+    }
+    int meshes[3] = {
+        gl_mesh_create(quad, 4, quad_indices, 6),
+        gl_mesh_create(triangle, 3, triangle_indices, 3),
+        gl_mesh_create(circle, 33, circle_indices, 96),
+    };
+
+    bool indirect = state.meshes.indirect;
+    for (int pass = indirect ? 0 : 1; pass < 2; pass++) {
+        state.meshes.indirect = pass == 0;
+        const int frames = 32;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int f = 0; f < frames; f++) {
+            SDL_PumpEvents();
+            glClear(GL_COLOR_BUFFER_BIT);
+            state.batch.draw_calls = 0;
+            for (int i = 0; i < BENCH_MESH_DRAWS; i++) {
+                float x = (float)(i * 37 % (int)state.window_width);
+                float y = (float)(i * 53 % (int)state.window_height);
+                float size = 4.0f + (i + f) % 13;
+                gl_draw_mesh(meshes[i % 3], x, y, size, size, {(unsigned char)i, (unsigned char)(i >> 8), 200, 255});
+            }
+            gl_batch_end_frame(&state.batch);
+            SDL_GL_SwapWindow(state.window);
+        }
+        glFinish();
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / frames;
+        printf("%-9s %dk distinct draws: %6.2f ms, %d draw calls\n",
+               pass == 0 ? "indirect" : "per-draw", BENCH_MESH_DRAWS / 1000, ms, state.batch.draw_calls);
+    }
+    state.meshes.indirect = indirect;
+}
+
+#define BENCH_CAPTURE_RECTS 10000
+
+// Frame time with every frame recorded against none, to show the readback
+// doesn't stall the pipeline
+static void app_bench_capture() {
+    const char *path = "bench-capture.rgba";
+    const int frames = 120;
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1 && !gl_capture_start_recording(path)) return;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int f = 0; f < frames; f++) {
+            SDL_PumpEvents();
+            glClear(GL_COLOR_BUFFER_BIT);
+            for (int i = 0; i < BENCH_CAPTURE_RECTS; i++) {
+                float x = (float)((i * 37 + f) % (int)state.window_width);
+                float y = (float)(i * 53 % (int)state.window_height);
+                gl_draw_rect(x, y, 8.0f, 8.0f, {(unsigned char)i, (unsigned char)(i >> 8), 200, 255});
+            }
+            gl_batch_end_frame(&state.batch);
+            gl_capture_frame();
+            SDL_GL_SwapWindow(state.window);
+        }
+        glFinish();
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / frames;
+        int dropped = state.capture.dropped;
+        if (pass == 1) gl_capture_stop_recording();
+        printf("capture %-3s %dk rects: %6.2f ms per frame%s", pass ? "on" : "off", BENCH_CAPTURE_RECTS / 1000, ms,
+               pass ? "" : "\n");
+        if (pass) printf(", %d of %d frames dropped by the encoder\n", dropped, frames);
+    }
+    remove(path);
+}
+
+#define BENCH_LAYOUT_RECTS 20000
+
+// A stand-in for CPU-heavy layout: rects placed with some trig each
+static void app_bench_layout(FramePacket *packet, int frame) {
+    for (int i = 0; i < BENCH_LAYOUT_RECTS; i++) {
+        float t = frame * 0.02f + i * 0.001f;
+        float x = packet->window_width * (0.5f + 0.45f * sinf(t * 3.0f) * cosf(t * 0.7f + i));
+        float y = packet->window_height * (0.5f + 0.45f * cosf(t * 2.0f) * sinf(t * 1.3f + i));
+        frame_draw_rect(packet, x, y, 6.0f, 6.0f, {(unsigned char)i, (unsigned char)(i >> 8), 200, 255});
+    }
+}
+
+// Frame time and input-to-swap latency with layout and submission on one
+// thread, then split across two
+static void app_bench_render_thread() {
+    const int frames = 120;
+    for (int threaded = 0; threaded < 2; threaded++) {
+        if (threaded && !app_start_render_thread()) return;
+        state.frame_stats = (FrameStats){};
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int f = 0; f < frames; f++) {
+            FramePacket *packet = app_begin_frame();
+            SDL_PumpEvents();
+            packet->input_time = SDL_GetPerformanceCounter();
+            app_update(packet);
+            app_bench_layout(packet, f);
+            app_end_frame(packet);
+        }
+        app_stop_render_thread();
+        glFinish();
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / frames;
+        if (!threaded) app_collect_stats(&state.frames.packets[0]);
+        printf("%-13s %dk laid out rects: %6.2f ms per frame, %6.2f ms input to swap\n",
+               threaded ? "render thread" : "one thread", BENCH_LAYOUT_RECTS / 1000, ms,
+               state.frame_stats.latency_ms / state.frame_stats.frames);
+    }
+}
+
+int main(int argc, char *argv[]) {
     if (!app_init()) {
         printf("Failed to initialize");
         return 1;
     }
+    bool use_render_thread = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            app_bench();
+            app_bench_meshes();
+            app_bench_capture();
+            app_bench_render_thread();
+            app_quit();
+            return 0;
+        } else if (strcmp(argv[i], "--render-thread") == 0) {
+            use_render_thread = true;
+        }
+    }
+    if (use_render_thread && !app_start_render_thread()) {
+        return 1;
+    }
 
     bool quit = false;
     SDL_Event event;
+    Uint64 title_start = SDL_GetPerformanceCounter();
+    int frames = 0;
 
     while (!quit) {
-        app_update();
+        FramePacket *packet = app_begin_frame();
         while (SDL_PollEvent(&event) != 0) {
             switch (event.type) {
                 case SDL_QUIT:
@@ -277,18 +2024,44 @@ int main(void) {
                 case SDL_KEYDOWN:
                     if (event.key.keysym.sym == SDLK_q) {
                         quit = true;
+                    } else if (event.key.keysym.sym == SDLK_F1) {
+                        packet->flags |= FRAME_TOGGLE_OVERLAY;
+                    } else if (event.key.keysym.sym == SDLK_p) {
+                        packet->flags |= FRAME_PRINT_PROFILE;
+                    } else if (event.key.keysym.sym == SDLK_F12) {
+                        packet->flags |= FRAME_SCREENSHOT;
+                    } else if (event.key.keysym.sym == SDLK_F2) {
+                        packet->flags |= FRAME_TOGGLE_RECORDING;
                     }
                     break;
             }
         }
+        packet->input_time = SDL_GetPerformanceCounter();
+        app_update(packet);
 
-        // Draw
-        glClear(GL_COLOR_BUFFER_BIT);
-        gl_draw_rect(50.0f, 100.0f, 300.0f, 400.0f, {128, 128, 255, 255});
+        // Draw. F1 shows the GPU profiler overlay, P prints its numbers,
+        // F12 saves a screenshot and F2 starts and stops recording.
+        frame_draw_rect(packet, 50.0f, 100.0f, 300.0f, 400.0f, {128, 128, 255, 255});
         /* gl_draw_my_triangle(); */
-        SDL_GL_SwapWindow(state.window);
+        app_end_frame(packet);
+
+        frames++;
+        if (SDL_GetPerformanceCounter() - title_start > SDL_GetPerformanceFrequency()) {
+            double seconds = (SDL_GetPerformanceCounter() - title_start) / (double)SDL_GetPerformanceFrequency();
+            FrameStats *stats = &state.frame_stats;
+            int presented = stats->frames ? stats->frames : 1;
+            char title[160];
+            snprintf(title, sizeof(title), "App: %.2f ms per frame, %.2f ms input to swap, %d GL state calls issued, %d elided",
+                     seconds * 1000.0 / frames, stats->latency_ms / presented, stats->gl_issued / presented,
+                     stats->gl_elided / presented);
+            SDL_SetWindowTitle(state.window, title);
+            *stats = (FrameStats){};
+            frames = 0;
+            title_start = SDL_GetPerformanceCounter();
+        }
     }
 
+    app_stop_render_thread();
     app_quit();
     return 0;
 }
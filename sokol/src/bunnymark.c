@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ppl.h"
+
+// Bouncing sprites drawn with the instanced renderer. Starts with argv[1]
+// sprites (100k by default) and adds more while the mouse is held, printing
+// the count and frame time every second.
+
+#define BUNNY_SIZE 16
+#define BUNNY_BATCH 1000 // added per frame while the mouse is held
+
+typedef struct bunny {
+    float dx, dy;
+    float spin;
+} bunny;
+
+static struct {
+    sg_image image;
+    ppl_sprite *sprites;
+    bunny *bunnies;
+    int count;
+    int capacity;
+    int start_count;
+    bool adding;
+    int frames;
+    double time;
+} state;
+
+static float random_float(float min, float max) {
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static void add_bunnies(int n) {
+    if (state.count + n > state.capacity) {
+        state.capacity = (state.count + n) * 2;
+        state.sprites = realloc(state.sprites, state.capacity * sizeof(ppl_sprite));
+        state.bunnies = realloc(state.bunnies, state.capacity * sizeof(bunny));
+    }
+    for (int i = state.count; i < state.count + n; i++) {
+        state.sprites[i] = (ppl_sprite){
+            .x = random_float(0.0f, sapp_widthf()),
+            .y = random_float(0.0f, sapp_heightf() / 2.0f),
+            .w = BUNNY_SIZE,
+            .h = BUNNY_SIZE,
+            .uv = {0.0f, 0.0f, 1.0f, 1.0f},
+            .color = {(uint8_t)rand(), (uint8_t)rand(), (uint8_t)rand(), 255},
+        };
+        state.bunnies[i] = (bunny){random_float(-4.0f, 4.0f), random_float(-2.0f, 2.0f), random_float(-0.1f, 0.1f)};
+    }
+    state.count += n;
+}
+
+static void init(void) {
+    ppl_init();
+
+    // A round sprite with a darker rim, so overlapping ones stay readable
+    uint8_t pixels[BUNNY_SIZE * BUNNY_SIZE * 4];
+    for (int y = 0; y < BUNNY_SIZE; y++) {
+        for (int x = 0; x < BUNNY_SIZE; x++) {
+            float dx = x + 0.5f - BUNNY_SIZE / 2.0f, dy = y + 0.5f - BUNNY_SIZE / 2.0f;
+            float d = dx * dx + dy * dy, r = BUNNY_SIZE / 2.0f;
+            uint8_t *p = &pixels[(y * BUNNY_SIZE + x) * 4];
+            p[0] = p[1] = p[2] = d < (r - 2.0f) * (r - 2.0f) ? 255 : 160;
+            p[3] = d < r * r ? 255 : 0;
+        }
+    }
+    state.image = ppl_make_image(pixels, BUNNY_SIZE, BUNNY_SIZE);
+    add_bunnies(state.start_count);
+}
+
+static void frame(void) {
+    if (state.adding) {
+        add_bunnies(BUNNY_BATCH);
+    }
+
+    float width = sapp_widthf(), height = sapp_heightf();
+    for (int i = 0; i < state.count; i++) {
+        ppl_sprite *s = &state.sprites[i];
+        bunny *b = &state.bunnies[i];
+        s->x += b->dx;
+        s->y += b->dy;
+        s->rotation += b->spin;
+        b->dy += 0.75f;
+        if (s->x < 0.0f || s->x > width) {
+            b->dx = -b->dx;
+            s->x = s->x < 0.0f ? 0.0f : width;
+        }
+        if (s->y > height) {
+            b->dy *= -0.85f;
+            s->y = height;
+            if (rand() % 2) b->dy -= random_float(0.0f, 6.0f);
+        } else if (s->y < 0.0f) {
+            b->dy = 0.0f;
+            s->y = 0.0f;
+        }
+    }
+
+    ppl_begin((ppl_color){255, 255, 255, 255});
+    ppl_sprites(state.image, state.sprites, state.count);
+    char text[64];
+    snprintf(text, sizeof(text), "%d sprites", state.count);
+    ppl_rect(0.0f, 0.0f, 200.0f, 32.0f, (ppl_color){0, 0, 0, 200});
+    ppl_text(8.0f, 22.0f, text, (ppl_color){255, 255, 255, 255});
+    ppl_end();
+
+    state.frames++;
+    state.time += sapp_frame_duration();
+    if (state.time >= 1.0) {
+        ppl_stats stats = ppl_frame_stats();
+        printf("%d sprites: %.2f ms per frame, %d draw calls, %.2f MB uploaded\n", stats.sprites,
+               state.time * 1000.0 / state.frames, stats.draw_calls, stats.uploaded_bytes / 1e6);
+        state.frames = 0;
+        state.time = 0.0;
+    }
+}
+
+static void cleanup(void) {
+    free(state.sprites);
+    free(state.bunnies);
+    ppl_quit();
+}
+
+static void event(const sapp_event *e) {
+    if (e->type == SAPP_EVENTTYPE_MOUSE_DOWN) {
+        state.adding = true;
+    } else if (e->type == SAPP_EVENTTYPE_MOUSE_UP) {
+        state.adding = false;
+    } else {
+        ppl_handle_event(e);
+    }
+}
+
+sapp_desc sokol_main(int argc, char* argv[]) {
+    state.start_count = argc > 1 ? atoi(argv[1]) : 100000;
+    return (sapp_desc){
+        .init_cb = init,
+        .frame_cb = frame,
+        .cleanup_cb = cleanup,
+        .event_cb = event,
+        .width = 800,
+        .height = 600,
+        .window_title = "Bunnymark",
+        .swap_interval = 0,
+    };
+}
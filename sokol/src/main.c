@@ -1,7 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ppl.h"
 
+static int frame_limit;
+static int frame_count;
+
 static void init(void) {
     ppl_init();
 }
@@ -9,6 +14,9 @@ static void init(void) {
 void frame(void) {
 
     ppl_draw();
+    if (frame_limit > 0 && ++frame_count == frame_limit) {
+        sapp_request_quit();
+    }
 }
 
 void cleanup(void) {
@@ -20,6 +28,24 @@ void event(const sapp_event *e) {
 }
 
 sapp_desc sokol_main(int argc, char* argv[]) {
+    // --stress draws 50k quads a frame with vsync off, --trace <file> records
+    // every sg_* call, --frames <n> quits after n frames, and
+    // --no-frame-skip redraws every frame even when nothing changed
+    bool stress = false;
+    bool frame_skip = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stress") == 0) {
+            stress = true;
+            ppl_set_stress(50000);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            ppl_set_trace(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_limit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-frame-skip") == 0) {
+            frame_skip = false;
+        }
+    }
+    ppl_set_frame_skip(frame_skip && !stress);
     return (sapp_desc){
         .init_cb = init,
         .frame_cb = frame,
@@ -28,5 +54,6 @@ sapp_desc sokol_main(int argc, char* argv[]) {
         .width = 800,
         .height = 600,
         .window_title = "App",
+        .swap_interval = stress ? 0 : 1,
     };
 }
@@ -1,117 +1,660 @@
-
-#define SOKOL_IMPL
-
 #if defined(_WIN32)
 #define SOKOL_D3D11
+#define PPL_COLOR_FORMAT SG_PIXELFORMAT_BGRA8
 #elif defined(__linux) || defined(__unix__)
+// sokol_app.h and sokol_gfx.h in lib/ are from different releases, which
+// name the GL backend differently
 #define SOKOL_GLCORE33
+#define SOKOL_GLCORE
+#define PPL_COLOR_FORMAT SG_PIXELFORMAT_RGBA8
 #endif
+#define SOKOL_TRACE_HOOKS // for ppl_trace.c
 
-#include "sokol_app.h"
-#include "sokol_gfx.h"
-#include "sokol_glue.h"
+#include <math.h>
+#if defined(__linux) || defined(__unix__)
+#include <poll.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+// ppl.h includes the sokol headers for their declarations, and the vendored
+// sokol_app.h can't be included again for its implementation, so that
+// comes first. sokol_app.h also defines allocator macros that sokol_gfx.h
+// rejects, so it's implemented last. ppl.h also includes draw.h.
+#define DRAW_IMPLEMENTATION
 #include "ppl.h"
 
+#define SOKOL_IMPL
+#include "sokol_gfx.h"
+#include "sokol_log.h"
+#include "sokol_app.h"
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+#define TEXT_IMPLEMENTATION
+#include "text.h"
+
+#include "ppl_trace.h"
 #include "shape.glsl.h"
 
+#define PPL_MAX_QUADS 65536
+#define PPL_MAX_DRAWS 1024 // texture changes per frame
+#define PPL_MAX_SPRITES (1 << 19)
+#define PPL_FONT_PATH "../res/fonts/vera/Vera.ttf"
+#define PPL_FONT_SIZE 20.0f
+#define PPL_FONT_ATLAS 512
+#define PPL_IDLE_WAIT_MS 500 // longest a skipped frame waits for an event
+
+// A run of quads drawn with one texture
+typedef struct ppl_draw_cmd {
+    sg_image image;
+    int first_quad;
+    int quad_count;
+} ppl_draw_cmd;
+
 /* application state */
 static struct {
     sg_pipeline pip;
     sg_bindings bind;
     sg_pass_action pass_action;
+    sg_sampler sampler;
+    sg_image white;
+    sg_image font;
+    sg_image checker;
+    bool has_font;
+    stbtt_packedchar chars[TEXT_NUM_CHARS];
+    FontMetrics metrics;
     float window_width;
     float window_height;
     float pos_x;
     float pos_y;
-} state;
 
+    // This frame's quads and draws, and the last uploaded ones to compare
+    // against: an unchanged frame is drawn from what the buffer holds. A
+    // quad is one draw.h instance.
+    VertStore quads;
+    VertStore prev_quads;
+    ppl_draw_cmd cmds[PPL_MAX_DRAWS];
+    ppl_draw_cmd prev_cmds[PPL_MAX_DRAWS];
+    int cmd_count;
+    int prev_cmd_count;
+    int vertex_offset; // of the last upload in the vertex buffer
+
+    // Sprites are uploaded every frame, since they're expected to move
+    sg_pipeline sprite_pip;
+    sg_bindings sprite_bind;
+    ppl_sprite *sprites;
+    int sprite_count;
+    ppl_draw_cmd sprite_cmds[PPL_MAX_DRAWS];
+    int sprite_cmd_count;
+    int sprite_offset;
+
+    // With frame skipping on, frames are drawn into `target` and copied to
+    // the swapchain, so that a skipped frame can present the last one again
+    bool frame_skip;
+    bool dirty;
+    bool animating;
+    uint64_t frames_skipped;
+    sg_pipeline blit_pip;
+    sg_bindings blit_bind;
+    sg_image target_color;
+    sg_image target_resolve;
+    sg_image target_depth;
+    sg_attachments target_atts;
+    int target_width;
+    int target_height;
+
+    bool overflowed;
+    ppl_stats stats;
 
-static float gl_x(float x) {
-    return -1.0f + 2.0f * x / state.window_width;
+    const char *trace_path;
+
+    int stress_quads;
+    int stress_frames;
+    double stress_time;
+    uint64_t frame;
+} state;
+
+// The vendored sokol_app.h predates the sglue_environment and
+// sglue_swapchain that sokol_glue.h implements, so they're filled in here
+// from what it has
+static sg_environment ppl_environment() {
+    sg_environment env = {0};
+    env.defaults.color_format = PPL_COLOR_FORMAT;
+    env.defaults.depth_format = SG_PIXELFORMAT_DEPTH_STENCIL;
+    env.defaults.sample_count = sapp_sample_count();
+#if defined(SOKOL_D3D11)
+    env.d3d11.device = sapp_d3d11_get_device();
+    env.d3d11.device_context = sapp_d3d11_get_device_context();
+#endif
+    return env;
 }
 
-static float gl_y(float y) {
-    return 1.0f - 2.0f * y / state.window_height;
+static sg_swapchain ppl_swapchain() {
+    sg_swapchain swapchain = {0};
+    swapchain.width = sapp_width();
+    swapchain.height = sapp_height();
+    swapchain.sample_count = sapp_sample_count();
+    swapchain.color_format = PPL_COLOR_FORMAT;
+    swapchain.depth_format = SG_PIXELFORMAT_DEPTH_STENCIL;
+#if defined(SOKOL_D3D11)
+    swapchain.d3d11.render_view = sapp_d3d11_get_render_target_view();
+    swapchain.d3d11.depth_stencil_view = sapp_d3d11_get_depth_stencil_view();
+#endif
+    return swapchain;
 }
 
+static bool ppl_load_font() {
+    FILE *f = fopen(PPL_FONT_PATH, "rb");
+    if (!f) {
+        printf("Couldn't open %s, text is disabled\n", PPL_FONT_PATH);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *ttf = malloc(size);
+    bool ok = fread(ttf, size, 1, f) == 1;
+    fclose(f);
+    if (ok) {
+        // White with the coverage in alpha, so glyphs are drawn and tinted
+        // like any other textured quad
+        u8 *pixels = text_atlas_build(&state.metrics, state.chars, ttf, PPL_FONT_SIZE, PPL_FONT_ATLAS, PPL_FONT_ATLAS,
+                                      PPL_FONT_ATLAS);
+        state.font = ppl_make_image(pixels, PPL_FONT_ATLAS, PPL_FONT_ATLAS);
+        free(pixels);
+    }
+    free(ttf);
+    return ok;
+}
 
 void ppl_init() {
     sg_setup(&(sg_desc){
-        .context = sapp_sgcontext()
+        .environment = ppl_environment(),
+        .logger.func = slog_func,
     });
+    if (state.trace_path) {
+        ppl_trace_begin(state.trace_path);
+    }
 
     /* create shader from code-generated sg_shader_desc */
-    sg_shader shd = sg_make_shader(simple_shader_desc(sg_query_backend()));
-
-    /* a vertex buffer with 3 vertices */
-    float vertices[] = {
-        // positions
-        state.pos_x + -0.5f, state.pos_y + -0.5f, 0.0f,     // bottom left
-        state.pos_x + 0.5f, state.pos_y + -0.5f, 0.0f,      // bottom right
-        state.pos_x + 0.0f,  state.pos_y + 0.5f, 0.0f       // top
-    };
+    sg_shader shd = sg_make_shader(batch_shader_desc(sg_query_backend()));
+
+    // Appended to once per changed frame. The buffer is the VertStore as
+    // is, one instance per quad, and the corners come from gl_VertexIndex.
     state.bind.vertex_buffers[0] = sg_make_buffer(&(sg_buffer_desc){
-        .size = sizeof(vertices),
-        .usage = SG_USAGE_DYNAMIC,
-        .label = "shape-vertices"
+        .size = PPL_MAX_QUADS * sizeof(VertInput),
+        .usage = SG_USAGE_STREAM,
+        .label = "batch-instances"
     });
 
-    /* create a pipeline object (default render states are fine for triangle) */
     state.pip = sg_make_pipeline(&(sg_pipeline_desc){
         .shader = shd,
-        /* if the vertex layout doesn't have gaps, don't need to provide strides and offsets */
         .layout = {
+            .buffers[0] = {.stride = sizeof(VertInput), .step_func = SG_VERTEXSTEP_PER_INSTANCE},
             .attrs = {
-                [ATTR_vs_position].format = SG_VERTEXFORMAT_FLOAT3
+                [ATTR_batch_dst_rect] = {.format = SG_VERTEXFORMAT_FLOAT4, .offset = offsetof(VertInput, dst_rect)},
+                [ATTR_batch_src_rect] = {.format = SG_VERTEXFORMAT_FLOAT4, .offset = offsetof(VertInput, src_rect)},
+                [ATTR_batch_border_color] = {.format = SG_VERTEXFORMAT_FLOAT4, .offset = offsetof(VertInput, border_color)},
+                [ATTR_batch_corner_radii] = {.format = SG_VERTEXFORMAT_FLOAT4, .offset = offsetof(VertInput, corner_radii)},
+                [ATTR_batch_color0] = {.format = SG_VERTEXFORMAT_FLOAT4, .offset = offsetof(VertInput, colors[0])},
+                [ATTR_batch_color1] = {.format = SG_VERTEXFORMAT_FLOAT4, .offset = offsetof(VertInput, colors[1])},
+                [ATTR_batch_color2] = {.format = SG_VERTEXFORMAT_FLOAT4, .offset = offsetof(VertInput, colors[2])},
+                [ATTR_batch_color3] = {.format = SG_VERTEXFORMAT_FLOAT4, .offset = offsetof(VertInput, colors[3])},
+                [ATTR_batch_params] = {.format = SG_VERTEXFORMAT_FLOAT3, .offset = offsetof(VertInput, edge_softness)},
             }
         },
-        .label = "shape-pipeline"
+        .colors[0].blend = {
+            .enabled = true,
+            .src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA,
+            .dst_factor_rgb = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+            .src_factor_alpha = SG_BLENDFACTOR_SRC_ALPHA,
+            .dst_factor_alpha = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+        },
+        .label = "batch-pipeline"
     });
 
-    /* a pass action to clear framebuffer */
-    state.pass_action = (sg_pass_action) {
-        .colors[0] = { .load_action=SG_LOADACTION_CLEAR, .clear_value={0.2f, 0.3f, 0.3f, 1.0f} }
-    };
+    const float corners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    state.sprite_bind.vertex_buffers[0] = sg_make_buffer(&(sg_buffer_desc){
+        .data = SG_RANGE(corners),
+        .label = "sprite-corners"
+    });
+    state.sprite_bind.vertex_buffers[1] = sg_make_buffer(&(sg_buffer_desc){
+        .size = PPL_MAX_SPRITES * sizeof(ppl_sprite),
+        .usage = SG_USAGE_STREAM,
+        .label = "sprite-instances"
+    });
+    const uint32_t indices[6] = {0, 1, 2, 0, 2, 3};
+    state.sprite_bind.index_buffer = sg_make_buffer(&(sg_buffer_desc){
+        .type = SG_BUFFERTYPE_INDEXBUFFER,
+        .data = SG_RANGE(indices),
+        .label = "sprite-indices"
+    });
+
+    state.sprite_pip = sg_make_pipeline(&(sg_pipeline_desc){
+        .shader = sg_make_shader(sprite_shader_desc(sg_query_backend())),
+        .layout = {
+            .buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE,
+            .attrs = {
+                [ATTR_sprite_corner] = {.format = SG_VERTEXFORMAT_FLOAT2, .buffer_index = 0},
+                [ATTR_sprite_inst_rect] = {.format = SG_VERTEXFORMAT_FLOAT4, .buffer_index = 1},
+                [ATTR_sprite_inst_rotation] = {.format = SG_VERTEXFORMAT_FLOAT, .buffer_index = 1},
+                [ATTR_sprite_inst_uv] = {.format = SG_VERTEXFORMAT_FLOAT4, .buffer_index = 1},
+                [ATTR_sprite_inst_color] = {.format = SG_VERTEXFORMAT_UBYTE4N, .buffer_index = 1},
+            }
+        },
+        .index_type = SG_INDEXTYPE_UINT32,
+        .colors[0].blend = {
+            .enabled = true,
+            .src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA,
+            .dst_factor_rgb = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+            .src_factor_alpha = SG_BLENDFACTOR_SRC_ALPHA,
+            .dst_factor_alpha = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+        },
+        .label = "sprite-pipeline"
+    });
+
+    // Vertices come from gl_VertexIndex, so there are no buffers to bind
+    state.blit_pip = sg_make_pipeline(&(sg_pipeline_desc){
+        .shader = sg_make_shader(blit_shader_desc(sg_query_backend())),
+        .label = "blit-pipeline"
+    });
+
+    state.sampler = sg_make_sampler(&(sg_sampler_desc){
+        .min_filter = SG_FILTER_NEAREST,
+        .mag_filter = SG_FILTER_NEAREST,
+        .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+        .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+    });
+    state.bind.samplers[SMP_smp] = state.sampler;
+    state.blit_bind.samplers[SMP_smp] = state.sampler;
+    state.sprite_bind.samplers[SMP_smp] = state.sampler;
+
+    // Solid quads don't read their texture, so they draw with whichever is
+    // bound; white is used when nothing else is
+    state.white = ppl_make_image((const uint8_t[]){255, 255, 255, 255}, 1, 1);
+    uint8_t checker[8 * 8 * 4];
+    for (int i = 0; i < 64; i++) {
+        uint8_t c = ((i % 8) / 2 + (i / 16)) % 2 ? 255 : 96;
+        checker[i * 4] = c;
+        checker[i * 4 + 1] = c;
+        checker[i * 4 + 2] = c;
+        checker[i * 4 + 3] = 255;
+    }
+    state.checker = ppl_make_image(checker, 8, 8);
+    state.has_font = ppl_load_font();
+    if (!state.has_font) {
+        state.font = state.white;
+    }
+
+    state.quads = make_vert_store();
+    state.prev_quads = make_vert_store();
+    state.prev_quads.size = -1;
+    state.sprites = malloc(PPL_MAX_SPRITES * sizeof(ppl_sprite));
 
     state.window_width = 800.0f;
     state.window_height = 600.0f;
     state.pos_x = 0.0f;
     state.pos_y = 0.0f;
+    state.dirty = true;
 }
 
-void ppl_draw() {
-    /* a vertex buffer with 3 vertices */
-    float vertices[] = {
-        // positions
-        state.pos_x + -0.5f, state.pos_y + -0.5f, 0.0f,     // bottom left
-        state.pos_x + 0.5f, state.pos_y + -0.5f, 0.0f,      // bottom right
-        state.pos_x + 0.0f,  state.pos_y + 0.5f, 0.0f       // top
+sg_image ppl_make_image(const uint8_t *rgba, int width, int height) {
+    return sg_make_image(&(sg_image_desc){
+        .width = width,
+        .height = height,
+        .pixel_format = SG_PIXELFORMAT_RGBA8,
+        .data.subimage[0][0] = {rgba, (size_t)width * height * 4},
+    });
+}
+
+void ppl_begin(ppl_color clear) {
+    state.window_width = sapp_widthf();
+    state.window_height = sapp_heightf();
+    state.pass_action = (sg_pass_action){
+        .colors[0] = {
+            .load_action = SG_LOADACTION_CLEAR,
+            .clear_value = {clear.r / 255.0f, clear.g / 255.0f, clear.b / 255.0f, clear.a / 255.0f}
+        }
     };
-    sg_update_buffer(state.bind.vertex_buffers[0], &SG_RANGE(vertices));
+    vert_clear(&state.quads);
+    state.cmd_count = 0;
+    state.sprite_count = 0;
+    state.sprite_cmd_count = 0;
+}
+
+static Vec4 ppl_vec4(ppl_color c) {
+    return (Vec4){{c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, c.a / 255.0f}};
+}
+
+// Checks there is room for `count` more quads, and starts a new draw when
+// textured ones need another image than the current draw's. Solid quads
+// don't read their texture, so they go with whichever draw is current. The
+// caller then appends the quads to state.quads.
+static bool ppl_reserve(sg_image image, bool textured, int count) {
+    bool new_cmd = state.cmd_count == 0 || (textured && state.cmds[state.cmd_count - 1].image.id != image.id);
+    if (count > PPL_MAX_QUADS - state.quads.size || (new_cmd && state.cmd_count == PPL_MAX_DRAWS)) {
+        if (!state.overflowed) printf("ppl: more than %d quads or %d textures in a frame\n", PPL_MAX_QUADS, PPL_MAX_DRAWS);
+        state.overflowed = true;
+        return false;
+    }
+    if (new_cmd) {
+        state.cmds[state.cmd_count++] = (ppl_draw_cmd){textured ? image : state.white, state.quads.size, 0};
+    }
+    return true;
+}
+
+void ppl_rect(float x, float y, float w, float h, ppl_color color) {
+    if (ppl_reserve(state.white, false, 1)) {
+        draw_rect(&state.quads, (Rect){x, y, w, h}, ppl_vec4(color));
+    }
+}
+
+void ppl_rounded_rect(float x, float y, float w, float h, float radius, ppl_color color) {
+    float max_radius = fminf(w, h) / 2.0f;
+    if (ppl_reserve(state.white, false, 1)) {
+        draw_box(&state.quads, (Rect){x, y, w, h}, ppl_vec4(color), fminf(radius, max_radius), 0.0f, ppl_vec4(color));
+    }
+}
+
+void ppl_image(sg_image image, float x, float y, float w, float h, ppl_color tint) {
+    if (ppl_reserve(image, true, 1)) {
+        draw_image(&state.quads, (Rect){x, y, w, h}, (Rect){0.0f, 0.0f, 1.0f, 1.0f}, ppl_vec4(tint));
+    }
+}
+
+float ppl_text(float x, float y, const char *text, ppl_color color) {
+    int len = (int)strlen(text);
+    if (!state.has_font || !ppl_reserve(state.font, true, len)) return x;
+    int first = state.quads.size;
+    x = text_layout_batch(&state.quads, &state.metrics, text, len, x, y, true, NULL, NULL);
+    // Glyphs come out white
+    Vec4 tint = ppl_vec4(color);
+    for (int i = first; i < state.quads.size; i++) {
+        VertInput *q = &state.quads.data[i];
+        q->colors[0] = q->colors[1] = q->colors[2] = q->colors[3] = tint;
+    }
+    return x;
+}
+
+void ppl_verts(sg_image image, const VertInput *verts, int count) {
+    if (!ppl_reserve(image, image.id != SG_INVALID_ID, count)) return;
+    memcpy(reserve_verts(&state.quads, count), verts, count * sizeof(VertInput));
+    state.quads.size += count;
+}
+
+void ppl_sprites(sg_image image, const ppl_sprite *sprites, int count) {
+    ppl_draw_cmd *cmd = state.sprite_cmd_count ? &state.sprite_cmds[state.sprite_cmd_count - 1] : NULL;
+    bool new_cmd = !cmd || cmd->image.id != image.id;
+    if (count > PPL_MAX_SPRITES - state.sprite_count || (new_cmd && state.sprite_cmd_count == PPL_MAX_DRAWS)) {
+        if (!state.overflowed) printf("ppl: more than %d sprites or %d textures in a frame\n", PPL_MAX_SPRITES, PPL_MAX_DRAWS);
+        state.overflowed = true;
+        count = new_cmd && state.sprite_cmd_count == PPL_MAX_DRAWS ? 0 : PPL_MAX_SPRITES - state.sprite_count;
+    }
+    if (count <= 0) return;
+    if (new_cmd) {
+        cmd = &state.sprite_cmds[state.sprite_cmd_count++];
+        *cmd = (ppl_draw_cmd){image, state.sprite_count, 0};
+    }
+    memcpy(state.sprites + state.sprite_count, sprites, count * sizeof(ppl_sprite));
+    state.sprite_count += count;
+    cmd->quad_count += count;
+}
+
+// (Re)creates the offscreen target to match the window
+static void ppl_update_target() {
+    int width = sapp_width(), height = sapp_height();
+    if (state.target_atts.id != SG_INVALID_ID && width == state.target_width && height == state.target_height) {
+        return;
+    }
+    sg_destroy_attachments(state.target_atts);
+    sg_destroy_image(state.target_color);
+    sg_destroy_image(state.target_resolve);
+    sg_destroy_image(state.target_depth);
+
+    // Same formats and sample count as the swapchain, so the pipelines
+    // work for both
+    int sample_count = sapp_sample_count();
+    state.target_color = sg_make_image(&(sg_image_desc){
+        .render_target = true,
+        .width = width,
+        .height = height,
+        .pixel_format = PPL_COLOR_FORMAT,
+        .sample_count = sample_count,
+        .label = "frame-color"
+    });
+    state.target_depth = sg_make_image(&(sg_image_desc){
+        .render_target = true,
+        .width = width,
+        .height = height,
+        .pixel_format = SG_PIXELFORMAT_DEPTH_STENCIL,
+        .sample_count = sample_count,
+        .label = "frame-depth"
+    });
+    state.target_resolve = (sg_image){SG_INVALID_ID};
+    if (sample_count > 1) {
+        state.target_resolve = sg_make_image(&(sg_image_desc){
+            .render_target = true,
+            .width = width,
+            .height = height,
+            .pixel_format = PPL_COLOR_FORMAT,
+            .label = "frame-resolve"
+        });
+    }
+    state.target_atts = sg_make_attachments(&(sg_attachments_desc){
+        .colors[0].image = state.target_color,
+        .resolves[0].image = state.target_resolve,
+        .depth_stencil.image = state.target_depth,
+        .label = "frame"
+    });
+    state.target_width = width;
+    state.target_height = height;
+}
 
-    sg_begin_default_pass(&state.pass_action, sapp_width(), sapp_height());
-    sg_apply_pipeline(state.pip);
-    sg_apply_bindings(&state.bind);
+static void ppl_present_target() {
+    sg_begin_pass(&(sg_pass){
+        .action.colors[0].load_action = SG_LOADACTION_DONTCARE,
+        .swapchain = ppl_swapchain()
+    });
+    sg_apply_pipeline(state.blit_pip);
+    blit_params_t params = {.flip = sg_query_features().origin_top_left ? 1.0f : 0.0f};
+    sg_apply_uniforms(UB_blit_params, &SG_RANGE(params));
+    state.blit_bind.images[IMG_tex] = state.target_resolve.id != SG_INVALID_ID ? state.target_resolve : state.target_color;
+    sg_apply_bindings(&state.blit_bind);
     sg_draw(0, 3, 1);
     sg_end_pass();
+}
+
+// sokol_app polls for events once per frame and has no way to wait, but its
+// implementation is in this file, so on X11 the wait happens here instead
+static void ppl_wait_for_event() {
+#if defined(_SAPP_LINUX)
+    if (XPending(_sapp.x11.display) == 0) {
+        struct pollfd fd = {ConnectionNumber(_sapp.x11.display), POLLIN, 0};
+        poll(&fd, 1, PPL_IDLE_WAIT_MS);
+    }
+#endif
+}
+
+void ppl_end() {
+    // Each draw runs up to where the next one starts
+    for (int i = 0; i < state.cmd_count; i++) {
+        int end = i + 1 < state.cmd_count ? state.cmds[i + 1].first_quad : state.quads.size;
+        state.cmds[i].quad_count = end - state.cmds[i].first_quad;
+    }
+    size_t bytes = state.quads.size * sizeof(VertInput);
+    bool unchanged = state.quads.size == state.prev_quads.size && state.cmd_count == state.prev_cmd_count &&
+                     memcmp(state.quads.data, state.prev_quads.data, bytes) == 0 &&
+                     memcmp(state.cmds, state.prev_cmds, state.cmd_count * sizeof(ppl_draw_cmd)) == 0;
+    state.stats = (ppl_stats){.quads = state.quads.size, .sprites = state.sprite_count, .upload_skipped = unchanged};
+    // The sg_* calls from here on are back to back
+    ppl_trace_mark();
+    if (!unchanged && state.quads.size > 0) {
+        state.vertex_offset = sg_append_buffer(state.bind.vertex_buffers[0], &(sg_range){state.quads.data, bytes});
+        state.stats.uploaded_bytes = (int)bytes;
+    }
+    if (!unchanged) {
+        VertStore swap = state.prev_quads;
+        state.prev_quads = state.quads;
+        state.quads = swap;
+        memcpy(state.prev_cmds, state.cmds, state.cmd_count * sizeof(ppl_draw_cmd));
+        state.prev_cmd_count = state.cmd_count;
+    }
+
+    if (state.sprite_count > 0) {
+        size_t sprite_bytes = state.sprite_count * sizeof(ppl_sprite);
+        state.sprite_offset = sg_append_buffer(state.sprite_bind.vertex_buffers[1], &(sg_range){state.sprites, sprite_bytes});
+        state.stats.uploaded_bytes += (int)sprite_bytes;
+    }
+
+    if (state.frame_skip) {
+        ppl_update_target();
+        sg_begin_pass(&(sg_pass){.action = state.pass_action, .attachments = state.target_atts});
+    } else {
+        sg_begin_pass(&(sg_pass){.action = state.pass_action, .swapchain = ppl_swapchain()});
+    }
+    vs_params_t params = {.screen_size = {state.window_width, state.window_height}};
+    if (state.sprite_count > 0) {
+        sg_apply_pipeline(state.sprite_pip);
+        sg_apply_uniforms(UB_vs_params, &SG_RANGE(params));
+        for (int i = 0; i < state.sprite_cmd_count; i++) {
+            ppl_draw_cmd *cmd = &state.sprite_cmds[i];
+            state.sprite_bind.vertex_buffer_offsets[1] = state.sprite_offset + cmd->first_quad * (int)sizeof(ppl_sprite);
+            state.sprite_bind.images[IMG_tex] = cmd->image;
+            sg_apply_bindings(&state.sprite_bind);
+            sg_draw(0, 6, cmd->quad_count);
+            state.stats.draw_calls++;
+        }
+    }
+    // prev_quads is this frame's now, whether it was uploaded or matched
+    if (state.prev_quads.size > 0) {
+        sg_apply_pipeline(state.pip);
+        sg_apply_uniforms(UB_vs_params, &SG_RANGE(params));
+        for (int i = 0; i < state.prev_cmd_count; i++) {
+            ppl_draw_cmd *cmd = &state.prev_cmds[i];
+            if (cmd->quad_count == 0) continue;
+            // No base instance in sg_draw, so each run starts at its offset
+            state.bind.vertex_buffer_offsets[0] = state.vertex_offset + cmd->first_quad * (int)sizeof(VertInput);
+            state.bind.images[IMG_tex] = cmd->image;
+            sg_apply_bindings(&state.bind);
+            sg_draw(0, 6, cmd->quad_count);
+            state.stats.draw_calls++;
+        }
+    }
+    sg_end_pass();
+    if (state.frame_skip) {
+        ppl_present_target();
+    }
     sg_commit();
+    state.frame++;
+}
+
+ppl_stats ppl_frame_stats() {
+    return state.stats;
+}
+
+void ppl_set_stress(int quads) {
+    state.stress_quads = quads;
+}
+
+void ppl_set_trace(const char *path) {
+    state.trace_path = path;
+}
+
+static void ppl_draw_stress() {
+    float t = state.frame * 0.01f;
+    for (int i = 0; i < state.stress_quads; i++) {
+        float x = fmodf(i * 37.0f + t * (i % 7 + 1) * 20.0f, state.window_width);
+        float y = fmodf(i * 53.0f + t * (i % 5 + 1) * 10.0f, state.window_height);
+        ppl_color color = {(uint8_t)i, (uint8_t)(i >> 8), 200, 255};
+        if (i % 2) {
+            ppl_rounded_rect(x, y, 10.0f, 10.0f, 3.0f, color);
+        } else {
+            ppl_rect(x, y, 8.0f, 8.0f, color);
+        }
+    }
+}
+
+void ppl_set_frame_skip(bool enabled) {
+    state.frame_skip = enabled;
+    state.dirty = true;
+}
+
+void ppl_set_animating(bool animating) {
+    state.animating = animating;
+}
+
+void ppl_invalidate() {
+    state.dirty = true;
+}
+
+uint64_t ppl_frames_skipped() {
+    return state.frames_skipped;
+}
+
+void ppl_draw() {
+    // Nothing can have changed without an event, so the last frame is shown
+    // again without rebuilding or uploading anything
+    bool resized = sapp_width() != state.target_width || sapp_height() != state.target_height;
+    if (state.frame_skip && !state.dirty && !state.animating && state.stress_quads == 0 && !resized) {
+        ppl_wait_for_event();
+        ppl_present_target();
+        sg_commit();
+        state.frames_skipped++;
+        return;
+    }
+    state.dirty = false;
+
+    ppl_begin((ppl_color){51, 77, 77, 255});
+    if (state.stress_quads > 0) {
+        ppl_draw_stress();
+    } else {
+        float y = 40.0f + state.pos_y;
+        ppl_rect(40.0f, y, 200.0f, 120.0f, (ppl_color){255, 128, 51, 255});
+        ppl_rounded_rect(260.0f, y, 200.0f, 120.0f, 24.0f, (ppl_color){80, 160, 255, 255});
+        ppl_image(state.checker, 480.0f, y, 120.0f, 120.0f, (ppl_color){255, 255, 255, 255});
+        ppl_text(40.0f, y + 160.0f, "Batched with sg_append_buffer", (ppl_color){255, 255, 255, 255});
+    }
+    ppl_end();
+
+    if (state.stress_quads > 0) {
+        state.stress_frames++;
+        state.stress_time += sapp_frame_duration();
+        if (state.stress_time >= 1.0) {
+            ppl_stats stats = ppl_frame_stats();
+            printf("%d quads: %.2f ms per frame, %d draw calls, %.2f MB uploaded\n", stats.quads,
+                   state.stress_time * 1000.0 / state.stress_frames, stats.draw_calls, stats.uploaded_bytes / 1e6);
+            state.stress_frames = 0;
+            state.stress_time = 0.0;
+        }
+    }
 }
 
 void ppl_quit() {
+    if (state.frame_skip) {
+        printf("Skipped %llu of %llu frames\n", (unsigned long long)state.frames_skipped,
+               (unsigned long long)(state.frame + state.frames_skipped));
+    }
+    free_vert_store(&state.quads);
+    free_vert_store(&state.prev_quads);
+    font_metrics_free(&state.metrics);
+    free(state.sprites);
+    ppl_trace_end();
     sg_shutdown();
 }
 
-void ppl_handle_event(sapp_event *e) {
+void ppl_handle_event(const sapp_event *e) {
+    state.dirty = true;
     if (e->type == SAPP_EVENTTYPE_KEY_DOWN) {
         if (e->key_code == SAPP_KEYCODE_ESCAPE) {
             sapp_request_quit();
         }
     } else if (e->type == SAPP_EVENTTYPE_MOUSE_MOVE) {
-        /* state.pos_x = gl_x(e->mouse_x); */
-        /* state.pos_y = gl_y(e->mouse_y); */
+        /* state.pos_x = e->mouse_x; */
+        /* state.pos_y = e->mouse_y; */
     } else if (e->type == SAPP_EVENTTYPE_MOUSE_SCROLL) {
         printf("scroll %f\n", e->scroll_y);
-        state.pos_y -= e->scroll_y / state.window_height * 10.0;
+        state.pos_y -= e->scroll_y * 10.0f;
     }
 }
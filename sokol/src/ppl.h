@@ -1,10 +1,73 @@
 #ifndef _PPL_H
 #define _PPL_H
 
-/* #include "sokol_app.h" */
-/* #include "sokol_gfx.h" */
-/* #include "sokol_glue.h" */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sokol_app.h"
+#include "sokol_gfx.h"
+
+#include "draw.h"
+
+typedef struct ppl_color {
+    uint8_t r, g, b, a;
+} ppl_color;
+
+// One instance of the sprite renderer, rotated around its center
+typedef struct ppl_sprite {
+    float x, y; // center
+    float w, h;
+    float rotation; // radians
+    float uv[4];    // top left, bottom right
+    ppl_color color;
+} ppl_sprite;
+
+// Counts for the last finished frame
+typedef struct ppl_stats {
+    int quads;
+    int sprites;
+    int draw_calls;
+    int uploaded_bytes;
+    bool upload_skipped; // the frame matched the one before
+} ppl_stats;
 
 void ppl_init();
+void ppl_draw();
+void ppl_quit();
+void ppl_handle_event(const sapp_event *e);
+
+// Draws `quads` animated quads per frame instead of the demo scene, and
+// prints draw calls and frame time every second
+void ppl_set_stress(int quads);
+// Records every sg_* call to `path` (see ppl_trace.h); call before ppl_init
+void ppl_set_trace(const char *path);
+
+// With frame skipping on, ppl_draw only builds and uploads a frame after an
+// event, ppl_invalidate or while animating; other frames present the last
+// one again and, on X11, wait for the next event first
+void ppl_set_frame_skip(bool enabled);
+void ppl_set_animating(bool animating);
+void ppl_invalidate();
+uint64_t ppl_frames_skipped();
+
+// Batched 2D drawing between ppl_begin and ppl_end, in pixels from the
+// top left. Everything is uploaded with one sg_append_buffer, and drawn
+// with one sg_draw per run of quads sharing a texture.
+void ppl_begin(ppl_color clear);
+void ppl_rect(float x, float y, float w, float h, ppl_color color);
+void ppl_rounded_rect(float x, float y, float w, float h, float radius, ppl_color color);
+void ppl_image(sg_image image, float x, float y, float w, float h, ppl_color tint);
+// Text in the built-in font with its baseline at y; returns the end x
+float ppl_text(float x, float y, const char *text, ppl_color color);
+// Quads built with lib/draw.h or lib/text.h, as the sdl3-c renderers take
+// them; textured ones sample `image`
+void ppl_verts(sg_image image, const VertInput *verts, int count);
+// Instanced sprites, drawn below the quads above with one sg_draw per run of
+// sprites sharing a texture
+void ppl_sprites(sg_image image, const ppl_sprite *sprites, int count);
+void ppl_end();
+
+sg_image ppl_make_image(const uint8_t *rgba, int width, int height);
+ppl_stats ppl_frame_stats();
 
 #endif
@@ -0,0 +1,377 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "sokol_gfx.h"
+
+#include "ppl_trace.h"
+
+#define PPL_TRACE_MAX_EVENTS (1 << 20) // after this only the totals are kept
+
+typedef enum ppl_call {
+    PPL_CALL_MAKE_BUFFER,
+    PPL_CALL_MAKE_IMAGE,
+    PPL_CALL_MAKE_SAMPLER,
+    PPL_CALL_MAKE_SHADER,
+    PPL_CALL_MAKE_PIPELINE,
+    PPL_CALL_MAKE_ATTACHMENTS,
+    PPL_CALL_DESTROY_BUFFER,
+    PPL_CALL_DESTROY_IMAGE,
+    PPL_CALL_DESTROY_SAMPLER,
+    PPL_CALL_DESTROY_SHADER,
+    PPL_CALL_DESTROY_PIPELINE,
+    PPL_CALL_DESTROY_ATTACHMENTS,
+    PPL_CALL_UPDATE_BUFFER,
+    PPL_CALL_UPDATE_IMAGE,
+    PPL_CALL_APPEND_BUFFER,
+    PPL_CALL_BEGIN_PASS,
+    PPL_CALL_APPLY_VIEWPORT,
+    PPL_CALL_APPLY_SCISSOR_RECT,
+    PPL_CALL_APPLY_PIPELINE,
+    PPL_CALL_APPLY_BINDINGS,
+    PPL_CALL_APPLY_UNIFORMS,
+    PPL_CALL_DRAW,
+    PPL_CALL_END_PASS,
+    PPL_CALL_COMMIT,
+    PPL_CALL_COUNT,
+} ppl_call;
+
+static const char *ppl_call_names[PPL_CALL_COUNT] = {
+    "sg_make_buffer",
+    "sg_make_image",
+    "sg_make_sampler",
+    "sg_make_shader",
+    "sg_make_pipeline",
+    "sg_make_attachments",
+    "sg_destroy_buffer",
+    "sg_destroy_image",
+    "sg_destroy_sampler",
+    "sg_destroy_shader",
+    "sg_destroy_pipeline",
+    "sg_destroy_attachments",
+    "sg_update_buffer",
+    "sg_update_image",
+    "sg_append_buffer",
+    "sg_begin_pass",
+    "sg_apply_viewport",
+    "sg_apply_scissor_rect",
+    "sg_apply_pipeline",
+    "sg_apply_bindings",
+    "sg_apply_uniforms",
+    "sg_draw",
+    "sg_end_pass",
+    "sg_commit",
+};
+
+typedef struct ppl_trace_event {
+    ppl_call call;
+    double start; // microseconds
+    double duration;
+} ppl_trace_event;
+
+typedef struct ppl_trace_frame {
+    double start; // microseconds, from the previous commit
+    double duration;
+    int calls;
+    int passes;
+    int pipelines;
+    int bindings;
+    int uniforms;
+    int draws;
+    int64_t elements; // indices or vertices times instances
+    int64_t uniform_bytes;
+    int64_t upload_bytes;
+    // From sg_query_frame_stats, what the bindings cost the GL backend
+    uint32_t gl_bind_buffer;
+    uint32_t gl_bind_texture;
+    uint32_t gl_uniform;
+} ppl_trace_frame;
+
+static struct {
+    bool active;
+    char *path;
+    sg_trace_hooks prev_hooks;
+    double origin;
+    double last;
+
+    int call_counts[PPL_CALL_COUNT];
+    double call_times[PPL_CALL_COUNT];
+
+    ppl_trace_event *events;
+    int event_count;
+    int event_capacity;
+
+    ppl_trace_frame current;
+    ppl_trace_frame *frames;
+    int frame_count;
+    int frame_capacity;
+} trace;
+
+static double ppl_trace_now() {
+#if defined(_WIN32)
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart * 1e6 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#endif
+}
+
+static void ppl_trace_call(ppl_call call) {
+    double now = ppl_trace_now() - trace.origin;
+    double duration = now - trace.last;
+    trace.call_counts[call]++;
+    trace.call_times[call] += duration;
+    trace.current.calls++;
+    if (trace.event_count < PPL_TRACE_MAX_EVENTS) {
+        if (trace.event_count == trace.event_capacity) {
+            trace.event_capacity = trace.event_capacity ? trace.event_capacity * 2 : 4096;
+            trace.events = realloc(trace.events, trace.event_capacity * sizeof(ppl_trace_event));
+        }
+        trace.events[trace.event_count++] = (ppl_trace_event){call, trace.last, duration};
+    }
+    trace.last = now;
+}
+
+static void ppl_trace_make_buffer(const sg_buffer_desc *desc, sg_buffer result, void *user_data) {
+    ppl_trace_call(PPL_CALL_MAKE_BUFFER);
+}
+
+static void ppl_trace_make_image(const sg_image_desc *desc, sg_image result, void *user_data) {
+    ppl_trace_call(PPL_CALL_MAKE_IMAGE);
+}
+
+static void ppl_trace_make_sampler(const sg_sampler_desc *desc, sg_sampler result, void *user_data) {
+    ppl_trace_call(PPL_CALL_MAKE_SAMPLER);
+}
+
+static void ppl_trace_make_shader(const sg_shader_desc *desc, sg_shader result, void *user_data) {
+    ppl_trace_call(PPL_CALL_MAKE_SHADER);
+}
+
+static void ppl_trace_make_pipeline(const sg_pipeline_desc *desc, sg_pipeline result, void *user_data) {
+    ppl_trace_call(PPL_CALL_MAKE_PIPELINE);
+}
+
+static void ppl_trace_make_attachments(const sg_attachments_desc *desc, sg_attachments result, void *user_data) {
+    ppl_trace_call(PPL_CALL_MAKE_ATTACHMENTS);
+}
+
+static void ppl_trace_destroy_buffer(sg_buffer buf, void *user_data) {
+    ppl_trace_call(PPL_CALL_DESTROY_BUFFER);
+}
+
+static void ppl_trace_destroy_image(sg_image img, void *user_data) {
+    ppl_trace_call(PPL_CALL_DESTROY_IMAGE);
+}
+
+static void ppl_trace_destroy_sampler(sg_sampler smp, void *user_data) {
+    ppl_trace_call(PPL_CALL_DESTROY_SAMPLER);
+}
+
+static void ppl_trace_destroy_shader(sg_shader shd, void *user_data) {
+    ppl_trace_call(PPL_CALL_DESTROY_SHADER);
+}
+
+static void ppl_trace_destroy_pipeline(sg_pipeline pip, void *user_data) {
+    ppl_trace_call(PPL_CALL_DESTROY_PIPELINE);
+}
+
+static void ppl_trace_destroy_attachments(sg_attachments atts, void *user_data) {
+    ppl_trace_call(PPL_CALL_DESTROY_ATTACHMENTS);
+}
+
+static void ppl_trace_update_buffer(sg_buffer buf, const sg_range *data, void *user_data) {
+    trace.current.upload_bytes += data->size;
+    ppl_trace_call(PPL_CALL_UPDATE_BUFFER);
+}
+
+static void ppl_trace_update_image(sg_image img, const sg_image_data *data, void *user_data) {
+    for (int face = 0; face < SG_CUBEFACE_NUM; face++) {
+        for (int mip = 0; mip < SG_MAX_MIPMAPS; mip++) {
+            trace.current.upload_bytes += data->subimage[face][mip].size;
+        }
+    }
+    ppl_trace_call(PPL_CALL_UPDATE_IMAGE);
+}
+
+static void ppl_trace_append_buffer(sg_buffer buf, const sg_range *data, int result, void *user_data) {
+    trace.current.upload_bytes += data->size;
+    ppl_trace_call(PPL_CALL_APPEND_BUFFER);
+}
+
+static void ppl_trace_begin_pass(const sg_pass *pass, void *user_data) {
+    trace.current.passes++;
+    ppl_trace_call(PPL_CALL_BEGIN_PASS);
+}
+
+static void ppl_trace_apply_viewport(int x, int y, int width, int height, bool origin_top_left, void *user_data) {
+    ppl_trace_call(PPL_CALL_APPLY_VIEWPORT);
+}
+
+static void ppl_trace_apply_scissor_rect(int x, int y, int width, int height, bool origin_top_left, void *user_data) {
+    ppl_trace_call(PPL_CALL_APPLY_SCISSOR_RECT);
+}
+
+static void ppl_trace_apply_pipeline(sg_pipeline pip, void *user_data) {
+    trace.current.pipelines++;
+    ppl_trace_call(PPL_CALL_APPLY_PIPELINE);
+}
+
+static void ppl_trace_apply_bindings(const sg_bindings *bindings, void *user_data) {
+    trace.current.bindings++;
+    ppl_trace_call(PPL_CALL_APPLY_BINDINGS);
+}
+
+static void ppl_trace_apply_uniforms(int ub_index, const sg_range *data, void *user_data) {
+    trace.current.uniforms++;
+    trace.current.uniform_bytes += data->size;
+    ppl_trace_call(PPL_CALL_APPLY_UNIFORMS);
+}
+
+static void ppl_trace_draw(int base_element, int num_elements, int num_instances, void *user_data) {
+    trace.current.draws++;
+    trace.current.elements += (int64_t)num_elements * num_instances;
+    ppl_trace_call(PPL_CALL_DRAW);
+}
+
+static void ppl_trace_end_pass(void *user_data) {
+    ppl_trace_call(PPL_CALL_END_PASS);
+}
+
+static void ppl_trace_commit(void *user_data) {
+    ppl_trace_call(PPL_CALL_COMMIT);
+
+    // The hook runs once the stats for this frame have been published
+    sg_frame_stats stats = sg_query_frame_stats();
+    trace.current.gl_bind_buffer = stats.gl.num_bind_buffer;
+    trace.current.gl_bind_texture = stats.gl.num_bind_texture;
+    trace.current.gl_uniform = stats.gl.num_uniform;
+    trace.current.duration = trace.last - trace.current.start;
+    if (trace.frame_count == trace.frame_capacity) {
+        trace.frame_capacity = trace.frame_capacity ? trace.frame_capacity * 2 : 1024;
+        trace.frames = realloc(trace.frames, trace.frame_capacity * sizeof(ppl_trace_frame));
+    }
+    trace.frames[trace.frame_count++] = trace.current;
+    trace.current = (ppl_trace_frame){.start = trace.last};
+}
+
+bool ppl_trace_begin(const char *path) {
+    if (trace.active) return false;
+    trace.path = strdup(path);
+    trace.origin = ppl_trace_now();
+    trace.last = 0.0;
+    trace.current = (ppl_trace_frame){0};
+    sg_enable_frame_stats();
+    trace.prev_hooks = sg_install_trace_hooks(&(sg_trace_hooks){
+        .make_buffer = ppl_trace_make_buffer,
+        .make_image = ppl_trace_make_image,
+        .make_sampler = ppl_trace_make_sampler,
+        .make_shader = ppl_trace_make_shader,
+        .make_pipeline = ppl_trace_make_pipeline,
+        .make_attachments = ppl_trace_make_attachments,
+        .destroy_buffer = ppl_trace_destroy_buffer,
+        .destroy_image = ppl_trace_destroy_image,
+        .destroy_sampler = ppl_trace_destroy_sampler,
+        .destroy_shader = ppl_trace_destroy_shader,
+        .destroy_pipeline = ppl_trace_destroy_pipeline,
+        .destroy_attachments = ppl_trace_destroy_attachments,
+        .update_buffer = ppl_trace_update_buffer,
+        .update_image = ppl_trace_update_image,
+        .append_buffer = ppl_trace_append_buffer,
+        .begin_pass = ppl_trace_begin_pass,
+        .apply_viewport = ppl_trace_apply_viewport,
+        .apply_scissor_rect = ppl_trace_apply_scissor_rect,
+        .apply_pipeline = ppl_trace_apply_pipeline,
+        .apply_bindings = ppl_trace_apply_bindings,
+        .apply_uniforms = ppl_trace_apply_uniforms,
+        .draw = ppl_trace_draw,
+        .end_pass = ppl_trace_end_pass,
+        .commit = ppl_trace_commit,
+    });
+    trace.active = true;
+    return true;
+}
+
+void ppl_trace_mark() {
+    if (trace.active) {
+        trace.last = ppl_trace_now() - trace.origin;
+    }
+}
+
+static bool ppl_trace_write_csv(FILE *f) {
+    fprintf(f, "frame,ms,calls,passes,pipelines,bindings,uniforms,draws,elements,uniform_bytes,upload_bytes,"
+               "gl_bind_buffer,gl_bind_texture,gl_uniform\n");
+    for (int i = 0; i < trace.frame_count; i++) {
+        ppl_trace_frame *fr = &trace.frames[i];
+        fprintf(f, "%d,%.3f,%d,%d,%d,%d,%d,%d,%lld,%lld,%lld,%u,%u,%u\n", i, fr->duration / 1e3, fr->calls,
+                fr->passes, fr->pipelines, fr->bindings, fr->uniforms, fr->draws, (long long)fr->elements,
+                (long long)fr->uniform_bytes, (long long)fr->upload_bytes, fr->gl_bind_buffer, fr->gl_bind_texture,
+                fr->gl_uniform);
+    }
+    return !ferror(f);
+}
+
+// Every call is a complete event inside its frame's, and the frame totals
+// are also counters so they show up as graphs
+static bool ppl_trace_write_json(FILE *f) {
+    fprintf(f, "{\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"sokol_gfx\"}}");
+    for (int i = 0; i < trace.frame_count; i++) {
+        ppl_trace_frame *fr = &trace.frames[i];
+        fprintf(f, ",\n{\"name\":\"frame %d\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,"
+                   "\"args\":{\"calls\":%d,\"draws\":%d,\"bindings\":%d,\"upload_bytes\":%lld}}",
+                i, fr->start, fr->duration, fr->calls, fr->draws, fr->bindings, (long long)fr->upload_bytes);
+        fprintf(f, ",\n{\"name\":\"frame\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+                   "\"args\":{\"draws\":%d,\"bindings\":%d,\"upload_bytes\":%lld}}",
+                fr->start, fr->draws, fr->bindings, (long long)fr->upload_bytes);
+    }
+    for (int i = 0; i < trace.event_count; i++) {
+        ppl_trace_event *e = &trace.events[i];
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                ppl_call_names[e->call], e->start, e->duration);
+    }
+    fprintf(f, "\n]}\n");
+    return !ferror(f);
+}
+
+void ppl_trace_end() {
+    if (!trace.active) return;
+    sg_install_trace_hooks(&trace.prev_hooks);
+    trace.active = false;
+
+    size_t len = strlen(trace.path);
+    bool json = len >= 5 && strcmp(trace.path + len - 5, ".json") == 0;
+    FILE *f = fopen(trace.path, "w");
+    bool ok = f && (json ? ppl_trace_write_json(f) : ppl_trace_write_csv(f));
+    if (f) fclose(f);
+    if (ok) {
+        printf("Wrote %d frames to %s\n", trace.frame_count, trace.path);
+    } else {
+        printf("Couldn't write %s\n", trace.path);
+    }
+    if (trace.event_count == PPL_TRACE_MAX_EVENTS) {
+        printf("Only the first %d calls have events in the trace\n", PPL_TRACE_MAX_EVENTS);
+    }
+
+    printf("%-24s %10s %12s %10s\n", "call", "count", "total ms", "avg us");
+    for (int i = 0; i < PPL_CALL_COUNT; i++) {
+        if (trace.call_counts[i] == 0) continue;
+        printf("%-24s %10d %12.3f %10.3f\n", ppl_call_names[i], trace.call_counts[i], trace.call_times[i] / 1e3,
+               trace.call_times[i] / trace.call_counts[i]);
+    }
+
+    free(trace.path);
+    free(trace.events);
+    free(trace.frames);
+    memset(&trace, 0, sizeof(trace));
+}
@@ -0,0 +1,19 @@
+#ifndef _PPL_TRACE_H
+#define _PPL_TRACE_H
+
+#include <stdbool.h>
+
+// Counts and times sokol_gfx calls through its trace hooks, which ppl.c
+// compiles in with SOKOL_TRACE_HOOKS, and keeps per-frame totals. The
+// hooks run after a call returns, so a call's time is measured from the
+// previous call or ppl_trace_mark, whichever was later.
+
+// Installs the hooks; call after sg_setup. The file written on
+// ppl_trace_end is a Chrome trace if `path` ends in .json, CSV otherwise.
+bool ppl_trace_begin(const char *path);
+// Starts timing the next call from here, ahead of a run of sg_* calls
+void ppl_trace_mark();
+// Restores the previous hooks, writes the file and prints per-call totals
+void ppl_trace_end();
+
+#endif
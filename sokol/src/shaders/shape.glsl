@@ -1,17 +1,165 @@
+// The 2D pipeline of the sdl3-c renderers (lib/draw.h): one VertInput
+// instance per quad, expanded to two triangles from gl_VertexIndex, with
+// rounded corners and borders from a signed distance function
 @vs vs
-in vec4 position;
+layout(binding=0) uniform vs_params {
+    vec2 screen_size;
+};
+
+in vec4 dst_rect; // pixels from the top left
+in vec4 src_rect; // normalized
+in vec4 border_color;
+in vec4 corner_radii;
+in vec4 color0; // top left, bottom left, bottom right, top right
+in vec4 color1;
+in vec4 color2;
+in vec4 color3;
+in vec3 params; // edge softness, border thickness, use texture
+
+out vec4 color;
+out vec2 uv;
+out vec2 position; // pixels, in place of gl_FragCoord whose origin varies
+flat out vec4 rect;
+flat out vec4 v_border_color;
+flat out vec4 v_corner_radii;
+flat out vec3 v_params;
+flat out vec2 v_screen_size;
 
 void main() {
-    gl_Position = vec4(position.x, position.y, position.z, 1.0);
+    const int tri_idx[6] = int[6](0, 1, 2, 2, 3, 0);
+    int p = tri_idx[gl_VertexIndex];
+    vec2 corner = vec2(p >= 2 ? 1.0 : 0.0, p == 1 || p == 2 ? 1.0 : 0.0);
+    vec4 colors[4] = vec4[4](color0, color1, color2, color3);
+    position = dst_rect.xy + dst_rect.zw * corner;
+    gl_Position = vec4(position / screen_size * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0.0, 1.0);
+    uv = src_rect.xy + src_rect.zw * corner;
+    color = colors[p];
+    rect = dst_rect;
+    v_border_color = border_color;
+    v_corner_radii = corner_radii;
+    v_params = params;
+    v_screen_size = screen_size;
 }
 @end
 
 @fs fs
-out vec4 FragColor;
+layout(binding=0) uniform texture2D tex;
+layout(binding=0) uniform sampler smp;
+
+in vec4 color;
+in vec2 uv;
+in vec2 position;
+flat in vec4 rect;
+flat in vec4 v_border_color;
+flat in vec4 v_corner_radii;
+flat in vec3 v_params;
+flat in vec2 v_screen_size;
+
+out vec4 frag_color;
+
+float sdf_rounded_box(vec2 p, vec2 b, vec4 r) {
+    r.xy = (p.x > 0.0) ? r.xy : r.zw;
+    r.x = (p.y > 0.0) ? r.x : r.y;
+    vec2 q = abs(p) - b + r.x;
+    return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r.x;
+}
+
+// Same math as draw_gl.h, in units of half the screen height
+void main() {
+    vec4 t = texture(sampler2D(tex, smp), uv);
+    if (v_params.z > 0.0) {
+        frag_color = color * t;
+        return;
+    }
+    vec2 size = v_screen_size;
+    float border_thickness = v_params.y;
+    vec2 half_size = rect.zw / size.y;
+    vec2 p = (2.0 * position - size) / size.y - (2.0 * (rect.xy + rect.zw / 2.0) - size) / size.y;
+    float d = sdf_rounded_box(p, half_size, v_corner_radii / (size.y / 2.0));
+    float d2 = 0.0;
+    vec2 half_size2 = (rect.zw - (border_thickness * 2.0 + 2.0)) / size.y;
+    if (border_thickness > 0.0) {
+        d2 = sdf_rounded_box(p, half_size2, (v_corner_radii - (border_thickness + 2.0)) / (size.y / 2.0));
+    }
+    frag_color = mix(
+        vec4(v_border_color.rgb, (1.0 - smoothstep(0.0, 0.003, d)) * v_border_color.a),
+        color,
+        1.0 - smoothstep(0.0, 0.005, d2));
+}
+@end
+
+@program batch vs fs
+
+// Sprites are one instance each: the quad's corners come from a per-vertex
+// buffer and everything else from a per-instance one, so any number of
+// sprites with the same texture is one draw
+@vs sprite_vs
+layout(binding=0) uniform vs_params {
+    vec2 screen_size;
+};
+
+in vec2 corner;         // 0..1 across the quad
+in vec4 inst_rect;      // center, size in pixels
+in float inst_rotation; // radians
+in vec4 inst_uv;        // top left, bottom right
+in vec4 inst_color;
+
+out vec2 uv;
+out vec4 v_color;
+
+void main() {
+    vec2 local = (corner - 0.5) * inst_rect.zw;
+    float s = sin(inst_rotation);
+    float c = cos(inst_rotation);
+    vec2 position = inst_rect.xy + vec2(local.x * c - local.y * s, local.x * s + local.y * c);
+    gl_Position = vec4(position / screen_size * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0.0, 1.0);
+    uv = mix(inst_uv.xy, inst_uv.zw, corner);
+    v_color = inst_color;
+}
+@end
+
+@fs sprite_fs
+layout(binding=0) uniform texture2D tex;
+layout(binding=0) uniform sampler smp;
+
+in vec2 uv;
+in vec4 v_color;
+
+out vec4 frag_color;
+
+void main() {
+    frag_color = texture(sampler2D(tex, smp), uv) * v_color;
+}
+@end
+
+@program sprite sprite_vs sprite_fs
+
+// Copies a finished frame to the swapchain with one fullscreen triangle
+@vs blit_vs
+layout(binding=1) uniform blit_params {
+    float flip; // 1 where textures start at the top left
+};
+
+out vec2 uv;
+
+void main() {
+    vec2 p = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+    uv = vec2(p.x, mix(p.y, 1.0 - p.y, flip));
+}
+@end
+
+@fs blit_fs
+layout(binding=0) uniform texture2D tex;
+layout(binding=0) uniform sampler smp;
+
+in vec2 uv;
+
+out vec4 frag_color;
 
 void main() {
-    FragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);
+    frag_color = texture(sampler2D(tex, smp), uv);
 }
 @end
 
-@program simple vs fs
+@program blit blit_vs blit_fs
@@ -1,4 +1,5 @@
 // Compile with: cc -std=c99 wayland.c -Ofast.
+// Run with --fuzz to check the event reader against random read splits.
 
 #define _POSIX_C_SOURCE 200112L
 #include <assert.h>
@@ -14,6 +15,7 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "wayland-logo.h"
@@ -28,6 +30,8 @@ static const uint32_t wayland_display_object_id = 1;
 static const uint16_t wayland_wl_registry_event_global = 0;
 static const uint16_t wayland_shm_pool_event_format = 0;
 static const uint16_t wayland_wl_buffer_event_release = 0;
+static const uint16_t wayland_wl_callback_event_done = 0;
+static const uint16_t wayland_wl_display_delete_id_event = 1;
 static const uint16_t wayland_xdg_wm_base_event_ping = 0;
 static const uint16_t wayland_xdg_toplevel_event_configure = 0;
 static const uint16_t wayland_xdg_toplevel_event_close = 1;
@@ -43,11 +47,61 @@ static const uint16_t wayland_wl_shm_pool_create_buffer_opcode = 0;
 static const uint16_t wayland_wl_surface_attach_opcode = 1;
 static const uint16_t wayland_xdg_surface_get_toplevel_opcode = 1;
 static const uint16_t wayland_wl_surface_commit_opcode = 6;
+static const uint16_t wayland_wl_surface_damage_opcode = 2;
+static const uint16_t wayland_wl_surface_frame_opcode = 3;
+static const uint16_t wayland_wl_shm_pool_resize_opcode = 2;
 static const uint16_t wayland_wl_display_error_event = 0;
 static const uint32_t wayland_format_xrgb8888 = 1;
 static const uint32_t wayland_header_size = 8;
 static const uint32_t color_channels = 4;
 
+#define WAYLAND_OUT_CAP 4096
+#define WAYLAND_OUT_MAX_FDS 28 // Same as libwayland.
+
+typedef struct wayland_out_t wayland_out_t;
+struct wayland_out_t {
+  uint32_t buf[WAYLAND_OUT_CAP / sizeof(uint32_t)]; // Aligned for u32 writes.
+  uint64_t len;
+  int fds[WAYLAND_OUT_MAX_FDS];
+  uint32_t fd_count;
+  uint32_t requests; // Since the last flush.
+  uint64_t total_requests;
+  uint64_t syscalls;
+};
+
+static wayland_out_t wayland_out;
+
+// Big enough for any message, since the size field is 16 bits.
+#define WAYLAND_IN_CAP 65536
+#define WAYLAND_IN_MAX_FDS 28
+
+typedef struct wayland_in_t wayland_in_t;
+struct wayland_in_t {
+  uint32_t buf[WAYLAND_IN_CAP / sizeof(uint32_t)]; // Aligned for u32 reads.
+  uint64_t start; // First byte not parsed yet.
+  uint64_t end;
+  int fds[WAYLAND_IN_MAX_FDS];
+  uint32_t fd_start;
+  uint32_t fd_count;
+  uint64_t reads;
+  uint64_t bytes;
+  uint64_t messages;
+};
+
+static wayland_in_t wayland_in;
+
+// Buffers start double-buffered and are added, up to this many, only when
+// the compositor holds all of them.
+#define WAYLAND_MAX_BUFFERS 4
+#define WAYLAND_START_BUFFERS 2
+
+typedef struct buffer_t buffer_t;
+struct buffer_t {
+  uint32_t wl_buffer;
+  uint32_t offset; // In the shm pool.
+  int busy;        // Attached and not released yet.
+};
+
 typedef enum state_state_t state_state_t;
 enum state_state_t {
   STATE_NONE,
@@ -60,7 +114,11 @@ struct state_t {
   uint32_t wl_registry;
   uint32_t wl_shm;
   uint32_t wl_shm_pool;
-  uint32_t wl_buffer;
+  buffer_t buffers[WAYLAND_MAX_BUFFERS];
+  uint32_t buffer_count;
+  uint32_t buffer_size;
+  uint32_t wl_callback; // Pending frame callback.
+  int frame_due;
   uint32_t xdg_wm_base;
   uint32_t xdg_surface;
   uint32_t wl_compositor;
@@ -74,6 +132,11 @@ struct state_t {
   uint8_t *shm_pool_data;
 
   state_state_t state;
+
+  uint64_t frames;
+  uint64_t frames_waited; // Frames that were due with every buffer busy.
+  uint64_t fps_frames;
+  struct timeval fps_start;
 };
 
 static int wayland_display_connect() {
@@ -144,6 +207,168 @@ static void buf_write_string(char *buf, uint64_t *buf_size, uint64_t buf_cap,
   *buf_size += roundup_4(src_len);
 }
 
+// Requests are queued here and sent with a single sendmsg per flush, along
+// with the file descriptors they pass, instead of one send per request.
+static void wayland_flush(int fd) {
+  if (wayland_out.len == 0)
+    return;
+
+  char *data = (char *)wayland_out.buf;
+  uint64_t sent = 0;
+  uint32_t fd_count = wayland_out.fd_count;
+  uint32_t syscalls = 0;
+  while (sent < wayland_out.len) {
+    struct iovec io = {.iov_base = data + sent,
+                       .iov_len = wayland_out.len - sent};
+    struct msghdr socket_msg = {.msg_iov = &io, .msg_iovlen = 1};
+
+    // UNIX/Macros monstrosities ahead.
+    char buf[CMSG_SPACE(sizeof(int) * WAYLAND_OUT_MAX_FDS)] = "";
+    if (wayland_out.fd_count > 0) {
+      uint64_t fds_size = sizeof(int) * wayland_out.fd_count;
+      socket_msg.msg_control = buf;
+      socket_msg.msg_controllen = CMSG_SPACE(fds_size);
+
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&socket_msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(fds_size);
+      memcpy(CMSG_DATA(cmsg), wayland_out.fds, fds_size);
+    }
+
+    int64_t n = sendmsg(fd, &socket_msg, 0);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      exit(errno);
+
+    // The fds went with the first chunk.
+    wayland_out.fd_count = 0;
+    sent += (uint64_t)n;
+    syscalls++;
+  }
+
+  wayland_out.syscalls += syscalls;
+  printf("-> flush: requests=%u bytes=%lu fds=%u sendmsg=%u\n",
+         wayland_out.requests, wayland_out.len, fd_count, syscalls);
+
+  wayland_out.len = 0;
+  wayland_out.requests = 0;
+}
+
+static void wayland_queue(int fd, char *msg, uint64_t msg_size) {
+  assert(msg_size <= sizeof(wayland_out.buf));
+  assert(roundup_4(msg_size) == msg_size);
+
+  if (wayland_out.len + msg_size > sizeof(wayland_out.buf))
+    wayland_flush(fd);
+
+  memcpy((char *)wayland_out.buf + wayland_out.len, msg, msg_size);
+  wayland_out.len += msg_size;
+  wayland_out.requests++;
+  wayland_out.total_requests++;
+}
+
+// Must be followed by the request that passes `passed_fd`.
+static void wayland_queue_fd(int fd, int passed_fd) {
+  if (wayland_out.fd_count == WAYLAND_OUT_MAX_FDS)
+    wayland_flush(fd);
+
+  wayland_out.fds[wayland_out.fd_count++] = passed_fd;
+}
+
+// Reads whatever the socket has after the unparsed bytes, along with any
+// fds passed with it. Complete messages are then parsed where they are, and
+// only a trailing partial message is moved, to the front, before the next
+// read.
+static void wayland_read(int fd, wayland_in_t *in) {
+  if (in->start > 0) {
+    memmove(in->buf, (char *)in->buf + in->start, in->end - in->start);
+    in->end -= in->start;
+    in->start = 0;
+  }
+  assert(in->end < sizeof(in->buf));
+
+  struct iovec io = {.iov_base = (char *)in->buf + in->end,
+                     .iov_len = sizeof(in->buf) - in->end};
+  char buf[CMSG_SPACE(sizeof(int) * WAYLAND_IN_MAX_FDS)] = "";
+  struct msghdr socket_msg = {
+      .msg_iov = &io,
+      .msg_iovlen = 1,
+      .msg_control = buf,
+      .msg_controllen = sizeof(buf),
+  };
+
+  int64_t read_bytes;
+  do {
+    read_bytes = recvmsg(fd, &socket_msg, 0);
+  } while (read_bytes == -1 && errno == EINTR);
+  if (read_bytes == -1)
+    exit(errno);
+  if (read_bytes == 0) {
+    fprintf(stderr, "compositor closed the connection\n");
+    exit(EPIPE);
+  }
+  if (socket_msg.msg_flags & MSG_CTRUNC) {
+    fprintf(stderr, "too many fds in one read\n");
+    exit(EMSGSIZE);
+  }
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&socket_msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&socket_msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    uint64_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (uint64_t i = 0; i < count; i++) {
+      int passed_fd;
+      memcpy(&passed_fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+      if (in->fd_count == WAYLAND_IN_MAX_FDS) {
+        fprintf(stderr, "fd queue full\n");
+        exit(EMFILE);
+      }
+      in->fds[(in->fd_start + in->fd_count++) % WAYLAND_IN_MAX_FDS] =
+          passed_fd;
+    }
+  }
+
+  in->end += (uint64_t)read_bytes;
+  in->reads++;
+  in->bytes += (uint64_t)read_bytes;
+}
+
+// Points `msg` at the next complete message, without copying it.
+static int wayland_next_message(wayland_in_t *in, char **msg,
+                                uint64_t *msg_len) {
+  uint64_t available = in->end - in->start;
+  if (available < wayland_header_size)
+    return 0;
+
+  char *next = (char *)in->buf + in->start;
+  uint16_t announced_size = *(uint16_t *)(next + 6);
+  assert(announced_size >= wayland_header_size);
+  assert(roundup_4(announced_size) == announced_size);
+  if (announced_size > available)
+    return 0;
+
+  *msg = next;
+  *msg_len = announced_size;
+  in->start += announced_size;
+  in->messages++;
+  return 1;
+}
+
+// Fds are handed out in the order they arrived, for the events that carry
+// them.
+static int wayland_take_fd(wayland_in_t *in) {
+  assert(in->fd_count > 0);
+
+  int passed_fd = in->fds[in->fd_start];
+  in->fd_start = (in->fd_start + 1) % WAYLAND_IN_MAX_FDS;
+  in->fd_count--;
+  return passed_fd;
+}
+
 static uint32_t buf_read_u32(char **buf, uint64_t *buf_size) {
   assert(*buf_size >= sizeof(uint32_t));
   assert((size_t)*buf % sizeof(uint32_t) == 0);
@@ -191,8 +416,7 @@ static uint32_t wayland_wl_display_get_registry(int fd) {
   wayland_current_id++;
   buf_write_u32(msg, &msg_size, sizeof(msg), wayland_current_id);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> wl_display@%u.get_registry: wl_registry=%u\n",
          wayland_display_object_id, wayland_current_id);
@@ -225,8 +449,7 @@ static uint32_t wayland_wl_registry_bind(int fd, uint32_t registry,
 
   assert(msg_size == roundup_4(msg_size));
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> wl_registry@%u.bind: name=%u interface=%.*s version=%u\n",
          registry, name, interface_len, interface, version);
@@ -252,8 +475,7 @@ static uint32_t wayland_wl_compositor_create_surface(int fd, state_t *state) {
   wayland_current_id++;
   buf_write_u32(msg, &msg_size, sizeof(msg), wayland_current_id);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> wl_compositor@%u.create_surface: wl_surface=%u\n",
          state->wl_compositor, wayland_current_id);
@@ -298,8 +520,7 @@ static void wayland_xdg_wm_base_pong(int fd, state_t *state, uint32_t ping) {
 
   buf_write_u32(msg, &msg_size, sizeof(msg), ping);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> xdg_wm_base@%u.pong: ping=%u\n", state->xdg_wm_base, ping);
 }
@@ -321,8 +542,7 @@ static void wayland_xdg_surface_ack_configure(int fd, state_t *state,
 
   buf_write_u32(msg, &msg_size, sizeof(msg), configure);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> xdg_surface@%u.ack_configure: configure=%u\n", state->xdg_surface,
          configure);
@@ -351,28 +571,9 @@ static uint32_t wayland_wl_shm_create_pool(int fd, state_t *state) {
 
   assert(roundup_4(msg_size) == msg_size);
 
-  // Send the file descriptor as ancillary data.
-  // UNIX/Macros monstrosities ahead.
-  char buf[CMSG_SPACE(sizeof(state->shm_fd))] = "";
-
-  struct iovec io = {.iov_base = msg, .iov_len = msg_size};
-  struct msghdr socket_msg = {
-      .msg_iov = &io,
-      .msg_iovlen = 1,
-      .msg_control = buf,
-      .msg_controllen = sizeof(buf),
-  };
-
-  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&socket_msg);
-  cmsg->cmsg_level = SOL_SOCKET;
-  cmsg->cmsg_type = SCM_RIGHTS;
-  cmsg->cmsg_len = CMSG_LEN(sizeof(state->shm_fd));
-
-  *((int *)CMSG_DATA(cmsg)) = state->shm_fd;
-  socket_msg.msg_controllen = CMSG_SPACE(sizeof(state->shm_fd));
-
-  if (sendmsg(fd, &socket_msg, 0) == -1)
-    exit(errno);
+  // The file descriptor goes out as ancillary data with the next flush.
+  wayland_queue_fd(fd, state->shm_fd);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> wl_shm@%u.create_pool: wl_shm_pool=%u\n", state->wl_shm,
          wayland_current_id);
@@ -402,8 +603,7 @@ static uint32_t wayland_xdg_wm_base_get_xdg_surface(int fd, state_t *state) {
 
   buf_write_u32(msg, &msg_size, sizeof(msg), state->wl_surface);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> xdg_wm_base@%u.get_xdg_surface: xdg_surface=%u wl_surface=%u\n",
          state->xdg_wm_base, wayland_current_id, state->wl_surface);
@@ -411,7 +611,8 @@ static uint32_t wayland_xdg_wm_base_get_xdg_surface(int fd, state_t *state) {
   return wayland_current_id;
 }
 
-static uint32_t wayland_wl_shm_pool_create_buffer(int fd, state_t *state) {
+static uint32_t wayland_wl_shm_pool_create_buffer(int fd, state_t *state,
+                                                  uint32_t offset) {
   assert(state->wl_shm_pool > 0);
 
   uint64_t msg_size = 0;
@@ -429,7 +630,6 @@ static uint32_t wayland_wl_shm_pool_create_buffer(int fd, state_t *state) {
   wayland_current_id++;
   buf_write_u32(msg, &msg_size, sizeof(msg), wayland_current_id);
 
-  uint32_t offset = 0;
   buf_write_u32(msg, &msg_size, sizeof(msg), offset);
 
   buf_write_u32(msg, &msg_size, sizeof(msg), state->w);
@@ -441,18 +641,40 @@ static uint32_t wayland_wl_shm_pool_create_buffer(int fd, state_t *state) {
   uint32_t format = wayland_format_xrgb8888;
   buf_write_u32(msg, &msg_size, sizeof(msg), format);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
-  printf("-> wl_shm_pool@%u.create_buffer: wl_buffer=%u\n", state->wl_shm_pool,
-         wayland_current_id);
+  printf("-> wl_shm_pool@%u.create_buffer: wl_buffer=%u offset=%u\n",
+         state->wl_shm_pool, wayland_current_id, offset);
 
   return wayland_current_id;
 }
 
-static void wayland_wl_surface_attach(int fd, state_t *state) {
+static void wayland_wl_shm_pool_resize(int fd, state_t *state) {
+  assert(state->wl_shm_pool > 0);
+
+  uint64_t msg_size = 0;
+  char msg[128] = "";
+  buf_write_u32(msg, &msg_size, sizeof(msg), state->wl_shm_pool);
+
+  buf_write_u16(msg, &msg_size, sizeof(msg), wayland_wl_shm_pool_resize_opcode);
+
+  uint16_t msg_announced_size =
+      wayland_header_size + sizeof(state->shm_pool_size);
+  assert(roundup_4(msg_announced_size) == msg_announced_size);
+  buf_write_u16(msg, &msg_size, sizeof(msg), msg_announced_size);
+
+  buf_write_u32(msg, &msg_size, sizeof(msg), state->shm_pool_size);
+
+  wayland_queue(fd, msg, msg_size);
+
+  printf("-> wl_shm_pool@%u.resize: size=%u\n", state->wl_shm_pool,
+         state->shm_pool_size);
+}
+
+static void wayland_wl_surface_attach(int fd, state_t *state,
+                                      uint32_t wl_buffer) {
   assert(state->wl_surface > 0);
-  assert(state->wl_buffer > 0);
+  assert(wl_buffer > 0);
 
   uint64_t msg_size = 0;
   char msg[128] = "";
@@ -461,21 +683,70 @@ static void wayland_wl_surface_attach(int fd, state_t *state) {
   buf_write_u16(msg, &msg_size, sizeof(msg), wayland_wl_surface_attach_opcode);
 
   uint16_t msg_announced_size =
-      wayland_header_size + sizeof(state->wl_buffer) + sizeof(uint32_t) * 2;
+      wayland_header_size + sizeof(wl_buffer) + sizeof(uint32_t) * 2;
   assert(roundup_4(msg_announced_size) == msg_announced_size);
   buf_write_u16(msg, &msg_size, sizeof(msg), msg_announced_size);
 
-  buf_write_u32(msg, &msg_size, sizeof(msg), state->wl_buffer);
+  buf_write_u32(msg, &msg_size, sizeof(msg), wl_buffer);
 
   uint32_t x = 0, y = 0;
   buf_write_u32(msg, &msg_size, sizeof(msg), x);
   buf_write_u32(msg, &msg_size, sizeof(msg), y);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> wl_surface@%u.attach: wl_buffer=%u\n", state->wl_surface,
-         state->wl_buffer);
+         wl_buffer);
+}
+
+static void wayland_wl_surface_damage(int fd, state_t *state) {
+  assert(state->wl_surface > 0);
+
+  uint64_t msg_size = 0;
+  char msg[128] = "";
+  buf_write_u32(msg, &msg_size, sizeof(msg), state->wl_surface);
+
+  buf_write_u16(msg, &msg_size, sizeof(msg), wayland_wl_surface_damage_opcode);
+
+  uint16_t msg_announced_size = wayland_header_size + sizeof(uint32_t) * 4;
+  assert(roundup_4(msg_announced_size) == msg_announced_size);
+  buf_write_u16(msg, &msg_size, sizeof(msg), msg_announced_size);
+
+  uint32_t x = 0, y = 0;
+  buf_write_u32(msg, &msg_size, sizeof(msg), x);
+  buf_write_u32(msg, &msg_size, sizeof(msg), y);
+  buf_write_u32(msg, &msg_size, sizeof(msg), state->w);
+  buf_write_u32(msg, &msg_size, sizeof(msg), state->h);
+
+  wayland_queue(fd, msg, msg_size);
+
+  printf("-> wl_surface@%u.damage: w=%u h=%u\n", state->wl_surface, state->w,
+         state->h);
+}
+
+static uint32_t wayland_wl_surface_frame(int fd, state_t *state) {
+  assert(state->wl_surface > 0);
+
+  uint64_t msg_size = 0;
+  char msg[128] = "";
+  buf_write_u32(msg, &msg_size, sizeof(msg), state->wl_surface);
+
+  buf_write_u16(msg, &msg_size, sizeof(msg), wayland_wl_surface_frame_opcode);
+
+  uint16_t msg_announced_size =
+      wayland_header_size + sizeof(wayland_current_id);
+  assert(roundup_4(msg_announced_size) == msg_announced_size);
+  buf_write_u16(msg, &msg_size, sizeof(msg), msg_announced_size);
+
+  wayland_current_id++;
+  buf_write_u32(msg, &msg_size, sizeof(msg), wayland_current_id);
+
+  wayland_queue(fd, msg, msg_size);
+
+  printf("-> wl_surface@%u.frame: wl_callback=%u\n", state->wl_surface,
+         wayland_current_id);
+
+  return wayland_current_id;
 }
 
 static uint32_t wayland_xdg_surface_get_toplevel(int fd, state_t *state) {
@@ -496,8 +767,7 @@ static uint32_t wayland_xdg_surface_get_toplevel(int fd, state_t *state) {
   wayland_current_id++;
   buf_write_u32(msg, &msg_size, sizeof(msg), wayland_current_id);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> xdg_surface@%u.get_toplevel: xdg_toplevel=%u\n",
          state->xdg_surface, wayland_current_id);
@@ -518,12 +788,19 @@ static void wayland_wl_surface_commit(int fd, state_t *state) {
   assert(roundup_4(msg_announced_size) == msg_announced_size);
   buf_write_u16(msg, &msg_size, sizeof(msg), msg_announced_size);
 
-  if ((int64_t)msg_size != send(fd, msg, msg_size, 0))
-    exit(errno);
+  wayland_queue(fd, msg, msg_size);
 
   printf("-> wl_surface@%u.commit: \n", state->wl_surface);
 }
 
+static buffer_t *state_find_buffer(state_t *state, uint32_t wl_buffer) {
+  for (uint32_t i = 0; i < state->buffer_count; i++) {
+    if (state->buffers[i].wl_buffer == wl_buffer)
+      return &state->buffers[i];
+  }
+  return NULL;
+}
+
 static void wayland_handle_message(int fd, state_t *state, char **msg,
                                    uint64_t *msg_len) {
   assert(*msg_len >= 8);
@@ -599,11 +876,27 @@ static void wayland_handle_message(int fd, state_t *state, char **msg,
     uint32_t format = buf_read_u32(msg, msg_len);
     printf("<- wl_shm: format=%#x\n", format);
     return;
-  } else if (object_id == state->wl_buffer &&
+  } else if (object_id == wayland_display_object_id &&
+             opcode == wayland_wl_display_delete_id_event) {
+    uint32_t id = buf_read_u32(msg, msg_len);
+    printf("<- wl_display@%u.delete_id: id=%u\n", wayland_display_object_id,
+           id);
+    return;
+  } else if (object_id == state->wl_callback &&
+             opcode == wayland_wl_callback_event_done) {
+    uint32_t callback_data = buf_read_u32(msg, msg_len);
+    printf("<- wl_callback@%u.done: callback_data=%u\n", state->wl_callback,
+           callback_data);
+    state->wl_callback = 0;
+    state->frame_due = 1;
+    return;
+  } else if (state_find_buffer(state, object_id) != NULL &&
              opcode == wayland_wl_buffer_event_release) {
-    // No-op, for now.
+    buffer_t *buffer = state_find_buffer(state, object_id);
+    assert(buffer->busy);
+    buffer->busy = 0;
 
-    printf("<- xdg_wl_buffer@%u.release\n", state->wl_buffer);
+    printf("<- wl_buffer@%u.release\n", object_id);
     return;
   } else if (object_id == state->xdg_wm_base &&
              opcode == wayland_xdg_wm_base_event_ping) {
@@ -637,6 +930,9 @@ static void wayland_handle_message(int fd, state_t *state, char **msg,
   } else if (object_id == state->xdg_toplevel &&
              opcode == wayland_xdg_toplevel_event_close) {
     printf("<- xdg_toplevel@%u.close\n", state->xdg_toplevel);
+    printf("requests=%lu sendmsg=%lu frames=%lu buffers=%u waited=%lu\n",
+           wayland_out.total_requests, wayland_out.syscalls, state->frames,
+           state->buffer_count, state->frames_waited);
     exit(0);
   }
 
@@ -645,7 +941,239 @@ static void wayland_handle_message(int fd, state_t *state, char **msg,
   assert(0 && "todo");
 }
 
-int main() {
+static double seconds_since(struct timeval *start) {
+  struct timeval now = {0};
+  if (gettimeofday(&now, NULL) == -1)
+    exit(errno);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_usec - start->tv_usec) / 1e6;
+}
+
+// Sends a stream of random messages over a socketpair in random chunks,
+// some carrying an fd, and checks the reader gets every message intact and
+// every fd, whatever the split points.
+static int wayland_fuzz() {
+  const uint64_t message_count = 50000;
+  srand(1);
+
+  uint64_t stream_cap = message_count * 1024, stream_len = 0;
+  char *stream = malloc(stream_cap);
+  assert(stream != NULL);
+  for (uint64_t i = 0; i < message_count; i++) {
+    // Mostly small messages, like most events, with some up to the largest
+    // the size field allows.
+    uint32_t payload_size = 4 * (uint32_t)(rand() % 64);
+    if (rand() % 100 == 0)
+      payload_size = 4 * (uint32_t)(rand() % 16382);
+    else if (rand() % 10 == 0)
+      payload_size = 4 * (uint32_t)(rand() % 1022);
+
+    uint64_t msg_size = wayland_header_size + payload_size;
+    if (stream_len + msg_size > stream_cap) {
+      stream_cap *= 2;
+      stream = realloc(stream, stream_cap);
+      assert(stream != NULL);
+    }
+
+    buf_write_u32(stream, &stream_len, stream_cap, (uint32_t)i + 1);
+    buf_write_u16(stream, &stream_len, stream_cap, (uint16_t)(rand() % 16));
+    buf_write_u16(stream, &stream_len, stream_cap, (uint16_t)msg_size);
+    for (uint32_t j = 0; j < payload_size; j++)
+      stream[stream_len++] = (char)rand();
+  }
+
+  int sv[2] = {0};
+  int count_pipe[2] = {0};
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1 || pipe(count_pipe) == -1)
+    exit(errno);
+
+  pid_t pid = fork();
+  if (pid == -1)
+    exit(errno);
+
+  if (pid == 0) {
+    close(sv[0]);
+    srand(2);
+
+    int passed_fd = open("/dev/null", O_RDONLY);
+    assert(passed_fd != -1);
+
+    uint64_t sent = 0, fds_sent = 0;
+    while (sent < stream_len) {
+      uint64_t chunk = rand() % 4 == 0 ? 1 + rand() % 16 : 1 + rand() % 8192;
+      if (chunk > stream_len - sent)
+        chunk = stream_len - sent;
+
+      struct iovec io = {.iov_base = stream + sent, .iov_len = chunk};
+      struct msghdr socket_msg = {.msg_iov = &io, .msg_iovlen = 1};
+      char buf[CMSG_SPACE(sizeof(passed_fd))] = "";
+      if (rand() % 64 == 0) {
+        socket_msg.msg_control = buf;
+        socket_msg.msg_controllen = sizeof(buf);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&socket_msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(passed_fd));
+        memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(passed_fd));
+        fds_sent++;
+      }
+
+      int64_t n = sendmsg(sv[1], &socket_msg, 0);
+      if (n == -1)
+        exit(errno);
+      sent += (uint64_t)n;
+    }
+
+    if (write(count_pipe[1], &fds_sent, sizeof(fds_sent)) != sizeof(fds_sent))
+      exit(errno);
+    exit(0);
+  }
+
+  close(sv[1]);
+  close(count_pipe[1]);
+
+  wayland_in_t *in = calloc(1, sizeof(wayland_in_t));
+  assert(in != NULL);
+
+  struct timeval start = {0};
+  if (gettimeofday(&start, NULL) == -1)
+    exit(errno);
+
+  uint64_t parsed = 0, fds_received = 0;
+  while (parsed < stream_len) {
+    wayland_read(sv[0], in);
+
+    char *msg = NULL;
+    uint64_t msg_len = 0;
+    while (wayland_next_message(in, &msg, &msg_len)) {
+      if (msg_len > stream_len - parsed ||
+          memcmp(msg, stream + parsed, msg_len) != 0) {
+        fprintf(stderr, "fuzz: message %lu differs\n", in->messages);
+        return 1;
+      }
+      parsed += msg_len;
+    }
+
+    while (in->fd_count > 0) {
+      close(wayland_take_fd(in));
+      fds_received++;
+    }
+  }
+  double elapsed = seconds_since(&start);
+
+  uint64_t fds_sent = 0;
+  if (read(count_pipe[0], &fds_sent, sizeof(fds_sent)) != sizeof(fds_sent))
+    exit(errno);
+  int status = 0;
+  waitpid(pid, &status, 0);
+
+  printf("fuzz: messages=%lu bytes=%lu reads=%lu fds=%lu/%lu\n", in->messages,
+         in->bytes, in->reads, fds_received, fds_sent);
+  printf("fuzz: %.1f MB/s, %.2f M messages/s, %.1f bytes per read\n",
+         in->bytes / elapsed / 1e6, in->messages / elapsed / 1e6,
+         (double)in->bytes / in->reads);
+
+  int ok = in->messages == message_count && fds_received == fds_sent &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  if (!ok)
+    fprintf(stderr, "fuzz: failed\n");
+
+  free(in);
+  free(stream);
+  return ok ? 0 : 1;
+}
+
+// Grows the shm file, the mapping and the pool by one buffer.
+static void wayland_add_buffer(int fd, state_t *state) {
+  assert(state->buffer_count < WAYLAND_MAX_BUFFERS);
+
+  uint32_t offset = state->buffer_count * state->buffer_size;
+  if (offset + state->buffer_size > state->shm_pool_size) {
+    uint32_t size = offset + state->buffer_size;
+    if (ftruncate(state->shm_fd, size) == -1)
+      exit(errno);
+
+    if (munmap(state->shm_pool_data, state->shm_pool_size) == -1)
+      exit(errno);
+    state->shm_pool_data =
+        mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, state->shm_fd, 0);
+    assert(state->shm_pool_data != MAP_FAILED);
+
+    state->shm_pool_size = size;
+    wayland_wl_shm_pool_resize(fd, state);
+  }
+
+  buffer_t *buffer = &state->buffers[state->buffer_count++];
+  buffer->wl_buffer = wayland_wl_shm_pool_create_buffer(fd, state, offset);
+  buffer->offset = offset;
+  buffer->busy = 0;
+}
+
+// A buffer the compositor isn't reading from, or NULL when they're all
+// held and the pool can't grow.
+static buffer_t *wayland_acquire_buffer(int fd, state_t *state) {
+  for (uint32_t i = 0; i < state->buffer_count; i++) {
+    if (!state->buffers[i].busy)
+      return &state->buffers[i];
+  }
+
+  if (state->buffer_count == WAYLAND_MAX_BUFFERS)
+    return NULL;
+
+  wayland_add_buffer(fd, state);
+  return &state->buffers[state->buffer_count - 1];
+}
+
+// Scrolls the logo sideways by a pixel a frame.
+static void render_frame(state_t *state, buffer_t *buffer) {
+  uint32_t *pixels = (uint32_t *)(state->shm_pool_data + buffer->offset);
+  uint32_t shift = state->frames % state->w;
+  for (uint32_t y = 0; y < state->h; y++) {
+    for (uint32_t x = 0; x < state->w; x++) {
+      uint32_t i = y * state->w + (x + shift) % state->w;
+      uint8_t r = wayland_logo[i * 3 + 0];
+      uint8_t g = wayland_logo[i * 3 + 1];
+      uint8_t b = wayland_logo[i * 3 + 2];
+      pixels[y * state->w + x] = (r << 16) | (g << 8) | b;
+    }
+  }
+}
+
+static void wayland_present_frame(int fd, state_t *state) {
+  buffer_t *buffer = wayland_acquire_buffer(fd, state);
+  if (buffer == NULL) {
+    // Tried again once a release arrives.
+    state->frames_waited++;
+    return;
+  }
+
+  render_frame(state, buffer);
+
+  state->wl_callback = wayland_wl_surface_frame(fd, state);
+  wayland_wl_surface_attach(fd, state, buffer->wl_buffer);
+  wayland_wl_surface_damage(fd, state);
+  wayland_wl_surface_commit(fd, state);
+  buffer->busy = 1;
+  state->frame_due = 0;
+
+  state->frames++;
+  state->fps_frames++;
+  double elapsed = seconds_since(&state->fps_start);
+  if (elapsed >= 1.0) {
+    printf("fps=%.1f frames=%lu buffers=%u waited=%lu\n",
+           state->fps_frames / elapsed, state->frames, state->buffer_count,
+           state->frames_waited);
+    state->fps_frames = 0;
+    if (gettimeofday(&state->fps_start, NULL) == -1)
+      exit(errno);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--fuzz") == 0)
+    return wayland_fuzz();
+
   struct timeval tv = {0};
   assert(gettimeofday(&tv, NULL) != -1);
   srand(tv.tv_sec * 1000 * 1000 + tv.tv_usec);
@@ -659,20 +1187,22 @@ int main() {
       .stride = 117 * color_channels,
   };
 
-  // Single buffering.
-  state.shm_pool_size = state.h * state.stride;
+  state.buffer_size = state.h * state.stride;
+  state.shm_pool_size = state.buffer_size * WAYLAND_START_BUFFERS;
   create_shared_memory_file(state.shm_pool_size, &state);
+  if (gettimeofday(&state.fps_start, NULL) == -1)
+    exit(errno);
 
   while (1) {
-    char read_buf[4096] = "";
-    int64_t read_bytes = recv(fd, read_buf, sizeof(read_buf), 0);
-    if (read_bytes == -1)
-      exit(errno);
+    // Everything queued while handling the last batch of events and
+    // rendering goes out together before waiting for more.
+    wayland_flush(fd);
 
-    char *msg = read_buf;
-    uint64_t msg_len = (uint64_t)read_bytes;
+    wayland_read(fd, &wayland_in);
 
-    while (msg_len > 0)
+    char *msg = NULL;
+    uint64_t msg_len = 0;
+    while (wayland_next_message(&wayland_in, &msg, &msg_len))
       wayland_handle_message(fd, &state, &msg, &msg_len);
 
     if (state.wl_compositor != 0 && state.wl_shm != 0 &&
@@ -687,31 +1217,28 @@ int main() {
     }
 
     if (state.state == STATE_SURFACE_ACKED_CONFIGURE) {
-      // Render a frame.
+      // Render the first frame, which starts the frame callbacks.
       assert(state.wl_surface != 0);
       assert(state.xdg_surface != 0);
       assert(state.xdg_toplevel != 0);
 
-      if (state.wl_shm_pool == 0)
+      if (state.wl_shm_pool == 0) {
         state.wl_shm_pool = wayland_wl_shm_create_pool(fd, &state);
-      if (state.wl_buffer == 0)
-        state.wl_buffer = wayland_wl_shm_pool_create_buffer(fd, &state);
+        for (uint32_t i = 0; i < WAYLAND_START_BUFFERS; i++)
+          wayland_add_buffer(fd, &state);
+      }
 
       assert(state.shm_pool_data != 0);
       assert(state.shm_pool_size != 0);
 
-      uint32_t *pixels = (uint32_t *)state.shm_pool_data;
-      for (uint32_t i = 0; i < state.w * state.h; i++) {
-        uint8_t r = wayland_logo[i * 3 + 0];
-        uint8_t g = wayland_logo[i * 3 + 1];
-        uint8_t b = wayland_logo[i * 3 + 2];
-        pixels[i] = (r << 16) | (g << 8) | b;
-      }
-      wayland_wl_surface_attach(fd, &state);
-      wayland_wl_surface_commit(fd, &state);
-
+      if (state.wl_callback == 0)
+        state.frame_due = 1;
       state.state = STATE_SURFACE_ATTACHED;
     }
+
+    // Animate continuously, a frame per frame callback.
+    if (state.state == STATE_SURFACE_ATTACHED && state.frame_due)
+      wayland_present_frame(fd, &state);
   }
 }
 